@@ -75,6 +75,89 @@ def _get_cache_opts(level, options):
     return opts
 
 
+# Triangel features a shadow prefetcher can toggle, by the name given to
+# --triangelshadows, mapped to the parameter they flip.
+_triangel_ablations = {
+    "scs": "use_scs",
+    "bloom": "use_bloom",
+    "reuse": "use_reuse",
+    "pattern": "use_pattern",
+    "pattern2": "use_pattern2",
+    "mrb": "use_mrb",
+    "perfbias": "perfbias",
+    "smallduel": "smallduel",
+    "timedscs": "timed_scs",
+    "rearrange": "should_rearrange",
+    "structural": "structural_addresses",
+}
+
+
+def _triangel_ablation(params, name):
+    """Parameters of a Triangel variant with feature name toggled."""
+    if name not in _triangel_ablations:
+        print(
+            "Unknown Triangel shadow '%s', expected one of: %s"
+            % (name, ", ".join(sorted(_triangel_ablations)))
+        )
+        sys.exit(1)
+    param = _triangel_ablations[name]
+    default = getattr(TriangelPrefetcher, param)
+    return {param: not params.get(param, default)}
+
+
+def _triangel_encoding(params, encoding, line_size):
+    """Parameters selecting a Markov encoding, with the rounded table as
+    wide as the entries the encoding packs into each line, over the same
+    number of LLC lines. Mirrors markovEntriesPerLine in triangel.cc."""
+
+    def param(name):
+        return params.get(name, getattr(TriangelPrefetcher, name))
+
+    successors = int(param("address_map_successors"))
+    # A confidence bit per successor, plus its recency position when
+    # there are several
+    per_successor = 1 + (successors - 1).bit_length()
+    tag_bits = int(param("address_map_tag_bits"))
+    target_bits = int(param("address_map_target_bits"))
+    page_bits = int(param("address_map_page_bits"))
+
+    def entry_bits(bits):
+        return tag_bits + successors * (per_successor + bits)
+
+    line_bits = line_size * 8
+    updates = dict(
+        address_map_encoding=encoding,
+        address_map_actual_entries="0",
+        address_map_actual_cache_assoc=0,
+        lookup_assoc=0,
+    )
+    if encoding == "full":
+        per_line = line_bits // entry_bits(target_bits)
+    elif encoding == "lookup_table":
+        updates["lookup_assoc"] = int(param("lookup_assoc")) or 16
+        per_line = line_bits // entry_bits(
+            10 + int(param("lookup_offset"))
+        )
+    elif encoding == "delta":
+        per_line = line_bits // entry_bits(
+            int(param("address_map_delta_bits"))
+        )
+    else:
+        per_line = (line_bits - (target_bits - page_bits)) // entry_bits(
+            page_bits
+        )
+
+    lines = MemorySize(param("address_map_rounded_entries")).value // int(
+        param("address_map_rounded_cache_assoc")
+    )
+    assoc = 1 << (per_line - 1).bit_length()
+    updates.update(
+        address_map_rounded_cache_assoc=assoc,
+        address_map_rounded_entries=str(lines * assoc),
+    )
+    return updates
+
+
 def config_cache(options, system):
     if options.external_memory_system and (options.caches or options.l2cache):
         print("External caches and internal caches are exclusive options.\n")
@@ -176,11 +259,70 @@ def config_cache(options, system):
         system.l3 = l3_cache_class(
             clk_domain=system.cpu_clk_domain, **_get_cache_opts("l3", options)
         )
+        if options.triangelconfhints:
+            # Insert the prefetches Triangel doubts at distant re-reference.
+            system.l3.replacement_policy = RRIPRP()
 
         # TODO: config for L3 croassbar?
         system.tol3bus = L2XBar(clk_domain=system.cpu_clk_domain)
         system.l3.cpu_side = system.tol3bus.mem_side_ports
         system.l3.mem_side = system.membus.cpu_side_ports
+        if options.triangeltimed:
+            # Markov table accesses reach the L3 on their own crossbar, so
+            # they are never snooped and never touch guest lines.
+            system.tol3metadatabus = NoncoherentXBar(
+                clk_domain=system.cpu_clk_domain,
+                width=32,
+                frontend_latency=1,
+                forward_latency=0,
+                response_latency=1,
+            )
+            system.tol3metadatabus.mem_side_ports = system.l3.metadata_side
+
+        if options.triangeldual:
+            # All cores' Triangel prefetchers steal ways from the same L3,
+            # so they share one Markov table and partition decision.
+            metadata_params = dict(
+                address_map_actual_entries="393216",
+                address_map_max_ways=8,
+                address_map_actual_cache_assoc=12,
+                address_map_rounded_entries="524288",
+                address_map_rounded_cache_assoc=16,
+                address_map_encoding="full",
+                address_map_tag_bits=10,
+                address_map_target_bits=31,
+                address_map_delta_bits=10,
+                address_map_page_bits=8,
+                lookup_assoc=0,
+                lookup_offset=11,
+                address_map_successors=options.triangelsuccessors,
+            )
+            if options.triangelsuccessors > 1:
+                # Let the wider entries set how many fit in a line.
+                metadata_params.update(
+                    address_map_actual_entries="0",
+                    address_map_actual_cache_assoc=0,
+                )
+            if options.triangelencoding:
+                metadata_params.update(
+                    _triangel_encoding(
+                        metadata_params,
+                        options.triangelencoding,
+                        options.cacheline_size,
+                    )
+                )
+            system.triangel_metadata = TriangelMetadataStore(
+                cachetags=system.l3.tags,
+                address_map_cache_indexing_policy=TriangelHashedSetAssociative(
+                    entry_size=1,
+                    assoc=Parent.address_map_rounded_cache_assoc,
+                    size=Parent.address_map_rounded_entries,
+                ),
+                address_map_cache_replacement_policy=RRIPRP(),
+                qos_partitioning=options.triangelqos,
+                qos_min_entries=1,
+                **metadata_params,
+            )
 
     if options.memchecker:
         system.memchecker = MemChecker()
@@ -248,8 +390,7 @@ def config_cache(options, system):
             icache = icache_class()
             dcache = dcache_class()
             if options.triangel:
-                l2_cache = l2_cache_class(
-                    prefetcher=TriangelPrefetcher(
+                triangel_params = dict(
                         cachetags=system.l3.tags,#To take a partition of for the Markov table.
                         cache_delay=25, #5 cycles more than the L3 cache itself
                         degree=4,
@@ -271,11 +412,38 @@ def config_cache(options, system):
                         use_reuse= not options.triangelnoreuse,
                         perfbias = options.triangelperfbias, #Adjusts tuning params to make it more aggressive and less DRAM/L3-partition friendly.
                         should_rearrange = not options.triangelnorearr,
-                        use_mrb = not options.triangelnomrb
-                        
-                        
-                    )
-                )     
+                        use_mrb = not options.triangelnomrb,
+                        #Back off when the shared L3 runs out of MSHRs.
+                        throttling = options.triangelthrottle,
+                        throttle_cache = system.l3,
+                        address_map_successors = options.triangelsuccessors,
+                        #Global miss history alongside the per-PC table.
+                        global_history = options.triangelghb,
+                        structural_addresses = options.triangelstructural,
+                        metadata_prefetch_degree = options.triangelmetadatapf,
+                        confidence_hints = options.triangelconfhints
+                )
+                if options.triangelsuccessors > 1:
+                    #Let the wider entries set how many fit in a line.
+                    triangel_params.update(address_map_actual_entries="0",
+                                           address_map_actual_cache_assoc=0)
+                if options.triangelencoding:
+                    triangel_params.update(_triangel_encoding(
+                        triangel_params, options.triangelencoding,
+                        options.cacheline_size))
+                l2_cache = l2_cache_class(
+                    prefetcher=TriangelPrefetcher(**triangel_params)
+                )
+                if options.triangelshadows:
+                    #Variants trained alongside the real prefetcher, each
+                    #with one feature toggled, scored but never issued.
+                    l2_cache.prefetcher.shadows = [
+                        TriangelPrefetcher(
+                            **dict(triangel_params,
+                                   **_triangel_ablation(triangel_params, name))
+                        )
+                        for name in options.triangelshadows.split(",")
+                    ]
             elif options.triangeldual: 
                 #two-core setup. Assumes 4M 16-way L3.
                 #Note that the size doubles and the number of ways stays the same
@@ -285,6 +453,7 @@ def config_cache(options, system):
                 l2_cache = l2_cache_class(
                     prefetcher=TriangelPrefetcher(
                         cachetags=system.l3.tags,
+                        metadata=system.triangel_metadata,
                         cache_delay=25,
                         address_map_actual_entries="393216",
                         address_map_rounded_entries="524288",
@@ -295,7 +464,13 @@ def config_cache(options, system):
                         use_reuse= not options.triangelnoreuse,
                         perfbias = options.triangelperfbias,
                         should_rearrange = not options.triangelnorearr,
-                        use_mrb = not options.triangelnomrb
+                        use_mrb = not options.triangelnomrb,
+                        throttling = options.triangelthrottle,
+                        throttle_cache = system.l3,
+                        global_history = options.triangelghb,
+                        structural_addresses = options.triangelstructural,
+                        metadata_prefetch_degree = options.triangelmetadatapf,
+                        confidence_hints = options.triangelconfhints
                     )
                 )     
             #The following cases could be rolled together if better parameterised...  sorry!
@@ -339,6 +514,7 @@ def config_cache(options, system):
                         address_map_rounded_entries="65536",
                         address_map_rounded_cache_assoc=16,
                         lookup_assoc=16,
+                        address_map_encoding="lookup_table",
                         use_hawkeye=True,
                         address_map_cache_replacement_policy=WeightedLRURP(),
                     )
@@ -353,6 +529,7 @@ def config_cache(options, system):
                         address_map_rounded_entries="65536",
                         address_map_rounded_cache_assoc=16,
                         lookup_assoc=16,
+                        address_map_encoding="lookup_table",
                         address_map_cache_replacement_policy=LRURP(),
                     )
                 )
@@ -368,6 +545,7 @@ def config_cache(options, system):
                         secondchance_entries="64",
                         sample_entries="512",
                         lookup_assoc=16,
+                        address_map_encoding="lookup_table",
                         address_map_cache_replacement_policy=RRIPRP(),
                     )
                 )
@@ -518,6 +696,26 @@ def config_cache(options, system):
                 )
             else:
                 l2_cache = l2_cache_class()
+            if options.triangeltimed and isinstance(
+                l2_cache.prefetcher, TriangelPrefetcher
+            ):
+                # Send Markov table accesses to the L3 so that they take its
+                # latency and port time instead of a flat cache_delay. They
+                # are named by addresses above all guest memory.
+                l2_cache.prefetcher.metadata_base_addr = max(
+                    int(r.end) for r in system.mem_ranges
+                )
+                l2_cache.prefetcher.metadata_port = (
+                    system.tol3metadatabus.cpu_side_ports
+                )
+            if options.triangelvirtual and isinstance(
+                l2_cache.prefetcher, TriangelPrefetcher
+            ):
+                # Correlate virtual addresses, so that successors scattered
+                # across physical pages are still captured. Every prefetch
+                # leaving the trigger's page is translated by the core's MMU.
+                l2_cache.prefetcher.use_virtual_addresses = True
+                l2_cache.prefetcher.registerMMU(system.cpu[i].mmu)
             # If we have a walker cache specified, instantiate two
             # instances here
             if walk_cache_class:
@@ -542,9 +740,19 @@ def config_cache(options, system):
                 dcache = dcache_mon
             # When connecting the caches, the clock is also inherited
             # from the CPU in question
-            system.cpu[i].addTwoLevelCacheHierarchy(
-                icache, dcache, l2_cache, iwalkcache, dwalkcache
-            )
+            if options.l2_trace:
+                _addTracedTwoLevelCacheHierarchy(
+                    system.cpu[i],
+                    icache,
+                    dcache,
+                    l2_cache,
+                    iwalkcache,
+                    dwalkcache,
+                )
+            else:
+                system.cpu[i].addTwoLevelCacheHierarchy(
+                    icache, dcache, l2_cache, iwalkcache, dwalkcache
+                )
 
             if options.memchecker:
                 # The mem_side ports of the caches haven't been connected yet.
@@ -575,6 +783,21 @@ def config_cache(options, system):
     return system
 
 
+def _addTracedTwoLevelCacheHierarchy(cpu, ic, dc, l2c, iwc, dwc):
+    """BaseCPU.addTwoLevelCacheHierarchy with a CommMonitor in front of
+    the L2, whose probe writes the L2's access stream, PCs included, to
+    <monitor>.trace.trc.gz in the output directory."""
+    cpu.addPrivateSplitL1Caches(ic, dc, iwc, dwc)
+    cpu.toL2Bus = L2XBar()
+    cpu.connectCachedPorts(cpu.toL2Bus.cpu_side_ports)
+    cpu.l2cache = l2c
+    cpu.l2monitor = CommMonitor()
+    cpu.l2monitor.trace = MemTraceProbe(with_pc=True)
+    cpu.toL2Bus.mem_side_ports = cpu.l2monitor.cpu_side_port
+    cpu.l2monitor.mem_side_port = cpu.l2cache.cpu_side
+    cpu._cached_ports = ["l2cache.mem_side"]
+
+
 # ExternalSlave provides a "port", but when that port connects to a cache,
 # the connecting CPU SimObject wants to refer to its "cpu_side".
 # The 'ExternalCache' class provides this adaptation by rewriting the name,
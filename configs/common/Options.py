@@ -197,6 +197,25 @@ def addNoISAOptions(parser):
 
     parser.add_argument("--triangel", action="store_true")
     parser.add_argument("--triangeldual", action="store_true")
+    parser.add_argument(
+        "--triangelqos",
+        action="store_true",
+        help="With --triangeldual, split the shared Markov table between "
+        "cores by their dueller utility",
+    )
+    parser.add_argument(
+        "--triangelsuccessors",
+        type=int,
+        default=1,
+        help="Successors kept per Triangel Markov entry (1 to 4)",
+    )
+    parser.add_argument(
+        "--triangelencoding",
+        choices=["full", "lookup_table", "delta", "page_shared"],
+        default=None,
+        help="Encoding of Triangel's Markov entries; the table is widened "
+        "to hold as many entries per LLC line as the encoding packs",
+    )
     parser.add_argument("--triagedual", action="store_true")
     parser.add_argument("--triagedeg4dual", action="store_true")
     parser.add_argument("--triangelhawk", action="store_true")    
@@ -230,6 +249,56 @@ def addNoISAOptions(parser):
     parser.add_argument("--triangelnoreuse", action="store_true")      
     parser.add_argument("--triangelperfbias", action="store_true")   
     parser.add_argument("--triangelnomrb", action="store_true")           
+    parser.add_argument("--triangeltimed", action="store_true")
+    parser.add_argument(
+        "--triangelthrottle",
+        action="store_true",
+        help="Adapt Triangel's per-PC degree to prefetch accuracy and back "
+        "off while the L3's MSHRs are saturated",
+    )
+    parser.add_argument(
+        "--triangelshadows",
+        default="",
+        help="Comma-separated Triangel features (e.g. scs,mrb,bloom) to "
+        "toggle in shadow prefetchers scored alongside --triangel",
+    )
+    parser.add_argument(
+        "--triangelghb",
+        action="store_true",
+        help="Also prefetch from a global miss history buffer kept in L3 "
+        "ways next to Triangel's Markov table",
+    )
+    parser.add_argument(
+        "--triangelstructural",
+        action="store_true",
+        help="Read Triangel's prefetch chains from ISB-style structural "
+        "addresses when they are mapped",
+    )
+    parser.add_argument(
+        "--triangelmetadatapf",
+        type=int,
+        default=0,
+        help="Markov entries Triangel fetches into its metadata reuse "
+        "buffer past the end of each chain",
+    )
+    parser.add_argument(
+        "--triangelconfhints",
+        action="store_true",
+        help="Hint Triangel's low-confidence prefetches to the caches, and "
+        "give the L3 an RRIP policy that inserts them as distant",
+    )
+    parser.add_argument(
+        "--triangelvirtual",
+        action="store_true",
+        help="Train Triangel on virtual addresses, translating its "
+        "prefetches through the core's MMU",
+    )
+    parser.add_argument(
+        "--l2-trace",
+        action="store_true",
+        help="Record every access each core's private L2 sees, with its "
+        "PC, for replay by configs/example/prefetch_trace.py",
+    )
 
     # Run duration options
     parser.add_argument(
@@ -0,0 +1,214 @@
+# Copyright (c) 2023
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met: redistributions of source code must retain the above copyright
+# notice, this list of conditions and the following disclaimer;
+# redistributions in binary form must reproduce the above copyright
+# notice, this list of conditions and the following disclaimer in the
+# documentation and/or other materials provided with the distribution;
+# neither the name of the copyright holders nor the names of its
+# contributors may be used to endorse or promote products derived from
+# this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# This script evaluates an L2 prefetcher without a CPU model. It replays
+# an L2 access trace, as recorded by running fs.py or se.py with
+# --pl2sl3cache --l2-trace, through a TrafficGen into a lone L2 (and
+# optionally an L3 for Triage and Triangel to partition) in front of a
+# fixed-latency memory. Only the trace's command, address, size, PC and
+# tick are replayed: hits, misses and the requestor are re-derived by the
+# modelled caches, so the trace can be reused for any cache geometry.
+#
+# Each run prints the prefetcher's coverage, accuracy and timeliness,
+# alongside the usual stats.txt. Configurations are swept by launching
+# one instance per point, e.g.
+#
+#   gem5.opt -d m5out/deg4 configs/example/prefetch_trace.py \
+#       --trace m5out/system.cpu.l2monitor.trace.trc.gz \
+#       --hwp-type TriangelPrefetcher \
+#       --param "system.l2.prefetcher.degree = 4"
+
+import argparse
+import os
+import sys
+
+import m5
+from m5.objects import *
+from m5.util import addToPath
+
+addToPath("../")
+
+from common import ObjectList
+
+parser = argparse.ArgumentParser(
+    formatter_class=argparse.ArgumentDefaultsHelpFormatter
+)
+
+parser.add_argument(
+    "--trace",
+    type=str,
+    required=True,
+    help="L2 access trace to replay, in the packet protobuf format "
+    "written by MemTraceProbe",
+)
+parser.add_argument(
+    "--hwp-type",
+    type=str,
+    default=None,
+    choices=ObjectList.hwp_list.get_names(),
+    help="Prefetcher to evaluate at the L2 (default: none, for a "
+    "baseline to compare coverage against)",
+)
+parser.add_argument("--l2_size", type=str, default="512kB")
+parser.add_argument("--l2_assoc", type=int, default=8)
+parser.add_argument(
+    "--l3_size",
+    type=str,
+    default=None,
+    help="Add an L3 behind the L2, whose tags Triage and Triangel "
+    "partition for their Markov tables",
+)
+parser.add_argument("--l3_assoc", type=int, default=16)
+parser.add_argument(
+    "--mem-latency",
+    type=str,
+    default="60ns",
+    help="Latency of the memory behind the caches",
+)
+parser.add_argument(
+    "--elastic",
+    action="store_true",
+    help="Stall the trace while the L2 cannot accept requests, rather "
+    "than sending on the recorded ticks",
+)
+parser.add_argument(
+    "--param",
+    action="append",
+    default=[],
+    help="Set a SimObject parameter relative to the root node, "
+    "e.g. 'system.l2.prefetcher.degree = 4'",
+)
+parser.add_argument(
+    "--sys-clock",
+    type=str,
+    default="2GHz",
+    help="Clock of the caches",
+)
+
+args = parser.parse_args()
+
+# Replay the trace in one state; once it has run out the generator
+# moves to a state that exits the simulation loop.
+cfg_file_path = os.path.join(m5.options.outdir, "prefetch_trace.cfg")
+with open(cfg_file_path, "w") as cfg_file:
+    cfg_file.write("STATE 0 0 TRACE %s 0\n" % os.path.abspath(args.trace))
+    cfg_file.write("STATE 1 0 EXIT\n")
+    cfg_file.write("INIT 0\n")
+    cfg_file.write("TRANSITION 0 1 1\n")
+    cfg_file.write("TRANSITION 1 1 1\n")
+
+system = System(mem_ranges=[AddrRange("16GB")], cache_line_size=64)
+system.voltage_domain = VoltageDomain(voltage="1V")
+system.clk_domain = SrcClockDomain(
+    clock=args.sys_clock, voltage_domain=system.voltage_domain
+)
+
+# A recorded trace can go quiet for longer than the default progress
+# check while the core it came from was idle
+system.tgen = TrafficGen(
+    config_file=cfg_file_path,
+    elastic_req=args.elastic,
+    progress_check="1s",
+)
+
+system.l2 = Cache(
+    size=args.l2_size,
+    assoc=args.l2_assoc,
+    tag_latency=9,
+    data_latency=9,
+    response_latency=9,
+    mshrs=32,
+    tgts_per_mshr=8,
+    write_buffers=8,
+    prefetch_on_pf_hit=True,
+    tags=BaseSetAssoc(),
+    replacement_policy=LRURP(),
+)
+system.tgen.port = system.l2.cpu_side
+
+system.membus = SystemXBar()
+system.physmem = SimpleMemory(
+    range=system.mem_ranges[0], latency=args.mem_latency
+)
+system.physmem.port = system.membus.mem_side_ports
+system.system_port = system.membus.cpu_side_ports
+
+if args.l3_size:
+    system.tol3bus = L2XBar()
+    system.l3 = Cache(
+        size=args.l3_size,
+        assoc=args.l3_assoc,
+        tag_latency=20,
+        data_latency=20,
+        response_latency=20,
+        mshrs=32,
+        tgts_per_mshr=12,
+        write_buffers=16,
+    )
+    system.l2.mem_side = system.tol3bus.cpu_side_ports
+    system.l3.cpu_side = system.tol3bus.mem_side_ports
+    system.l3.mem_side = system.membus.cpu_side_ports
+else:
+    system.l2.mem_side = system.membus.cpu_side_ports
+
+if args.hwp_type:
+    system.l2.prefetcher = ObjectList.hwp_list.get(args.hwp_type)()
+    if args.l3_size and "cachetags" in system.l2.prefetcher._params:
+        system.l2.prefetcher.cachetags = system.l3.tags
+
+root = Root(full_system=False, system=system)
+root.system.mem_mode = "timing"
+root.apply_config(args.param)
+
+m5.instantiate()
+
+exit_event = m5.simulate()
+print("Exiting @ tick %i because %s" % (m5.curTick(), exit_event.getCause()))
+
+m5.stats.dump()
+
+if not args.hwp_type:
+    sys.exit(0)
+
+# Summarise the prefetcher from the stats we just dumped
+summary = (
+    "pfIssued",
+    "pfUseful",
+    "pfUnused",
+    "pfLate",
+    "accuracy",
+    "coverage",
+)
+prefix = "system.l2.prefetcher."
+stats = {}
+with open(os.path.join(m5.options.outdir, "stats.txt")) as stats_file:
+    for line in stats_file:
+        fields = line.split()
+        if len(fields) > 1 and fields[0].startswith(prefix):
+            stats[fields[0][len(prefix) :]] = fields[1]
+
+for name in summary:
+    print("%-10s %s" % (name, stats.get(name, "n/a")))
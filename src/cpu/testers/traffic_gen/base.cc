@@ -197,8 +197,11 @@ BaseTrafficGen::update()
         // device accesses that could be part of a trace
         if (pkt && system->isMemAddr(pkt->getAddr())) {
             stats.numPackets++;
-            // Only attempts to send if not blocked by pending responses
-            blockedWaitingResp = allocateWaitingRespSlot(pkt);
+            // Only attempts to send if not blocked by pending
+            // responses. Writebacks and evictions replayed from a cache
+            // trace get no response, so they never hold a slot.
+            blockedWaitingResp = pkt->needsResponse() &&
+                                 allocateWaitingRespSlot(pkt);
             if (blockedWaitingResp || !port.sendTimingReq(pkt)) {
                 retryPkt = pkt;
                 retryPktTick = curTick();
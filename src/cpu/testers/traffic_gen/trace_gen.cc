@@ -85,6 +85,7 @@ TraceGen::InputStream::read(TraceElement& element)
         element.blocksize = pkt_msg.size();
         element.tick = pkt_msg.tick();
         element.flags = pkt_msg.has_flags() ? pkt_msg.flags() : 0;
+        element.pc = pkt_msg.has_pc() ? pkt_msg.pc() : 0;
         return true;
     }
 
@@ -153,6 +154,11 @@ TraceGen::getNextPacket()
                               currElement.blocksize,
                               currElement.cmd, currElement.flags);
 
+    // Replay the recorded PC so that PC-indexed prefetchers see the
+    // same streams they would behind a CPU
+    if (currElement.pc)
+        pkt->req->setPC(currElement.pc);
+
     if (!traceComplete)
         DPRINTF(TrafficGen, "nextElement: %c addr %d size %d tick %d (%d)\n",
                 nextElement.cmd.isRead() ? 'r' : 'w',
@@ -84,6 +84,9 @@ class TraceGen : public BaseGen
         /** Potential request flags to use */
         Request::FlagsType flags;
 
+        /** The PC of the access, or zero if the trace has none */
+        Addr pc;
+
         /**
          * Check validity of this element.
          *
@@ -98,6 +101,7 @@ class TraceGen : public BaseGen
          */
         void clear() {
             cmd = MemCmd::InvalidCmd;
+            pc = 0;
         }
     };
 
@@ -138,6 +138,9 @@ class BaseCache(ClockedObject):
 
     cpu_side = ResponsePort("Upstream port closer to the CPU and/or device")
     mem_side = RequestPort("Downstream port closer to memory")
+    metadata_side = ResponsePort(
+        "Prefetcher metadata accesses, outside the coherent interconnect"
+    )
 
     addr_ranges = VectorParam.AddrRange(
         [AllMemory], "Address range for the CPU-side port (to allow striping)"
@@ -55,6 +55,7 @@
 #include "debug/HWPrefetch.hh"
 #include "mem/cache/compressors/base.hh"
 #include "mem/cache/mshr.hh"
+#include "mem/cache/prefetch_confidence.hh"
 #include "mem/cache/prefetch/base.hh"
 #include "mem/cache/queue_entry.hh"
 #include "mem/cache/tags/compressed_tags.hh"
@@ -81,6 +82,8 @@ BaseCache::BaseCache(const BaseCacheParams &p, unsigned blk_size)
     : ClockedObject(p),
       cpuSidePort (p.name + ".cpu_side_port", *this, "CpuSidePort"),
       memSidePort(p.name + ".mem_side_port", this, "MemSidePort"),
+      metadataSidePort(p.name + ".metadata_side_port", *this,
+                       "MetadataSidePort"),
       mshrQueue("MSHRs", p.mshrs, 0, p.demand_mshr_reserve, p.name),
       writeBuffer("write buffer", p.write_buffers, p.mshrs, p.name),
       tags(p.tags),
@@ -195,6 +198,8 @@ BaseCache::init()
     if (!cpuSidePort.isConnected() || !memSidePort.isConnected())
         fatal("Cache ports on %s are not connected\n", name());
     cpuSidePort.sendRangeChange();
+    if (metadataSidePort.isConnected())
+        metadataSidePort.sendRangeChange();
     forwardSnoops = cpuSidePort.isSnooping();
 }
 
@@ -205,6 +210,8 @@ BaseCache::getPort(const std::string &if_name, PortID idx)
         return memSidePort;
     } else if (if_name == "cpu_side") {
         return cpuSidePort;
+    } else if (if_name == "metadata_side") {
+        return metadataSidePort;
     }  else {
         return ClockedObject::getPort(if_name, idx);
     }
@@ -349,6 +356,12 @@ BaseCache::handleTimingReqMiss(PacketPtr pkt, MSHR *mshr, CacheBlk *blk,
                 // delay of the xbar.
                 mshr->allocateTarget(pkt, forward_time, order++,
                                      allocOnFill(pkt->cmd));
+                // A demand now waits on the fill, so the fill is no
+                // longer a prefetch the replacement policy may doubt
+                if (pkt->isDemand()) {
+                    mshr->getTarget()->pkt->req->
+                        removeExtension<PrefetchConfidence>();
+                }
                 if (mshr->getNumTargets() >= numTarget) {
                     noTargetMSHR = mshr;
                     setBlocked(Blocked_NoTargets);
@@ -473,6 +486,28 @@ BaseCache::recvTimingReq(PacketPtr pkt)
     }
 }
 
+void
+BaseCache::handleMetadataAccess(PacketPtr pkt)
+{
+    // Same latency as a hit, without a block to wait for
+    const Cycles lat = ticksToCycles(pkt->headerDelay) + (sequentialAccess ?
+        lookupLatency + dataLatency : std::max(lookupLatency, dataLatency));
+    const Tick request_time = clockEdge(lat);
+    pkt->headerDelay = 0;
+    stats.metadataAccesses++;
+
+    DPRINTF(Cache, "%s metadata access %s\n", __func__, pkt->print());
+
+    if (pkt->needsResponse()) {
+        pkt->makeTimingResponse();
+        Tick completion_time = request_time + pkt->payloadDelay;
+        pkt->payloadDelay = 0;
+        metadataSidePort.schedTimingResp(pkt, completion_time);
+    } else {
+        pendingDelete.reset(pkt);
+    }
+}
+
 void
 BaseCache::handleUncacheableWriteResp(PacketPtr pkt)
 {
@@ -912,6 +947,7 @@ BaseCache::getNextQueueEntry()
                 DPRINTF(HWPrefetch, "Prefetch %#x has hit in a MSHR, "
                         "dropped.\n", pf_addr);
                 prefetcher->pfHitInMSHR();
+                prefetcher->notifyPfHitInMSHR(pkt);
                 // free the request and packet
                 delete pkt;
             } else if (writeBuffer.findMatch(pf_addr, pkt->isSecure())) {
@@ -1666,6 +1702,8 @@ BaseCache::invalidateBlock(CacheBlk *blk)
     // If block is still marked as prefetched, then it hasn't been used
     if (blk->wasPrefetched()) {
         prefetcher->prefetchUnused();
+        prefetcher->notifyPrefetchUnused(regenerateBlkAddr(blk),
+                                         blk->isSecure());
     }
 
     // Notify that the data contents for this address are no longer present
@@ -2273,6 +2311,8 @@ BaseCache::CacheStats::CacheStats(BaseCache &c)
              "number of data expansions"),
     ADD_STAT(dataContractions, statistics::units::Count::get(),
              "number of data contractions"),
+    ADD_STAT(metadataAccesses, statistics::units::Count::get(),
+             "number of prefetcher metadata accesses served"),
     cmd(MemCmd::NUM_MEM_CMDS)
 {
     for (int idx = 0; idx < MemCmd::NUM_MEM_CMDS; ++idx)
@@ -2605,6 +2645,49 @@ CpuSidePort::CpuSidePort(const std::string &_name, BaseCache& _cache,
 {
 }
 
+///////////////
+//
+// MetadataSidePort
+//
+///////////////
+bool
+BaseCache::MetadataSidePort::recvTimingReq(PacketPtr pkt)
+{
+    assert(pkt->isRequest());
+    cache.handleMetadataAccess(pkt);
+    return true;
+}
+
+Tick
+BaseCache::MetadataSidePort::recvAtomic(PacketPtr pkt)
+{
+    panic("%s: metadata accesses are only timed in timing mode\n",
+          cache.name());
+}
+
+void
+BaseCache::MetadataSidePort::recvFunctional(PacketPtr pkt)
+{
+    panic("%s: metadata lines hold no data to access functionally\n",
+          cache.name());
+}
+
+AddrRangeList
+BaseCache::MetadataSidePort::getAddrRanges() const
+{
+    // Metadata lines are named by their set alone, whatever the
+    // addresses this cache serves on its CPU side
+    return AddrRangeList{AddrRange(0, MaxAddr)};
+}
+
+BaseCache::
+MetadataSidePort::MetadataSidePort(const std::string &_name,
+                                   BaseCache& _cache,
+                                   const std::string &_label)
+    : CacheResponsePort(_name, _cache, _label)
+{
+}
+
 ///////////////
 //
 // MemSidePort
@@ -331,8 +331,31 @@ class BaseCache : public ClockedObject
 
     };
 
+    /**
+     * Port serving prefetcher metadata accesses. It sits outside the
+     * coherent interconnect, so the accesses are never snooped and never
+     * reach the tags or memory.
+     */
+    class MetadataSidePort : public CacheResponsePort
+    {
+      protected:
+        virtual bool recvTimingReq(PacketPtr pkt) override;
+
+        virtual Tick recvAtomic(PacketPtr pkt) override;
+
+        virtual void recvFunctional(PacketPtr pkt) override;
+
+        virtual AddrRangeList getAddrRanges() const override;
+
+      public:
+
+        MetadataSidePort(const std::string &_name, BaseCache& _cache,
+                         const std::string &_label);
+    };
+
     CpuSidePort cpuSidePort;
     MemSidePort memSidePort;
+    MetadataSidePort metadataSidePort;
 
   protected:
 
@@ -533,6 +556,14 @@ class BaseCache : public ClockedObject
      */
     virtual void recvTimingReq(PacketPtr pkt);
 
+    /**
+     * Service a prefetcher metadata access. The metadata lives in ways
+     * reserved from the tags, so it always hits and never allocates a
+     * block; only its latency and port occupancy are modelled.
+     * @param pkt The metadata request.
+     */
+    void handleMetadataAccess(PacketPtr pkt);
+
     /**
      * Handling the special case of uncacheable write responses to
      * make recvTimingResp less cluttered.
@@ -1139,6 +1170,9 @@ class BaseCache : public ClockedObject
          */
         statistics::Scalar dataContractions;
 
+        /** Number of prefetcher metadata accesses served. */
+        statistics::Scalar metadataAccesses;
+
         /** Per-command statistics */
         std::vector<std::unique_ptr<CacheCmdStats>> cmd;
     } stats;
@@ -1290,6 +1324,11 @@ class BaseCache : public ClockedObject
         return mshrQueue.findMatch(addr, is_secure);
     }
 
+    /** Fraction of the MSHRs in use, for prefetchers that throttle on it */
+    double mshrOccupancy() const {
+        return mshrQueue.occupancy();
+    }
+
     void incMissCount(PacketPtr pkt)
     {
         assert(pkt->req->requestorId() < system->maxRequestors());
@@ -127,6 +127,24 @@ class MultiPrefetcher(BasePrefetcher):
     cxx_header = "mem/cache/prefetch/multi.hh"
 
     prefetchers = VectorParam.BasePrefetcher([], "Array of prefetchers")
+    issued_prefetch_entries = Param.Unsigned(
+        1024, "Issued prefetches remembered to credit their sub-prefetcher"
+    )
+    dedup_window = Param.Cycles(
+        0,
+        "Drop prefetches to blocks a prefetch was issued for this many "
+        "cycles ago or less (0: issue duplicates)",
+    )
+    rank_by_accuracy = Param.Bool(
+        False, "Issue from the most accurate ready sub-prefetcher first"
+    )
+    accuracy_epoch = Param.Unsigned(
+        256, "Prefetches after which sub-prefetcher accuracy counts halve"
+    )
+    bandwidth_budget = Param.Unsigned(
+        0, "Most prefetches issued per budget window (0: no limit)"
+    )
+    budget_window = Param.Cycles(1000, "Length of a budget window")
 
 
 class QueuedPrefetcher(BasePrefetcher):
@@ -690,7 +708,14 @@ class PIFPrefetcher(QueuedPrefetcher):
         )
 
 
-class TriageHashedSetAssociative(SetAssociative):
+class TemporalHashedSetAssociative(SetAssociative):
+    type = "TemporalHashedSetAssociative"
+    abstract = True
+    cxx_class = "gem5::prefetch::TemporalHashedSetAssociative"
+    cxx_header = "mem/cache/prefetch/temporal.hh"
+
+
+class TriageHashedSetAssociative(TemporalHashedSetAssociative):
     type = "TriageHashedSetAssociative"
     cxx_class = "gem5::prefetch::TriageHashedSetAssociative"
     cxx_header = "mem/cache/prefetch/triage.hh"
@@ -767,12 +792,111 @@ class TriagePrefetcher(QueuedPrefetcher):
     )
 
 
-class TriangelHashedSetAssociative(SetAssociative):
+class TriangelHashedSetAssociative(TemporalHashedSetAssociative):
     type = "TriangelHashedSetAssociative"
     cxx_class = "gem5::prefetch::TriangelHashedSetAssociative"
     cxx_header = "mem/cache/prefetch/triangel.hh"
 
 
+# How a Markov entry's target is packed into an LLC line, which sets how
+# many entries fit per line: full addresses, upper bits shared through the
+# lookup table, a signed delta from the entry's own index, or low bits
+# with the upper bits shared by every entry of the line.
+class TriangelMarkovEncoding(ScopedEnum):
+    vals = ["full", "lookup_table", "delta", "page_shared"]
+
+
+class TriangelMetadataStore(SimObject):
+    type = "TriangelMetadataStore"
+    cxx_class = "gem5::prefetch::TriangelMetadataStore"
+    cxx_header = "mem/cache/prefetch/triangel.hh"
+
+    # By default each prefetcher gets a private store, configured from its
+    # own address_map_* parameters. To share one Markov table between the
+    # prefetchers of all cores on an LLC, create a single store per LLC and
+    # set every parameter explicitly.
+    cachetags = Param.BaseTags(
+        Parent.cachetags, "LLC whose ways hold the Markov table"
+    )
+    address_map_actual_entries = Param.MemorySize(
+        Parent.address_map_actual_entries,
+        "Number of entries of the History table",
+    )
+    address_map_max_ways = Param.Unsigned(
+        Parent.address_map_max_ways, "Max reservation of the History Table"
+    )
+    address_map_actual_cache_assoc = Param.Unsigned(
+        Parent.address_map_actual_cache_assoc,
+        "Associativity of the History Table",
+    )
+    address_map_encoding = Param.TriangelMarkovEncoding(
+        Parent.address_map_encoding, "Encoding of Markov entries"
+    )
+    address_map_tag_bits = Param.Unsigned(
+        Parent.address_map_tag_bits, "Tag bits stored per Markov entry"
+    )
+    address_map_target_bits = Param.Unsigned(
+        Parent.address_map_target_bits, "Bits of a full target line address"
+    )
+    address_map_delta_bits = Param.Unsigned(
+        Parent.address_map_delta_bits, "Bits of a delta-encoded target"
+    )
+    address_map_page_bits = Param.Unsigned(
+        Parent.address_map_page_bits,
+        "Target bits stored per entry when the line shares the rest",
+    )
+    address_map_successors = Param.Unsigned(
+        Parent.address_map_successors, "Successors kept per Markov entry"
+    )
+    lookup_assoc = Param.Unsigned(
+        Parent.lookup_assoc, "Associativity of the lookup table"
+    )
+    lookup_offset = Param.Unsigned(
+        Parent.lookup_offset, "Offset of the lookup table"
+    )
+    block_size = Param.Int(
+        Parent.cache_line_size, "Size of the LLC lines holding the table"
+    )
+    address_map_rounded_entries = Param.MemorySize(
+        Parent.address_map_rounded_entries,
+        "Number of entries of the History table",
+    )
+    address_map_rounded_cache_assoc = Param.Unsigned(
+        Parent.address_map_rounded_cache_assoc,
+        "Associativity of the History Table",
+    )
+    address_map_cache_indexing_policy = Param.BaseIndexingPolicy(
+        Parent.address_map_cache_indexing_policy,
+        "Indexing policy of the PC table",
+    )
+    address_map_cache_replacement_policy = Param.BaseReplacementPolicy(
+        Parent.address_map_cache_replacement_policy,
+        "Replacement policy of the Markov table",
+    )
+    rearrange_sets_per_access = Param.Unsigned(
+        16,
+        "Markov sets migrated per access after a resize (0 migrates the "
+        "whole table at once)",
+    )
+    qos_partitioning = Param.Bool(
+        False,
+        "Split each Markov line between the prefetchers sharing the store, "
+        "by the prefetch hits each one's duellers measure",
+    )
+    qos_min_entries = Param.Unsigned(
+        1, "Entries of each Markov line guaranteed to every prefetcher"
+    )
+    # With use_bloom, the table is sized from an estimate of how many
+    # distinct indexes are live, kept for a hashed sample of the indexes.
+    # Indexes age out lifetime epochs after they were last seen.
+    sizing_sample_slices = Param.Unsigned(
+        4, "Out of 128 hash slices, how many the sizing sketch samples"
+    )
+    sizing_lifetime = Param.Unsigned(
+        2, "Epochs an index stays in the sizing sketch since last seen"
+    )
+
+
 class TriangelPrefetcher(QueuedPrefetcher):
     type = "TriangelPrefetcher"
     cxx_class = "gem5::prefetch::Triangel"
@@ -786,8 +910,31 @@ class TriangelPrefetcher(QueuedPrefetcher):
     prefetch_on_pf_hit = True  # TODO: check these!
     cross_pages = True
     use_scs = Param.Bool(True, "Should use second-chance sampler")
-    use_bloom = Param.Bool(False, "Should use bloom filter instead of dueller")
+    use_bloom = Param.Bool(
+        False, "Size the Markov table with a sketch instead of duellers"
+    )
     should_lookahead = Param.Bool(True, "Should perform lookahead prefetching")
+    max_lookahead = Param.Unsigned(
+        2, "Largest distance, in accesses by the same PC, to look ahead by"
+    )
+    adaptive_lookahead = Param.Bool(
+        False, "Learn each PC's lookahead distance from late prefetches"
+    )
+    # Throttling adapts each PC's degree to how many of its prefetches are
+    # used before eviction, and cuts every PC to one prefetch per access
+    # while the watched MSHRs are saturated.
+    throttling = Param.Bool(
+        False, "Adapt degree to prefetch accuracy and MSHR occupancy"
+    )
+    throttle_mshr_threshold = Param.Float(
+        0.75, "MSHR occupancy at or above which degree is cut to 1"
+    )
+    throttle_cache = Param.BaseCache(
+        NULL, "Cache whose MSHRs are watched (default: our own)"
+    )
+    issued_prefetch_entries = Param.Unsigned(
+        1024, "Issued prefetches remembered to credit their PC"
+    )
     cachetags = Param.BaseTags(Parent.tags, "Cache we belong to")
     should_rearrange = Param.Bool(True, "Should rearrange on index change")
     use_hawkeye = Param.Bool(False, "Add hawkeye after the sample cache")
@@ -804,6 +951,97 @@ class TriangelPrefetcher(QueuedPrefetcher):
     cache_delay = Param.Unsigned(25, "Time to access L3 cache")
 
     sctags = Param.BaseTags(Parent.tags, "Cache we check for second-chance sampling")
+    metadata = Param.TriangelMetadataStore(
+        TriangelMetadataStore(),
+        "Markov table and partition state, shared per LLC",
+    )
+    # Connect metadata_port to the LLC's metadata_side (through a
+    # NoncoherentXBar when several prefetchers share the LLC) to time Markov
+    # table accesses through the LLC instead of cache_delay.
+    metadata_port = RequestPort("Timed Markov table accesses to the LLC")
+    metadata_base_addr = Param.Addr(
+        0, "Base of the addresses naming Markov lines on metadata_port"
+    )
+    # Shadows are trained on every access this prefetcher sees, each with
+    # private tables and metadata store, but never issue prefetches: their
+    # predictions are scored against later accesses (see their "shadow"
+    # stats), so ablations can be ranked from a single run.
+    shadows = VectorParam.TriangelPrefetcher(
+        [], "Variants evaluated alongside this prefetcher"
+    )
+    shadow_score_entries = Param.Unsigned(
+        4096, "Predictions remembered when this prefetcher is a shadow"
+    )
+    # The global history buffer records every miss, whatever its PC, in
+    # LLC ways above the Markov table's, and replays the misses that
+    # followed the last occurrence of an address (as in STMS), catching
+    # streams that interleave across PCs.
+    global_history = Param.Bool(
+        False, "Also prefetch from a global miss history buffer"
+    )
+    ghb_ways = Param.Unsigned(1, "LLC ways holding the global history")
+    ghb_degree = Param.Unsigned(
+        4, "History entries prefetched per global history hit"
+    )
+    ghb_index_assoc = Param.Int(8, "Associativity of the history index")
+    ghb_index_entries = Param.MemorySize(
+        "4096", "Number of entries of the history index"
+    )
+    ghb_index_indexing_policy = Param.BaseIndexingPolicy(
+        SetAssociative(
+            entry_size=1,
+            assoc=Parent.ghb_index_assoc,
+            size=Parent.ghb_index_entries,
+        ),
+        "Indexing policy of the history index",
+    )
+    ghb_index_replacement_policy = Param.BaseReplacementPolicy(
+        LRURP(), "Replacement policy of the history index"
+    )
+    # Structural addresses linearise each confident PC's stream, as in the
+    # Irregular Stream Buffer, so a prefetch chain is one read of a
+    # structural line rather than one Markov lookup per prefetch. The
+    # Markov table still trains, and is walked when the map misses.
+    structural_addresses = Param.Bool(
+        False, "Prefetch along structural addresses when they are mapped"
+    )
+    structural_chunk_size = Param.Unsigned(
+        256, "Structural addresses given to each new stream"
+    )
+    structural_entries_per_line = Param.Unsigned(
+        16, "Mappings per line of the structural address maps"
+    )
+    structural_counter_bits = Param.Unsigned(
+        2, "Bits of a structural mapping's confidence counter"
+    )
+    structural_map_assoc = Param.Int(
+        8, "Associativity of the PS/SP structural address maps"
+    )
+    structural_map_entries = Param.MemorySize(
+        "1024", "Number of lines of each structural address map"
+    )
+    ps_structural_map_indexing_policy = Param.BaseIndexingPolicy(
+        SetAssociative(
+            entry_size=1,
+            assoc=Parent.structural_map_assoc,
+            size=Parent.structural_map_entries,
+        ),
+        "Indexing policy of the physical-to-structural map",
+    )
+    ps_structural_map_replacement_policy = Param.BaseReplacementPolicy(
+        LRURP(), "Replacement policy of the physical-to-structural map"
+    )
+    sp_structural_map_indexing_policy = Param.BaseIndexingPolicy(
+        SetAssociative(
+            entry_size=1,
+            assoc=Parent.structural_map_assoc,
+            size=Parent.structural_map_entries,
+        ),
+        "Indexing policy of the structural-to-physical map",
+    )
+    sp_structural_map_replacement_policy = Param.BaseReplacementPolicy(
+        LRURP(), "Replacement policy of the structural-to-physical map"
+    )
     lookup_assoc = Param.Unsigned(0, "Associativity of the lookup table")
     lookup_offset = Param.Unsigned(11, "Offset of the lookup table")
     training_unit_assoc = Param.Unsigned(
@@ -824,15 +1062,46 @@ class TriangelPrefetcher(QueuedPrefetcher):
         LRURP(), "Replacement policy of the training unit"
     )
 
+    # The actual entries and associativity model the metadata density and
+    # follow from address_map_encoding when left at 0 (12 entries per line
+    # for full addresses). Setting them overrides the encoding's density.
+    # The rounded associativity must hold every entry of a line, so the
+    # denser delta and page_shared encodings need a 32-way rounded table;
+    # --triangelencoding in configs/common sizes it.
     address_map_actual_entries = Param.MemorySize(
-        "196608", "Number of entries of the History table"
+        "0", "Number of entries of the History table"
     )
     address_map_max_ways = Param.Unsigned(
         8, "Max reservation of the History Table"
     )
     address_map_actual_cache_assoc = Param.Unsigned(
-        12, "Associativity of the History Table"
-    )  # TODO: assert = address_map_line_assoc * cache assoc / 2
+        0, "Associativity of the History Table"
+    )
+    address_map_encoding = Param.TriangelMarkovEncoding(
+        "full", "Encoding of Markov entries"
+    )
+    address_map_tag_bits = Param.Unsigned(
+        10, "Tag bits stored per Markov entry"
+    )
+    address_map_target_bits = Param.Unsigned(
+        31, "Bits of a full target line address"
+    )
+    address_map_delta_bits = Param.Unsigned(
+        10, "Bits of a delta-encoded target"
+    )
+    address_map_page_bits = Param.Unsigned(
+        8, "Target bits stored per entry when the line shares the rest"
+    )
+    # Several successors per entry stop branching pointer chains from
+    # thrashing a single target, at the cost of fewer entries per line.
+    address_map_successors = Param.Unsigned(
+        1, "Successors kept per Markov entry (1 to 4)"
+    )
+    prefetch_successors = Param.Unsigned(
+        0,
+        "Confident successors prefetched per Markov lookup (0 for all those "
+        "kept)",
+    )
     address_map_rounded_entries = Param.MemorySize(
         "262144", "Number of entries of the History table"
     )  # TODO: assert = rnd(address_map_line_assoc) * cache size / 64 / 2
@@ -882,6 +1151,20 @@ class TriangelPrefetcher(QueuedPrefetcher):
     metadata_reuse_replacement_policy = Param.BaseReplacementPolicy(
         FIFORP(), "Replacement policy of the Prefetched cache"
     )
+    # Entries fetched ahead land in the Metadata Reuse Buffer, so its size
+    # and replacement policy above bound how far ahead they can run.
+    metadata_prefetch_degree = Param.Unsigned(
+        0,
+        "Markov entries past the end of each chain fetched into the "
+        "Metadata Reuse Buffer (0 disables)",
+    )
+    # Honoured by the BRRIP and SHiP replacement policies of the caches
+    # the prefetches fill.
+    confidence_hints = Param.Bool(
+        False,
+        "Hint prefetches without high pattern confidence, or from "
+        "unconfident successors, as low-confidence",
+    )
 
     secondchance_assoc = Param.Int(2, "Associativity of the Second Chance Sampler")
     secondchance_entries = Param.MemorySize(
@@ -899,7 +1182,7 @@ class TriangelPrefetcher(QueuedPrefetcher):
         FIFORP(), "Replacement policy of the Second Chance Sampler"
     )
     
-class SimpleTriangelHashedSetAssociative(SetAssociative):
+class SimpleTriangelHashedSetAssociative(TemporalHashedSetAssociative):
     type = "SimpleTriangelHashedSetAssociative"
     cxx_class = "gem5::prefetch::SimpleTriangelHashedSetAssociative"
     cxx_header = "mem/cache/prefetch/simpletriangel.hh"
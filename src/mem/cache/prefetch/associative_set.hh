@@ -29,9 +29,16 @@
 #ifndef __CACHE_PREFETCH_ASSOCIATIVE_SET_HH__
 #define __CACHE_PREFETCH_ASSOCIATIVE_SET_HH__
 
+#include <optional>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
 #include "mem/cache/replacement_policies/base.hh"
+#include "mem/cache/replacement_policies/inline_rp.hh"
 #include "mem/cache/replacement_policies/weighted_lru_rp.hh"
 #include "mem/cache/tags/indexing_policies/base.hh"
+#include "mem/cache/tags/indexing_policies/set_associative.hh"
 #include "mem/cache/tags/tagged_entry.hh"
 
 namespace gem5
@@ -41,13 +48,23 @@ namespace gem5
  * Associative container based on the previosuly defined Entry type
  * Each element is indexed by a key of type Addr, an additional
  * bool value is used as an additional tag data of the entry.
+ *
+ * Containers on hot paths can name one of the inline replacement policies
+ * of inline_rp.hh as InlinePolicy. While the configured replacement
+ * policy is of the type it mirrors, the replacement state is then kept in
+ * arrays in the container and the policy is called directly; any other
+ * configured policy is used through its virtual interface, as it is when
+ * InlinePolicy is void.
  */
-template<class Entry>
+template<class Entry, class InlinePolicy = void>
 class AssociativeSet
 {
     static_assert(std::is_base_of_v<TaggedEntry, Entry>,
                   "Entry must derive from TaggedEntry");
 
+    /** Whether the container was given an inline replacement policy */
+    static constexpr bool hasInlinePolicy = !std::is_void_v<InlinePolicy>;
+
     /** Associativity of the container */
     const int associativity;
     int allocAssoc;
@@ -66,6 +83,69 @@ class AssociativeSet
     /** Vector containing the entries of the container */
     std::vector<Entry> entries;
 
+  private:
+    /**
+     * The indexing policy, if it is set-associative with the associativity
+     * of the container. The ways of a set are then contiguous in entries,
+     * so lookups walk them directly instead of asking the policy for a
+     * vector of them. nullptr for other indexing policies.
+     */
+    SetAssociative* const setIndexing;
+    /**
+     * The replacement policy as a WeightedLRU, for weighted accesses, or
+     * nullptr if it is another policy
+     */
+    replacement_policy::WeightedLRU* const weightedPolicy;
+    /**
+     * The inline replacement policy, if the configured one is of the type
+     * it mirrors. Entries have no replacement data then.
+     */
+    std::optional<std::conditional_t<hasInlinePolicy, InlinePolicy,
+                                     std::monostate>> inlinePolicy;
+    /** Replacement candidates of the victim search, reused across calls */
+    std::vector<ReplaceableEntry*> candidates;
+    /** Indexes of the candidates, for the inline policy */
+    std::vector<size_t> candidateIndexes;
+
+    /** @return The inline policy mirroring rpl_policy, if any. */
+    static auto
+    createInlinePolicy(replacement_policy::Base *rpl_policy,
+                       size_t num_entries)
+    {
+        if constexpr (hasInlinePolicy) {
+            return InlinePolicy::create(rpl_policy, num_entries);
+        } else {
+            return std::optional<std::monostate>();
+        }
+    }
+
+    /** @return Whether the inline replacement policy is in use. */
+    bool
+    isInline() const
+    {
+        if constexpr (hasInlinePolicy) {
+            return inlinePolicy.has_value();
+        } else {
+            return false;
+        }
+    }
+
+    /** @return The index of an entry in entries. */
+    size_t indexOf(const Entry *entry) const { return entry - &entries[0]; }
+
+    /**
+     * Ask the replacement policy for a victim among the entries in
+     * [first, last), without invalidating it.
+     */
+    template <class Iterator>
+    Entry* pickVictim(Iterator first, Iterator last);
+
+    /**
+     * @param addr key element
+     * @return The first way of the set of addr, with setIndexing
+     */
+    Entry* firstWay(Addr addr) const;
+
   public:
     /**
      * Public constructor
@@ -104,14 +184,32 @@ class AssociativeSet
      */
     Entry* findVictim(Addr addr);
 
+    /**
+     * Find a victim among some of the entries of a set, e.g. those a
+     * partition may replace, and invalidate it.
+     * @param candidates Entries that may be replaced, of a single set.
+     * @result entry to be victimized
+     */
+    Entry* findVictim(const std::vector<Entry *> &candidates);
+
     /**
      * Find the set of entries that could be replaced given
-     * that we want to add a new entry with the provided key
+     * that we want to add a new entry with the provided key. Lookups and
+     * victim searches do not build this vector, so prefer them on hot
+     * paths.
      * @param addr key to select the set of entries
      * @result vector of candidates matching with the provided key
      */
     std::vector<Entry *> getPossibleEntries(const Addr addr) const;
 
+    /**
+     * Fill ways with the entries getPossibleEntries(addr) returns. Callers
+     * keeping ways across calls reuse its storage instead of allocating.
+     * @param addr key to select the set of entries
+     * @param ways vector the candidates are written to
+     */
+    void getPossibleEntries(const Addr addr, std::vector<Entry *> &ways) const;
+
     /**
      * Indicate that an entry has just been inserted
      * @param addr key of the container
@@ -120,6 +218,18 @@ class AssociativeSet
      */
     void insertEntry(Addr addr, bool is_secure, Entry* entry);
 
+    /**
+     * Put an entry back with a tag it held before, e.g. one read from a
+     * checkpoint. Indexing policies cannot always regenerate the key a
+     * tag was extracted from, so the tag is not rebuilt from a key. The
+     * replacement policy sees the entry as freshly inserted, keyed by
+     * its tag.
+     * @param tag tag the entry held
+     * @param is_secure tag component of the container
+     * @param entry pointer to the container entry to be restored
+     */
+    void restoreEntry(Addr tag, bool is_secure, Entry* entry);
+
     void setWayAllocationMax(int ways)
     {
         allocAssoc = ways;
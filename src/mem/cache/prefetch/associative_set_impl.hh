@@ -35,12 +35,16 @@
 namespace gem5
 {
 
-template<class Entry>
-AssociativeSet<Entry>::AssociativeSet(int assoc, int num_entries,
-        BaseIndexingPolicy *idx_policy, replacement_policy::Base *rpl_policy,
-        Entry const &init_value)
+template<class Entry, class InlinePolicy>
+AssociativeSet<Entry, InlinePolicy>::AssociativeSet(int assoc,
+        int num_entries, BaseIndexingPolicy *idx_policy,
+        replacement_policy::Base *rpl_policy, Entry const &init_value)
   : associativity(assoc),allocAssoc(assoc), numEntries(num_entries), indexingPolicy(idx_policy),
-    replacementPolicy(rpl_policy), entries(numEntries, init_value)
+    replacementPolicy(rpl_policy), entries(numEntries, init_value),
+    setIndexing(idx_policy->assoc == assoc ?
+                dynamic_cast<SetAssociative*>(idx_policy) : nullptr),
+    weightedPolicy(dynamic_cast<replacement_policy::WeightedLRU*>(rpl_policy)),
+    inlinePolicy(createInlinePolicy(rpl_policy, num_entries))
 {
     fatal_if(!isPowerOf2(num_entries), "The number of entries of an "
              "AssociativeSet<> must be a power of 2");
@@ -49,15 +53,41 @@ AssociativeSet<Entry>::AssociativeSet(int assoc, int num_entries,
     for (unsigned int entry_idx = 0; entry_idx < numEntries; entry_idx += 1) {
         Entry* entry = &entries[entry_idx];
         indexingPolicy->setEntry(entry, entry_idx);
-        entry->replacementData = replacementPolicy->instantiateEntry();
+        if (!isInline()) {
+            entry->replacementData = replacementPolicy->instantiateEntry();
+        }
     }
+    candidates.reserve(assoc);
+    candidateIndexes.reserve(assoc);
+}
+
+template<class Entry, class InlinePolicy>
+Entry*
+AssociativeSet<Entry, InlinePolicy>::firstWay(Addr addr) const
+{
+    const size_t first = size_t(setIndexing->getSetIndex(addr)) *
+        associativity;
+    assert(first + associativity <= entries.size());
+    return const_cast<Entry*>(&entries[first]);
 }
 
-template<class Entry>
+template<class Entry, class InlinePolicy>
 Entry*
-AssociativeSet<Entry>::findEntry(Addr addr, bool is_secure) const
+AssociativeSet<Entry, InlinePolicy>::findEntry(Addr addr,
+                                               bool is_secure) const
 {
     Addr tag = indexingPolicy->extractTag(addr);
+    if (setIndexing) {
+        Entry* way = firstWay(addr);
+        for (Entry* const end = way + associativity; way != end; ++way) {
+            if ((way->getTag() == tag) && way->isValid() &&
+                way->isSecure() == is_secure) {
+                return way;
+            }
+        }
+        return nullptr;
+    }
+
     const std::vector<ReplaceableEntry*> selected_entries =
         indexingPolicy->getPossibleEntries(addr);
 
@@ -71,67 +101,180 @@ AssociativeSet<Entry>::findEntry(Addr addr, bool is_secure) const
     return nullptr;
 }
 
-template<class Entry>
+template<class Entry, class InlinePolicy>
 void
-AssociativeSet<Entry>::accessEntry(Entry *entry)
+AssociativeSet<Entry, InlinePolicy>::accessEntry(Entry *entry)
 {
+    if constexpr (hasInlinePolicy) {
+        if (inlinePolicy) {
+            inlinePolicy->touch(indexOf(entry));
+            return;
+        }
+    }
     replacementPolicy->touch(entry->replacementData);
 }
 
-template<class Entry>
+template<class Entry, class InlinePolicy>
 void
-AssociativeSet<Entry>::weightedAccessEntry(Entry *entry, int weight, bool fill)
+AssociativeSet<Entry, InlinePolicy>::weightedAccessEntry(Entry *entry,
+                                                         int weight,
+                                                         bool fill)
 {
-    gem5::replacement_policy::WeightedLRU* wlru = dynamic_cast<gem5::replacement_policy::WeightedLRU*>(replacementPolicy);
-    if(wlru) wlru->touch(entry->replacementData, weight);
-    else if(!fill) accessEntry(entry);  //not fill for RRIPs
+    if constexpr (hasInlinePolicy) {
+        if (inlinePolicy) {
+            if constexpr (InlinePolicy::weighted) {
+                inlinePolicy->touch(indexOf(entry), weight);
+            } else if (!fill) {
+                inlinePolicy->touch(indexOf(entry));
+            }
+            return;
+        }
+    }
+    if (weightedPolicy) {
+        weightedPolicy->touch(entry->replacementData, weight);
+    } else if (!fill) {
+        // Fills do not promote entries under other policies, e.g. RRIP
+        accessEntry(entry);
+    }
 }
 
-template<class Entry>
+template<class Entry, class InlinePolicy>
+template<class Iterator>
 Entry*
-AssociativeSet<Entry>::findVictim(Addr addr)
+AssociativeSet<Entry, InlinePolicy>::pickVictim(Iterator first,
+                                                Iterator last)
+{
+    if constexpr (hasInlinePolicy) {
+        if (inlinePolicy) {
+            candidateIndexes.clear();
+            for (Iterator it = first; it != last; ++it) {
+                candidateIndexes.push_back(indexOf(static_cast<Entry*>(*it)));
+            }
+            return &entries[inlinePolicy->getVictim(candidateIndexes)];
+        }
+    }
+    candidates.assign(first, last);
+    return static_cast<Entry*>(replacementPolicy->getVictim(candidates));
+}
+
+template<class Entry, class InlinePolicy>
+Entry*
+AssociativeSet<Entry, InlinePolicy>::findVictim(Addr addr)
 {
     // Get possible entries to be victimized
-    const std::vector<ReplaceableEntry*> selected_entries =
-        indexingPolicy->getPossibleEntries(addr);
-     const std::vector<ReplaceableEntry*> slice = std::vector<ReplaceableEntry*>(selected_entries.begin(), selected_entries.begin()+getWayAllocationMax());
-    Entry* victim = static_cast<Entry*>(replacementPolicy->getVictim(
-                            slice));
+    Entry* victim;
+    if (setIndexing) {
+        Entry* way = firstWay(addr);
+        if constexpr (hasInlinePolicy) {
+            if (inlinePolicy) {
+                // Ways are adjacent, and so are their indexes
+                candidateIndexes.clear();
+                for (int i = 0; i < getWayAllocationMax(); i++) {
+                    candidateIndexes.push_back(indexOf(way + i));
+                }
+                victim = &entries[inlinePolicy->getVictim(candidateIndexes)];
+                invalidate(victim);
+                return victim;
+            }
+        }
+        candidates.clear();
+        for (int i = 0; i < getWayAllocationMax(); i++) {
+            candidates.push_back(way + i);
+        }
+        victim = static_cast<Entry*>(replacementPolicy->getVictim(
+                                candidates));
+    } else {
+        const std::vector<ReplaceableEntry*> selected_entries =
+            indexingPolicy->getPossibleEntries(addr);
+        victim = pickVictim(selected_entries.begin(),
+                            selected_entries.begin() + getWayAllocationMax());
+    }
     // There is only one eviction for this replacement
     invalidate(victim);
     return victim;
 }
 
+template<class Entry, class InlinePolicy>
+Entry*
+AssociativeSet<Entry, InlinePolicy>::findVictim(
+        const std::vector<Entry *> &ways)
+{
+    Entry* victim = pickVictim(ways.begin(), ways.end());
+    invalidate(victim);
+    return victim;
+}
 
-template<class Entry>
+template<class Entry, class InlinePolicy>
 std::vector<Entry *>
-AssociativeSet<Entry>::getPossibleEntries(const Addr addr) const
+AssociativeSet<Entry, InlinePolicy>::getPossibleEntries(const Addr addr) const
 {
-    std::vector<ReplaceableEntry *> selected_entries =
-        indexingPolicy->getPossibleEntries(addr);
-         const std::vector<ReplaceableEntry*> slice = std::vector<ReplaceableEntry*>(selected_entries.begin(), selected_entries.begin()+getWayAllocationMax());
-    std::vector<Entry *> entries(slice.size(), nullptr);
+    std::vector<Entry *> ways;
+    getPossibleEntries(addr, ways);
+    return ways;
+}
+
+template<class Entry, class InlinePolicy>
+void
+AssociativeSet<Entry, InlinePolicy>::getPossibleEntries(const Addr addr,
+        std::vector<Entry *> &ways) const
+{
+    ways.resize(getWayAllocationMax());
+    if (setIndexing) {
+        Entry* way = firstWay(addr);
+        for (unsigned int idx = 0; idx < ways.size(); idx++) {
+            ways[idx] = way + idx;
+        }
+        return;
+    }
 
-    unsigned int idx = 0;
-    for (auto &entry : slice) {
-        entries[idx++] = static_cast<Entry *>(entry);
+    const std::vector<ReplaceableEntry *> selected_entries =
+        indexingPolicy->getPossibleEntries(addr);
+    for (unsigned int idx = 0; idx < ways.size(); idx++) {
+        ways[idx] = static_cast<Entry *>(selected_entries[idx]);
     }
-    return entries;
 }
 
-template<class Entry>
+template<class Entry, class InlinePolicy>
 void
-AssociativeSet<Entry>::insertEntry(Addr addr, bool is_secure, Entry* entry)
+AssociativeSet<Entry, InlinePolicy>::insertEntry(Addr addr, bool is_secure,
+                                                 Entry* entry)
 {
    entry->insert(indexingPolicy->extractTag(addr), is_secure);
+   if constexpr (hasInlinePolicy) {
+       if (inlinePolicy) {
+           inlinePolicy->reset(indexOf(entry), addr);
+           return;
+       }
+   }
    replacementPolicy->reset(entry->replacementData);
 }
 
-template<class Entry>
+template<class Entry, class InlinePolicy>
 void
-AssociativeSet<Entry>::invalidate(Entry* entry)
+AssociativeSet<Entry, InlinePolicy>::restoreEntry(Addr tag, bool is_secure,
+                                                  Entry* entry)
+{
+    entry->insert(tag, is_secure);
+    if constexpr (hasInlinePolicy) {
+        if (inlinePolicy) {
+            inlinePolicy->reset(indexOf(entry), tag);
+            return;
+        }
+    }
+    replacementPolicy->reset(entry->replacementData);
+}
+
+template<class Entry, class InlinePolicy>
+void
+AssociativeSet<Entry, InlinePolicy>::invalidate(Entry* entry)
 {
     entry->invalidate();
+    if constexpr (hasInlinePolicy) {
+        if (inlinePolicy) {
+            inlinePolicy->invalidate(indexOf(entry));
+            return;
+        }
+    }
     replacementPolicy->invalidate(entry->replacementData);
 }
 
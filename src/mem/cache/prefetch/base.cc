@@ -58,19 +58,17 @@ namespace gem5
 namespace prefetch
 {
 
-Base::PrefetchInfo::PrefetchInfo(PacketPtr pkt, Addr addr, bool miss)
+Base::PrefetchInfo::PrefetchInfo(PacketPtr pkt, Addr addr, bool miss,
+                                 bool with_data)
   : address(addr), pc(pkt->req->hasPC() ? pkt->req->getPC() : 0),
     requestorId(pkt->req->requestorId()), validPC(pkt->req->hasPC()),
     secure(pkt->isSecure()), size(pkt->req->getSize()), write(pkt->isWrite()),
-    paddress(pkt->req->getPaddr()), cacheMiss(miss)
+    paddress(pkt->req->getPaddr()), cacheMiss(miss), confident(true),
+    data(nullptr)
 {
-    unsigned int req_size = pkt->req->getSize();
-    if (!write && miss) {
-        data = nullptr;
-    } else {
-        data = new uint8_t[req_size];
+    if (with_data && (write || !miss)) {
         Addr offset = pkt->req->getPaddr() - pkt->getAddr();
-        std::memcpy(data, &(pkt->getConstPtr<uint8_t>()[offset]), req_size);
+        data = pkt->getConstPtr<uint8_t>() + offset;
     }
 }
 
@@ -78,7 +76,7 @@ Base::PrefetchInfo::PrefetchInfo(PrefetchInfo const &pfi, Addr addr)
   : address(addr), pc(pfi.pc), requestorId(pfi.requestorId),
     validPC(pfi.validPC), secure(pfi.secure), size(pfi.size),
     write(pfi.write), paddress(pfi.paddress), cacheMiss(pfi.cacheMiss),
-    data(nullptr)
+    confident(true), data(nullptr)
 {
 }
 
@@ -265,15 +263,18 @@ Base::probeNotify(const PacketPtr &pkt, bool miss)
             // This case happens when a demand hits on a prefetched line
             // that's not in the requested coherency state.
             prefetchStats.pfUsefulButMiss++;
+        notifyPrefetchUseful(pkt->getAddr(), pkt->isSecure());
     }
 
     // Verify this access type is observed by prefetcher
     if (observeAccess(pkt, miss)) {
         if (useVirtualAddresses && pkt->req->hasVaddr()) {
-            PrefetchInfo pfi(pkt, pkt->req->getVaddr(), miss);
+            PrefetchInfo pfi(pkt, pkt->req->getVaddr(), miss,
+                             needsAccessData());
             notify(pkt, pfi);
         } else if (!useVirtualAddresses) {
-            PrefetchInfo pfi(pkt, pkt->req->getPaddr(), miss);
+            PrefetchInfo pfi(pkt, pkt->req->getPaddr(), miss,
+                             needsAccessData());
             notify(pkt, pfi);
         }
     }
@@ -113,8 +113,17 @@ class Base : public ClockedObject
         Addr paddress;
         /** Whether this event comes from a cache miss */
         bool cacheMiss;
-        /** Pointer to the associated request data */
-        uint8_t *data;
+        /**
+         * For the PrefetchInfo of a prefetch, whether the prefetcher is
+         * confident the block will be used
+         */
+        bool confident;
+        /**
+         * View of the request data inside the triggering packet, only set
+         * for prefetchers that need access data. It is borrowed, so it is
+         * only valid while the access is being notified.
+         */
+        const uint8_t *data;
 
       public:
         /**
@@ -201,7 +210,24 @@ class Base : public ClockedObject
         }
 
         /**
-         * Gets the associated data of the request triggering the event
+         * Check if the prefetcher is confident in this prefetch
+         * @result false if the caches should insert the block as unlikely
+         *         to be used
+         */
+        bool isConfident() const
+        {
+            return confident;
+        }
+
+        void setConfident(bool c)
+        {
+            confident = c;
+        }
+
+        /**
+         * Gets the associated data of the request triggering the event.
+         * Only available to prefetchers that need access data, and only
+         * while the access is being notified.
          * @param Byte ordering of the stored data
          * @return the data
          */
@@ -214,10 +240,10 @@ class Base : public ClockedObject
             }
             switch (endian) {
                 case ByteOrder::big:
-                    return betoh(*(T*)data);
+                    return betoh(*(const T*)data);
 
                 case ByteOrder::little:
-                    return letoh(*(T*)data);
+                    return letoh(*(const T*)data);
 
                 default:
                     panic("Illegal byte order in PrefetchInfo::get()\n");
@@ -241,8 +267,10 @@ class Base : public ClockedObject
          * @param addr the address value of the new object, this address is
          *        used to train the prefetcher
          * @param miss whether this event comes from a cache miss
+         * @param with_data whether to give access to the request data
          */
-        PrefetchInfo(PacketPtr pkt, Addr addr, bool miss);
+        PrefetchInfo(PacketPtr pkt, Addr addr, bool miss,
+                     bool with_data = false);
 
         /**
          * Constructs a PrefetchInfo using a new address value and
@@ -251,11 +279,6 @@ class Base : public ClockedObject
          * @param addr the address value of the new object
          */
         PrefetchInfo(PrefetchInfo const &pfi, Addr addr);
-
-        ~PrefetchInfo()
-        {
-            delete[] data;
-        }
     };
 
   protected:
@@ -386,10 +409,55 @@ class Base : public ClockedObject
      */
     virtual void notify(const PacketPtr &pkt, const PrefetchInfo &pfi) = 0;
 
+    /**
+     * Whether the prefetcher reads the data of the accesses it is
+     * notified of. Access data is otherwise not handed to it, which
+     * keeps the packet data out of the notification path.
+     */
+    virtual bool needsAccessData() const { return false; }
+
     /** Notify prefetcher of cache fill */
     virtual void notifyFill(const PacketPtr &pkt)
     {}
 
+    /**
+     * Notify prefetcher that one of its prefetches was dropped as the
+     * block was already being fetched into the cache, i.e. it was late.
+     * @param pkt The dropped prefetch
+     */
+    virtual void notifyPfHitInMSHR(const PacketPtr &pkt)
+    {}
+
+    /**
+     * Notify prefetcher that a block it prefetched left the cache without
+     * being used.
+     * @param addr Address of the block
+     * @param is_secure Whether the block was in the secure space
+     */
+    virtual void notifyPrefetchUnused(Addr addr, bool is_secure)
+    {}
+
+    /**
+     * Notify prefetcher that a demand access used a prefetched block.
+     * @param addr Address of the access
+     * @param is_secure Whether the access targets the secure space
+     */
+    virtual void notifyPrefetchUseful(Addr addr, bool is_secure)
+    {}
+
+    /**
+     * Take back a prefetch getPacket() returned that was dropped before
+     * leaving the cache, e.g. by a prefetcher arbitrating between several,
+     * so that it does not count as issued.
+     * @param pkt The dropped prefetch
+     */
+    virtual void
+    notifyPrefetchDropped(const PacketPtr &pkt)
+    {
+        prefetchStats.pfIssued--;
+        issuedPrefetches--;
+    }
+
     virtual PacketPtr getPacket() = 0;
 
     virtual Tick nextPrefetchReadyTime() const = 0;
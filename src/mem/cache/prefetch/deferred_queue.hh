@@ -0,0 +1,266 @@
+/**
+ * @file
+ * Priority queue of the prefetches a queued prefetcher has yet to issue.
+ */
+
+#ifndef __MEM_CACHE_PREFETCH_DEFERRED_QUEUE_HH__
+#define __MEM_CACHE_PREFETCH_DEFERRED_QUEUE_HH__
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <utility>
+#include <vector>
+
+#include "base/compiler.hh"
+#include "base/intmath.hh"
+#include "base/types.hh"
+
+namespace gem5
+{
+
+GEM5_DEPRECATED_NAMESPACE(Prefetcher, prefetch);
+namespace prefetch
+{
+
+/**
+ * Queue of deferred prefetches, ordered by decreasing priority and then
+ * by age, and hashed by prefetch address so that lookups, squashes and
+ * priority updates need no scan. Entries are list nodes recycled through
+ * a free list, so a queue that has once been full never allocates. The
+ * MMU holds on to entries being translated, so those removed
+ * mid-translation are kept aside until it is done with them.
+ *
+ * @tparam Entry Queued prefetch. It must provide the pfInfo of the
+ *         prefetch, whose getAddr() and isSecure() key the hash, its
+ *         int32_t priority, and the ongoingTranslation flag and
+ *         translationRequest of its address translation.
+ */
+template <typename Entry>
+class DeferredQueue
+{
+  public:
+    using iterator = typename std::list<Entry>::iterator;
+    using const_iterator = typename std::list<Entry>::const_iterator;
+
+  private:
+    std::list<Entry> queue;
+    /** Nodes of removed entries, reused by later insertions */
+    std::list<Entry> freeNodes;
+    /** Nodes of entries removed while their translation was in flight */
+    std::list<Entry> draining;
+    /**
+     * Priority and last entry of every priority level in the queue, from
+     * the front of the queue
+     */
+    std::vector<std::pair<int32_t, iterator>> levels;
+    /** Open-addressed hash of the entries, end() in empty slots */
+    std::vector<iterator> index;
+    /** log2 of the number of index slots */
+    unsigned indexBits;
+
+    size_t
+    slot(Addr addr, bool is_secure) const
+    {
+        // Fibonacci hashing: the top bits of the product mix every
+        // address bit
+        return ((addr ^ is_secure) * 0x9e3779b97f4a7c15ULL) >>
+            (64 - indexBits);
+    }
+
+    void
+    indexInsert(iterator it)
+    {
+        const size_t mask = index.size() - 1;
+        size_t s = slot(it->pfInfo.getAddr(), it->pfInfo.isSecure());
+        while (index[s] != queue.end()) {
+            s = (s + 1) & mask;
+        }
+        index[s] = it;
+    }
+
+    void
+    indexErase(iterator it)
+    {
+        const size_t mask = index.size() - 1;
+        size_t hole = slot(it->pfInfo.getAddr(), it->pfInfo.isSecure());
+        while (index[hole] != it) {
+            assert(index[hole] != queue.end());
+            hole = (hole + 1) & mask;
+        }
+        // Shift back the entries of the probe sequence past the hole that
+        // could not have been placed before it, so that no lookup stops
+        // early
+        for (size_t s = (hole + 1) & mask; index[s] != queue.end();
+             s = (s + 1) & mask) {
+            const size_t home = slot(index[s]->pfInfo.getAddr(),
+                                     index[s]->pfInfo.isSecure());
+            if (((s - home) & mask) >= ((s - hole) & mask)) {
+                index[hole] = index[s];
+                hole = s;
+            }
+        }
+        index[hole] = queue.end();
+    }
+
+    /** Move a free node to the back of its priority level */
+    void
+    link(iterator it)
+    {
+        const int32_t priority = it->priority;
+        auto level = std::find_if(levels.begin(), levels.end(),
+            [priority](const auto &l) { return l.first <= priority; });
+        if (level != levels.end() && level->first == priority) {
+            queue.splice(std::next(level->second), freeNodes, it);
+            level->second = it;
+        } else {
+            queue.splice(level == levels.begin() ? queue.begin() :
+                         std::next(std::prev(level)->second), freeNodes, it);
+            levels.insert(level, {priority, it});
+        }
+    }
+
+    /** Remove an entry from its priority level */
+    void
+    unlinkLevel(iterator it)
+    {
+        auto level = std::find_if(levels.begin(), levels.end(),
+            [&it](const auto &l) { return l.first == it->priority; });
+        assert(level != levels.end());
+        if (level->second != it) {
+            return;
+        }
+        if (it != queue.begin() && std::prev(it)->priority == it->priority) {
+            level->second = std::prev(it);
+        } else {
+            levels.erase(level);
+        }
+    }
+
+  public:
+    /** @param capacity Most entries the queue will hold at once */
+    DeferredQueue(size_t capacity)
+      : indexBits(ceilLog2(std::max<size_t>(capacity, 1)) + 1)
+    {
+        // At most half full, so probe sequences stay short
+        index.assign(size_t(1) << indexBits, queue.end());
+    }
+
+    DeferredQueue(const DeferredQueue &) = delete;
+    DeferredQueue &operator=(const DeferredQueue &) = delete;
+
+    bool empty() const { return queue.empty(); }
+    size_t size() const { return queue.size(); }
+    Entry &front() { return queue.front(); }
+    const Entry &front() const { return queue.front(); }
+    iterator begin() { return queue.begin(); }
+    iterator end() { return queue.end(); }
+    const_iterator begin() const { return queue.cbegin(); }
+    const_iterator end() const { return queue.cend(); }
+
+    /** @return The first entry queued for an address, or end(). */
+    iterator
+    find(Addr addr, bool is_secure)
+    {
+        const size_t mask = index.size() - 1;
+        for (size_t s = slot(addr, is_secure); index[s] != queue.end();
+             s = (s + 1) & mask) {
+            if (index[s]->pfInfo.getAddr() == addr &&
+                index[s]->pfInfo.isSecure() == is_secure) {
+                return index[s];
+            }
+        }
+        return queue.end();
+    }
+
+    /** @return The entry stored at entry, or end(). */
+    iterator
+    find(const Entry *entry)
+    {
+        const size_t mask = index.size() - 1;
+        for (size_t s = slot(entry->pfInfo.getAddr(),
+                             entry->pfInfo.isSecure());
+             index[s] != queue.end(); s = (s + 1) & mask) {
+            if (&*index[s] == entry) {
+                return index[s];
+            }
+        }
+        return queue.end();
+    }
+
+    /** Queue a copy of entry behind the entries of equal priority. */
+    iterator
+    insert(const Entry &entry)
+    {
+        if (freeNodes.empty()) {
+            freeNodes.push_back(entry);
+        } else {
+            freeNodes.front() = entry;
+        }
+        iterator it = freeNodes.begin();
+        link(it);
+        indexInsert(it);
+        return it;
+    }
+
+    void
+    erase(iterator it)
+    {
+        indexErase(it);
+        unlinkLevel(it);
+        if (it->ongoingTranslation) {
+            // The MMU will still complete the translation into this node
+            draining.splice(draining.end(), queue, it);
+        } else {
+            // Drop the translation request now rather than when the node
+            // is reused
+            it->translationRequest = nullptr;
+            freeNodes.splice(freeNodes.begin(), queue, it);
+        }
+    }
+
+    /**
+     * Reclaim the node of an entry removed while its translation was in
+     * flight, once the translation has finished.
+     * @return Whether entry was such an entry.
+     */
+    bool
+    release(const Entry *entry)
+    {
+        auto it = std::find_if(draining.begin(), draining.end(),
+            [entry](const Entry &node) { return &node == entry; });
+        if (it == draining.end()) {
+            return false;
+        }
+        assert(!it->ongoingTranslation);
+        it->translationRequest = nullptr;
+        freeNodes.splice(freeNodes.begin(), draining, it);
+        return true;
+    }
+
+    /** Move an entry behind the entries of its new priority. */
+    void
+    setPriority(iterator it, int32_t priority)
+    {
+        unlinkLevel(it);
+        freeNodes.splice(freeNodes.begin(), queue, it);
+        it->priority = priority;
+        link(it);
+    }
+
+    /** @return The oldest entry of the lowest priority. */
+    iterator
+    lowestPriority()
+    {
+        assert(!levels.empty());
+        return levels.size() == 1 ? queue.begin() :
+            std::next(levels[levels.size() - 2].second);
+    }
+};
+
+} // namespace prefetch
+} // namespace gem5
+
+#endif // __MEM_CACHE_PREFETCH_DEFERRED_QUEUE_HH__
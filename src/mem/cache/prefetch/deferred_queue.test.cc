@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2023
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "mem/cache/prefetch/deferred_queue.hh"
+
+using namespace gem5;
+
+namespace
+{
+
+/** Stand-in for the prefetch info of a queued prefetch. */
+struct FakeInfo
+{
+    Addr addr;
+    bool secure;
+
+    Addr getAddr() const { return addr; }
+    bool isSecure() const { return secure; }
+};
+
+/** Stand-in for a queued prefetch. */
+struct FakeEntry
+{
+    FakeInfo pfInfo;
+    int32_t priority;
+    bool ongoingTranslation;
+    std::shared_ptr<int> translationRequest;
+
+    FakeEntry(Addr addr, int32_t priority, bool secure = false)
+      : pfInfo{addr, secure}, priority(priority), ongoingTranslation(false),
+        translationRequest()
+    {}
+};
+
+using Queue = prefetch::DeferredQueue<FakeEntry>;
+
+/** @return The addresses of the queued entries, from the front. */
+std::vector<Addr>
+order(const Queue &queue)
+{
+    std::vector<Addr> addrs;
+    for (const FakeEntry &entry : queue) {
+        addrs.push_back(entry.pfInfo.getAddr());
+    }
+    return addrs;
+}
+
+} // anonymous namespace
+
+/** Test that entries are ordered by priority, then by insertion. */
+TEST(DeferredQueueTest, InsertOrder)
+{
+    Queue queue(8);
+    ASSERT_TRUE(queue.empty());
+    queue.insert(FakeEntry(0x100, 1));
+    queue.insert(FakeEntry(0x200, 1));
+    queue.insert(FakeEntry(0x300, 3));
+    queue.insert(FakeEntry(0x400, 1));
+    queue.insert(FakeEntry(0x500, 3));
+    queue.insert(FakeEntry(0x600, 2));
+    queue.insert(FakeEntry(0x700, -1));
+
+    ASSERT_EQ(queue.size(), 7);
+    ASSERT_EQ(order(queue), std::vector<Addr>(
+        {0x300, 0x500, 0x600, 0x100, 0x200, 0x400, 0x700}));
+    ASSERT_EQ(queue.front().pfInfo.getAddr(), 0x300);
+}
+
+/** Test that a changed priority moves an entry behind its new level. */
+TEST(DeferredQueueTest, SetPriority)
+{
+    Queue queue(8);
+    queue.insert(FakeEntry(0x100, 1));
+    queue.insert(FakeEntry(0x200, 1));
+    queue.insert(FakeEntry(0x300, 3));
+    queue.insert(FakeEntry(0x400, 1));
+
+    // Promoted behind the entries already at the new priority
+    queue.setPriority(queue.find(0x200, false), 3);
+    ASSERT_EQ(order(queue), std::vector<Addr>({0x300, 0x200, 0x100, 0x400}));
+
+    // Promoted to a priority no other entry has
+    queue.setPriority(queue.find(0x400, false), 5);
+    ASSERT_EQ(order(queue), std::vector<Addr>({0x400, 0x300, 0x200, 0x100}));
+
+    // Promoting the last entry of a level empties it
+    queue.setPriority(queue.find(0x100, false), 2);
+    ASSERT_EQ(order(queue), std::vector<Addr>({0x400, 0x300, 0x200, 0x100}));
+    ASSERT_EQ(queue.lowestPriority()->pfInfo.getAddr(), 0x100);
+
+    // Entries inserted later still queue behind the promoted ones
+    queue.insert(FakeEntry(0x500, 3));
+    queue.insert(FakeEntry(0x600, 2));
+    ASSERT_EQ(order(queue), std::vector<Addr>(
+        {0x400, 0x300, 0x200, 0x500, 0x100, 0x600}));
+}
+
+/** Test that the oldest entry of the lowest priority is found. */
+TEST(DeferredQueueTest, LowestPriority)
+{
+    Queue queue(8);
+    queue.insert(FakeEntry(0x100, 2));
+    ASSERT_EQ(queue.lowestPriority()->pfInfo.getAddr(), 0x100);
+    queue.insert(FakeEntry(0x200, 2));
+    ASSERT_EQ(queue.lowestPriority()->pfInfo.getAddr(), 0x100);
+    queue.insert(FakeEntry(0x300, 1));
+    queue.insert(FakeEntry(0x400, 1));
+    queue.insert(FakeEntry(0x500, 4));
+    ASSERT_EQ(queue.lowestPriority()->pfInfo.getAddr(), 0x300);
+    queue.erase(queue.lowestPriority());
+    ASSERT_EQ(queue.lowestPriority()->pfInfo.getAddr(), 0x400);
+    queue.erase(queue.lowestPriority());
+    ASSERT_EQ(queue.lowestPriority()->pfInfo.getAddr(), 0x100);
+}
+
+/**
+ * Test that a full queue makes room by dropping its oldest entry of the
+ * lowest priority, as the queued prefetcher does, reusing its node.
+ */
+TEST(DeferredQueueTest, FullQueueEviction)
+{
+    const size_t capacity = 4;
+    Queue queue(capacity);
+    queue.insert(FakeEntry(0x100, 2));
+    queue.insert(FakeEntry(0x200, 1));
+    queue.insert(FakeEntry(0x300, 1));
+    queue.insert(FakeEntry(0x400, 3));
+    ASSERT_EQ(queue.size(), capacity);
+
+    for (Addr addr : {0x500, 0x600}) {
+        auto victim = queue.lowestPriority();
+        const FakeEntry *node = &*victim;
+        queue.erase(victim);
+        auto it = queue.insert(FakeEntry(addr, 2));
+        ASSERT_EQ(&*it, node);
+        ASSERT_EQ(queue.size(), capacity);
+    }
+    ASSERT_EQ(queue.find(0x200, false), queue.end());
+    ASSERT_EQ(queue.find(0x300, false), queue.end());
+    ASSERT_EQ(order(queue), std::vector<Addr>({0x400, 0x100, 0x500, 0x600}));
+
+    // The new entries are now the youngest of the lowest priority
+    queue.erase(queue.lowestPriority());
+    ASSERT_EQ(order(queue), std::vector<Addr>({0x400, 0x500, 0x600}));
+}
+
+/** Test lookups by address, security and entry. */
+TEST(DeferredQueueTest, Find)
+{
+    Queue queue(8);
+    auto non_secure = queue.insert(FakeEntry(0x100, 1));
+    auto secure = queue.insert(FakeEntry(0x100, 1, true));
+    ASSERT_EQ(queue.find(0x100, false), non_secure);
+    ASSERT_EQ(queue.find(0x100, true), secure);
+    ASSERT_EQ(queue.find(0x140, false), queue.end());
+    ASSERT_EQ(queue.find(&*secure), secure);
+
+    const FakeEntry outsider(0x100, 1, true);
+    ASSERT_EQ(queue.find(&outsider), queue.end());
+
+    queue.erase(non_secure);
+    ASSERT_EQ(queue.find(0x100, false), queue.end());
+    ASSERT_EQ(queue.find(0x100, true), secure);
+}
+
+/**
+ * Test that erasing entries keeps every other one reachable. The queue
+ * is filled to capacity, so the hash holds many probe sequences that
+ * collide and wrap around, and the entries are erased in random order.
+ */
+TEST(DeferredQueueTest, EraseCollidingEntries)
+{
+    const size_t capacity = 64;
+    Queue queue(capacity);
+    std::mt19937 rng(1);
+
+    for (unsigned round = 0; round < 8; round++) {
+        // Blocks of a few pages, some of them queued twice, which the
+        // hash of the address alone cannot tell apart
+        std::vector<Addr> live;
+        while (live.size() < capacity) {
+            const Addr addr = (rng() % 512) * 64;
+            queue.insert(FakeEntry(addr, rng() % 4));
+            live.push_back(addr);
+        }
+        std::shuffle(live.begin(), live.end(), rng);
+
+        while (!live.empty()) {
+            const Addr addr = live.back();
+            live.pop_back();
+            auto it = queue.find(addr, false);
+            ASSERT_NE(it, queue.end());
+            queue.erase(it);
+            ASSERT_EQ(queue.size(), live.size());
+            for (Addr other : live) {
+                auto found = queue.find(other, false);
+                ASSERT_NE(found, queue.end());
+                ASSERT_EQ(found->pfInfo.getAddr(), other);
+                ASSERT_EQ(queue.find(&*found), found);
+            }
+            if (std::find(live.begin(), live.end(), addr) == live.end()) {
+                ASSERT_EQ(queue.find(addr, false), queue.end());
+            }
+        }
+        ASSERT_TRUE(queue.empty());
+    }
+}
+
+/**
+ * Test that an entry removed while being translated keeps its node until
+ * the translation has finished.
+ */
+TEST(DeferredQueueTest, ReleaseAfterTranslation)
+{
+    Queue queue(8);
+    auto translating = queue.insert(FakeEntry(0x100, 1));
+    translating->ongoingTranslation = true;
+    translating->translationRequest = std::make_shared<int>(0);
+    FakeEntry *node = &*translating;
+    auto other = queue.insert(FakeEntry(0x200, 1));
+
+    queue.erase(translating);
+    ASSERT_EQ(queue.find(0x100, false), queue.end());
+    ASSERT_EQ(queue.find(node), queue.end());
+    ASSERT_EQ(node->pfInfo.getAddr(), 0x100);
+    ASSERT_NE(node->translationRequest, nullptr);
+
+    // Only nodes set aside can be released
+    ASSERT_FALSE(queue.release(&*other));
+
+    // New entries must not land on the node being translated into
+    for (Addr addr : {0x300, 0x400, 0x500}) {
+        ASSERT_NE(&*queue.insert(FakeEntry(addr, 1)), node);
+    }
+    ASSERT_EQ(node->pfInfo.getAddr(), 0x100);
+
+    // Once translated the node is recycled, only once
+    node->ongoingTranslation = false;
+    ASSERT_TRUE(queue.release(node));
+    ASSERT_EQ(node->translationRequest, nullptr);
+    ASSERT_FALSE(queue.release(node));
+    ASSERT_EQ(&*queue.insert(FakeEntry(0x600, 1)), node);
+}
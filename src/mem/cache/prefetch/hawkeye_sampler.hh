@@ -0,0 +1,321 @@
+/**
+ * @file
+ * Hawkeye/OPTgen sampler shared by the temporal prefetchers.
+ */
+
+#ifndef __MEM_CACHE_PREFETCH_HAWKEYE_SAMPLER_HH__
+#define __MEM_CACHE_PREFETCH_HAWKEYE_SAMPLER_HH__
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "base/random.hh"
+#include "base/sat_counter.hh"
+#include "base/statistics.hh"
+#include "base/types.hh"
+#include "mem/cache/prefetch/associative_set.hh"
+#include "sim/serialize.hh"
+
+namespace gem5
+{
+
+GEM5_DEPRECATED_NAMESPACE(Prefetcher, prefetch);
+namespace prefetch
+{
+
+/**
+ * Samples a fixed number of Markov table sets and replays the metadata
+ * accesses that fall in them through OPTgen, training a per-PC confidence
+ * counter in the prefetcher's training unit: up when Belady's OPT would
+ * have kept the entry, down when it would not. Each address is routed
+ * only to the samplers that own its set, so the common case is a single
+ * bitmap test rather than a walk over every sampler.
+ */
+template <class TrainingEntry>
+class HawkeyeSampler : public Serializable
+{
+  public:
+    /** Training unit counter the sampler trains */
+    typedef SatCounter8 TrainingEntry::*Confidence;
+
+    /** Maximum number of entries OPTgen holds per sampled set */
+    static const int maxElems = 8;
+
+  private:
+    /** Accesses remembered per sampled set */
+    static const int historyLength = 64;
+    /** Occupancy counters packed per 64-bit word, 4 bits each */
+    static const int slotsPerWord = 16;
+    /** Checkpointed words per sampled set */
+    static const int packedWords =
+        2 + 2 * historyLength + historyLength / slotsPerWord;
+    static const uint64_t laneOnes = 0x1111111111111111ULL;
+
+    struct SampledSet
+    {
+        uint64_t set;
+        int iteration;
+        Addr logaddrs[historyLength];
+        Addr logpcs[historyLength];
+        /** OPTgen occupancy vector, never exceeds maxElems */
+        uint64_t occupancy[historyLength / slotsPerWord];
+
+        void
+        reset(uint64_t sampled)
+        {
+            set = sampled;
+            iteration = 0;
+            for (int x = 0; x < historyLength; x++) {
+                logaddrs[x] = 0;
+                logpcs[x] = 0;
+            }
+            for (auto &word : occupancy) {
+                word = 0;
+            }
+        }
+
+        int
+        getOccupancy(int slot) const
+        {
+            return (occupancy[slot / slotsPerWord] >>
+                    (4 * (slot % slotsPerWord))) & 0xf;
+        }
+
+        void
+        clearOccupancy(int slot)
+        {
+            occupancy[slot / slotsPerWord] &=
+                ~(0xfULL << (4 * (slot % slotsPerWord)));
+        }
+
+        /** Increment the occupancy of slots [from, to), without wrapping */
+        void
+        incrementOccupancy(int from, int to)
+        {
+            for (int w = from / slotsPerWord; w * slotsPerWord < to; w++) {
+                const int lo = std::max(from - w * slotsPerWord, 0);
+                const int hi = std::min(to - w * slotsPerWord, slotsPerWord);
+                const uint64_t lanes = (hi - lo == slotsPerWord) ? ~0ULL :
+                    ((1ULL << (4 * (hi - lo))) - 1);
+                occupancy[w] += laneOnes & (lanes << (4 * lo));
+            }
+        }
+
+        /** Increment the occupancy of the circular slot range [from, to) */
+        void
+        incrementOccupancyWrapped(int from, int to)
+        {
+            if (from < to) {
+                incrementOccupancy(from, to);
+            } else {
+                incrementOccupancy(from, historyLength);
+                incrementOccupancy(0, to);
+            }
+        }
+    };
+
+    /** Counter in the training entry trained by the samplers */
+    const Confidence confidence;
+
+    std::vector<SampledSet> samplers;
+
+    /** Number of Markov table sets sampled from; 0 disables sampling */
+    uint64_t numSets;
+
+    /** One bit per Markov table set, set if any sampler owns it */
+    std::vector<bool> sampledSets;
+
+    uint64_t
+    setOf(Addr addr) const
+    {
+        return addr % numSets;
+    }
+
+    bool
+    isSampled(Addr addr) const
+    {
+        return numSets != 0 && sampledSets[setOf(addr)];
+    }
+
+    struct HawkeyeStats : public statistics::Group
+    {
+        HawkeyeStats(statistics::Group *parent)
+          : statistics::Group(parent, "hawkeye"),
+            ADD_STAT(sampledAccesses, statistics::units::Count::get(),
+                     "number of accesses that fell in a sampled set"),
+            ADD_STAT(optHits, statistics::units::Count::get(),
+                     "number of sampled reuses OPT would have kept"),
+            ADD_STAT(optMisses, statistics::units::Count::get(),
+                     "number of sampled accesses OPT would have dropped"),
+            ADD_STAT(optHitRate, statistics::units::Ratio::get(),
+                     "fraction of sampled OPT decisions that were hits",
+                     optHits / (optHits + optMisses)),
+            ADD_STAT(evictionsTrained, statistics::units::Count::get(),
+                     "number of Markov evictions matched in a sampler")
+        {
+        }
+
+        statistics::Scalar sampledAccesses;
+        statistics::Scalar optHits;
+        statistics::Scalar optMisses;
+        statistics::Formula optHitRate;
+        statistics::Scalar evictionsTrained;
+    } stats;
+
+  public:
+    HawkeyeSampler(statistics::Group *parent, Confidence conf,
+                   int num_samplers = 64)
+      : confidence(conf), samplers(num_samplers), numSets(0), stats(parent)
+    {
+    }
+
+    /**
+     * Clear all histories and pick a new set for each sampler.
+     * @param table_entries Current number of Markov table entries.
+     */
+    void
+    reset(uint64_t table_entries)
+    {
+        numSets = table_entries / maxElems;
+        sampledSets.assign(numSets, false);
+        for (auto &sampler : samplers) {
+            sampler.reset(numSets ?
+                random_mt.random<uint64_t>(0, numSets - 1) : 0);
+            if (numSets) {
+                sampledSets[sampler.set] = true;
+            }
+        }
+    }
+
+    void
+    serialize(CheckpointOut &cp) const override
+    {
+        std::vector<uint64_t> data;
+        for (const auto &s : samplers) {
+            data.push_back(s.set);
+            data.push_back(s.iteration);
+            data.insert(data.end(), std::begin(s.logaddrs),
+                        std::end(s.logaddrs));
+            data.insert(data.end(), std::begin(s.logpcs),
+                        std::end(s.logpcs));
+            data.insert(data.end(), std::begin(s.occupancy),
+                        std::end(s.occupancy));
+        }
+        SERIALIZE_SCALAR(numSets);
+        arrayParamOut(cp, "samplers", data);
+    }
+
+    void
+    unserialize(CheckpointIn &cp) override
+    {
+        UNSERIALIZE_SCALAR(numSets);
+        std::vector<uint64_t> data;
+        arrayParamIn(cp, "samplers", data);
+        fatal_if(data.size() != samplers.size() * packedWords,
+                 "Checkpoint holds a different number of OPTgen samplers\n");
+
+        sampledSets.assign(numSets, false);
+        auto word = data.begin();
+        for (auto &s : samplers) {
+            s.set = *word++;
+            s.iteration = *word++;
+            std::copy_n(word, historyLength, std::begin(s.logaddrs));
+            word += historyLength;
+            std::copy_n(word, historyLength, std::begin(s.logpcs));
+            word += historyLength;
+            std::copy_n(word, historyLength / slotsPerWord,
+                        std::begin(s.occupancy));
+            word += historyLength / slotsPerWord;
+            fatal_if(numSets && s.set >= numSets,
+                     "Checkpointed OPTgen sampler outside the table\n");
+            if (numSets) {
+                sampledSets[s.set] = true;
+            }
+        }
+    }
+
+    /**
+     * Record a Markov table access by pc and train its counter according
+     * to whether OPT would have hit on it.
+     * @param trainer Training unit, an AssociativeSet of TrainingEntry.
+     */
+    template <class Trainer>
+    void
+    add(Addr addr, Addr pc, Trainer &trainer)
+    {
+        if (!isSampled(addr)) {
+            return;
+        }
+        const uint64_t set = setOf(addr);
+        for (auto &s : samplers) {
+            if (s.set != set) {
+                continue;
+            }
+            stats.sampledAccesses++;
+            const int iteration = s.iteration;
+            s.logaddrs[iteration] = addr;
+            s.logpcs[iteration] = pc;
+            s.clearOccupancy(iteration);
+
+            TrainingEntry *entry = trainer.findEntry(pc, false); //TODO: is secure
+            if (entry != nullptr) {
+                for (int y = (iteration - 1) & (historyLength - 1);
+                     y != iteration; y = (y - 1) & (historyLength - 1)) {
+                    if (s.getOccupancy(y) == maxElems) {
+                        (entry->*confidence)--;
+                        stats.optMisses++;
+                        break;
+                    }
+                    if (addr == s.logaddrs[y]) {
+                        (entry->*confidence)++;
+                        s.incrementOccupancyWrapped(y, iteration);
+                        stats.optHits++;
+                        break;
+                    }
+                }
+            }
+            s.iteration = (iteration + 1) % historyLength;
+        }
+    }
+
+    /**
+     * The Markov table evicted addr: if a sampler still remembers it,
+     * weaken the confidence of the pc that last used it.
+     * @param trainer Training unit, an AssociativeSet of TrainingEntry.
+     */
+    template <class Trainer>
+    void
+    decrementOnLRU(Addr addr, Trainer &trainer)
+    {
+        if (!isSampled(addr)) {
+            return;
+        }
+        const uint64_t set = setOf(addr);
+        for (auto &s : samplers) {
+            if (s.set != set) {
+                continue;
+            }
+            const int iteration = s.iteration;
+            for (int y = iteration;
+                 y != ((iteration + 1) & (historyLength - 1));
+                 y = (y - 1) & (historyLength - 1)) {
+                if (addr == s.logaddrs[y]) {
+                    TrainingEntry *entry =
+                        trainer.findEntry(s.logpcs[y], false); //TODO: is secure
+                    if (entry != nullptr && (entry->*confidence) >= 8) {
+                        (entry->*confidence)--;
+                    }
+                    stats.evictionsTrained++;
+                    break;
+                }
+            }
+        }
+    }
+};
+
+} // namespace prefetch
+} // namespace gem5
+
+#endif // __MEM_CACHE_PREFETCH_HAWKEYE_SAMPLER_HH__
@@ -200,6 +200,8 @@ class IndirectMemory : public Queued
     IndirectMemory(const IndirectMemoryPrefetcherParams &p);
     ~IndirectMemory() = default;
 
+    bool needsAccessData() const override { return true; }
+
     void calculatePrefetch(const PrefetchInfo &pfi,
                            std::vector<AddrPriority> &addresses) override;
 };
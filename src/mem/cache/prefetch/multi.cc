@@ -37,6 +37,10 @@
 
 #include "mem/cache/prefetch/multi.hh"
 
+#include <algorithm>
+
+#include "base/intmath.hh"
+#include "debug/HWPrefetch.hh"
 #include "params/MultiPrefetcher.hh"
 
 namespace gem5
@@ -48,17 +52,171 @@ namespace prefetch
 Multi::Multi(const MultiPrefetcherParams &p)
   : Base(p),
     prefetchers(p.prefetchers.begin(), p.prefetchers.end()),
-    lastChosenPf(0)
+    lastChosenPf(0),
+    issuedBy(p.issued_prefetch_entries, {MaxAddr, false, -1, 0}),
+    dedupWindow(p.dedup_window), rankByAccuracy(p.rank_by_accuracy),
+    accuracyEpoch(p.accuracy_epoch),
+    recentIssued(prefetchers.size(), 0), recentUseful(prefetchers.size(), 0),
+    epochIssued(0),
+    bandwidthBudget(p.bandwidth_budget), budgetWindow(p.budget_window),
+    windowStart(0), windowIssued(0), multiStats(this)
+{
+    fatal_if(!issuedBy.empty() && !isPowerOf2(issuedBy.size()),
+             "issued_prefetch_entries must be a power of 2");
+    fatal_if(dedupWindow && issuedBy.empty(),
+             "dedup_window needs issued_prefetch_entries");
+}
+
+Multi::MultiStats::MultiStats(Multi *parent)
+  : statistics::Group(parent, "multi"),
+    ADD_STAT(pfDuplicate, statistics::units::Count::get(),
+        "number of prefetches dropped as one was recently issued for the "
+        "same block"),
+    ADD_STAT(budgetExhausted, statistics::units::Count::get(),
+        "number of budget windows in which the prefetch budget ran out"),
+    ADD_STAT(issued, statistics::units::Count::get(),
+        "number of prefetches issued by each sub-prefetcher"),
+    ADD_STAT(useful, statistics::units::Count::get(),
+        "number of useful prefetches issued by each sub-prefetcher"),
+    ADD_STAT(accuracy, statistics::units::Ratio::get(),
+        "accuracy of each sub-prefetcher")
 {
+    issued.init(parent->prefetchers.size());
+    useful.init(parent->prefetchers.size());
+    accuracy = useful / issued;
 }
 
 void
 Multi::setCache(BaseCache *_cache)
 {
+    // Listen to the cache too, to credit sub-prefetchers with useful
+    // prefetches
+    Base::setCache(_cache);
     for (auto pf : prefetchers)
         pf->setCache(_cache);
 }
 
+double
+Multi::accuracy(int pf) const
+{
+    // Smoothed, so that a sub-prefetcher that has issued nothing yet is
+    // not ranked last
+    return (recentUseful[pf] + 1) / (recentIssued[pf] + 2);
+}
+
+bool
+Multi::budgetUsed() const
+{
+    return bandwidthBudget && windowIssued >= bandwidthBudget &&
+        curTick() < windowStart + cyclesToTicks(budgetWindow);
+}
+
+Multi::IssuedPrefetch &
+Multi::issuedEntry(Addr block)
+{
+    return issuedBy[blockIndex(block) & (issuedBy.size() - 1)];
+}
+
+int
+Multi::resolve(Addr addr, bool is_secure)
+{
+    if (issuedBy.empty()) {
+        return -1;
+    }
+    const Addr block = blockAddress(addr);
+    IssuedPrefetch &issued = issuedEntry(block);
+    if (issued.block != block || issued.secure != is_secure) {
+        return -1;
+    }
+    const int pf = issued.prefetcher;
+    issued.prefetcher = -1;
+    return pf;
+}
+
+bool
+Multi::isDuplicate(const PacketPtr &pkt)
+{
+    if (!dedupWindow) {
+        return false;
+    }
+    const Addr block = blockAddress(pkt->getAddr());
+    const IssuedPrefetch &issued = issuedEntry(block);
+    return issued.block == block && issued.secure == pkt->isSecure() &&
+        curTick() < issued.issued + cyclesToTicks(dedupWindow);
+}
+
+void
+Multi::recordIssue(int pf, const PacketPtr &pkt)
+{
+    prefetchStats.pfIssued++;
+    issuedPrefetches++;
+    multiStats.issued[pf]++;
+
+    if (bandwidthBudget && ++windowIssued == bandwidthBudget) {
+        multiStats.budgetExhausted++;
+    }
+
+    recentIssued[pf]++;
+    if (accuracyEpoch && ++epochIssued >= accuracyEpoch) {
+        for (int i = 0; i < prefetchers.size(); i++) {
+            recentIssued[i] /= 2;
+            recentUseful[i] /= 2;
+        }
+        epochIssued = 0;
+    }
+
+    if (!issuedBy.empty()) {
+        const Addr block = blockAddress(pkt->getAddr());
+        issuedEntry(block) = {block, pkt->isSecure(), pf, curTick()};
+    }
+}
+
+void
+Multi::notifyPfHitInMSHR(const PacketPtr &pkt)
+{
+    const int pf = resolve(pkt->getAddr(), pkt->isSecure());
+    if (pf >= 0) {
+        prefetchers[pf]->notifyPfHitInMSHR(pkt);
+    }
+}
+
+void
+Multi::notifyPrefetchUnused(Addr addr, bool is_secure)
+{
+    const int pf = resolve(addr, is_secure);
+    if (pf >= 0) {
+        prefetchers[pf]->notifyPrefetchUnused(addr, is_secure);
+    }
+}
+
+void
+Multi::notifyPrefetchUseful(Addr addr, bool is_secure)
+{
+    const int pf = resolve(addr, is_secure);
+    if (pf >= 0) {
+        multiStats.useful[pf]++;
+        recentUseful[pf]++;
+    }
+}
+
+void
+Multi::notifyPrefetchDropped(const PacketPtr &pkt)
+{
+    Base::notifyPrefetchDropped(pkt);
+    const int pf = resolve(pkt->getAddr(), pkt->isSecure());
+    if (pf < 0) {
+        return;
+    }
+    // Nor may it hold back other prefetches to its block
+    issuedEntry(blockAddress(pkt->getAddr())).block = MaxAddr;
+    multiStats.issued[pf]--;
+    recentIssued[pf] = std::max(recentIssued[pf] - 1, 0.0);
+    if (windowIssued > 0) {
+        windowIssued--;
+    }
+    prefetchers[pf]->notifyPrefetchDropped(pkt);
+}
+
 Tick
 Multi::nextPrefetchReadyTime() const
 {
@@ -67,27 +225,62 @@ Multi::nextPrefetchReadyTime() const
     for (auto pf : prefetchers)
         next_ready = std::min(next_ready, pf->nextPrefetchReadyTime());
 
+    if (next_ready != MaxTick && budgetUsed()) {
+        next_ready = std::max(next_ready,
+                              windowStart + cyclesToTicks(budgetWindow));
+    }
+
     return next_ready;
 }
 
 PacketPtr
 Multi::getPacket()
 {
+    if (bandwidthBudget &&
+        curTick() >= windowStart + cyclesToTicks(budgetWindow)) {
+        windowStart = curTick();
+        windowIssued = 0;
+    }
+    if (budgetUsed()) {
+        return nullptr;
+    }
+
     lastChosenPf = (lastChosenPf + 1) % prefetchers.size();
-    uint8_t pf_turn = lastChosenPf;
-
-    for (int pf = 0 ;  pf < prefetchers.size(); pf++) {
-        if (prefetchers[pf_turn]->nextPrefetchReadyTime() <= curTick()) {
-            PacketPtr pkt = prefetchers[pf_turn]->getPacket();
-            panic_if(!pkt, "Prefetcher is ready but didn't return a packet.");
-            prefetchStats.pfIssued++;
-            issuedPrefetches++;
-            return pkt;
+
+    while (true) {
+        // Round-robin over the ready sub-prefetchers, or take the most
+        // accurate one, the earliest in round-robin order on ties
+        int chosen = -1;
+        uint8_t pf_turn = lastChosenPf;
+        for (int pf = 0 ;  pf < prefetchers.size(); pf++) {
+            if (prefetchers[pf_turn]->nextPrefetchReadyTime() <= curTick() &&
+                (chosen < 0 || accuracy(pf_turn) > accuracy(chosen))) {
+                chosen = pf_turn;
+                if (!rankByAccuracy) {
+                    break;
+                }
+            }
+            pf_turn = (pf_turn + 1) % prefetchers.size();
+        }
+        if (chosen < 0) {
+            return nullptr;
         }
-        pf_turn = (pf_turn + 1) % prefetchers.size();
-    }
 
-    return nullptr;
+        PacketPtr pkt = prefetchers[chosen]->getPacket();
+        panic_if(!pkt, "Prefetcher is ready but didn't return a packet.");
+        if (isDuplicate(pkt)) {
+            DPRINTF(HWPrefetch, "Dropping prefetch for %#x, already issued "
+                    "by another sub-prefetcher.\n", pkt->getAddr());
+            multiStats.pfDuplicate++;
+            // It never leaves the cache, so it must not count against the
+            // sub-prefetcher's accuracy
+            prefetchers[chosen]->notifyPrefetchDropped(pkt);
+            delete pkt;
+            continue;
+        }
+        recordIssue(chosen, pkt);
+        return pkt;
+    }
 }
 
 } // namespace prefetch
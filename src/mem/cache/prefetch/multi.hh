@@ -40,6 +40,7 @@
 
 #include <vector>
 
+#include "base/statistics.hh"
 #include "mem/cache/prefetch/base.hh"
 
 namespace gem5
@@ -69,10 +70,103 @@ class Multi : public Base
     void notifyFill(const PacketPtr &pkt) override {};
     /** @} */
 
+    /** @{ */
+    /**
+     * Credit the sub-prefetcher that issued a prefetch with its outcome,
+     * and pass the outcome on to it.
+     */
+    void notifyPfHitInMSHR(const PacketPtr &pkt) override;
+    void notifyPrefetchUnused(Addr addr, bool is_secure) override;
+    void notifyPrefetchUseful(Addr addr, bool is_secure) override;
+    /** @} */
+
+    /**
+     * Take back a prefetch a parent dropped, from this prefetcher's counts
+     * and from the sub-prefetcher that issued it.
+     */
+    void notifyPrefetchDropped(const PacketPtr &pkt) override;
+
   protected:
     /** List of sub-prefetchers ordered by priority. */
     std::vector<Base*> prefetchers;
     uint8_t lastChosenPf;
+
+    /** A prefetch issued by a sub-prefetcher */
+    struct IssuedPrefetch
+    {
+        Addr block;
+        bool secure;
+        /** Sub-prefetcher that issued it, -1 once its outcome is known */
+        int prefetcher;
+        Tick issued;
+    };
+    /** Recently issued prefetches, direct-mapped by block */
+    std::vector<IssuedPrefetch> issuedBy;
+
+    /**
+     * Drop prefetches to blocks another prefetch was issued for this
+     * recently, 0 to issue duplicates
+     */
+    const Cycles dedupWindow;
+
+    /** Issue from the most accurate ready sub-prefetcher first */
+    const bool rankByAccuracy;
+
+    /**
+     * Prefetches issued by all sub-prefetchers after which their
+     * usefulness counts are halved, so that accuracy follows recent
+     * behaviour
+     */
+    const unsigned accuracyEpoch;
+
+    /** Recent prefetches issued and found useful, per sub-prefetcher */
+    std::vector<double> recentIssued;
+    std::vector<double> recentUseful;
+    /** Prefetches issued since the counts were last halved */
+    unsigned epochIssued;
+
+    /** Most prefetches issued per budget window, 0 for no limit */
+    const unsigned bandwidthBudget;
+    const Cycles budgetWindow;
+    /** Start of the current budget window, and prefetches issued in it */
+    Tick windowStart;
+    unsigned windowIssued;
+
+    struct MultiStats : public statistics::Group
+    {
+        MultiStats(Multi *parent);
+        /** Prefetches dropped as another was recently issued for them */
+        statistics::Scalar pfDuplicate;
+        /** Budget windows in which the budget ran out */
+        statistics::Scalar budgetExhausted;
+        statistics::Vector issued;
+        statistics::Vector useful;
+        statistics::Formula accuracy;
+    } multiStats;
+
+    /** @return The recent accuracy of a sub-prefetcher */
+    double accuracy(int pf) const;
+
+    /** @return Whether the budget of the current window is used up */
+    bool budgetUsed() const;
+
+    /** @return The issue record a block maps to */
+    IssuedPrefetch &issuedEntry(Addr block);
+
+    /**
+     * @return The sub-prefetcher that issued a prefetch to addr and whose
+     * outcome is not known yet, or -1. The prefetch is marked as known.
+     */
+    int resolve(Addr addr, bool is_secure);
+
+    /**
+     * @return Whether a prefetch was issued for the block of pkt within
+     * the dedup window
+     */
+    bool isDuplicate(const PacketPtr &pkt);
+
+    /** Account for a prefetch issued by a sub-prefetcher */
+    void recordIssue(int pf, const PacketPtr &pkt);
 };
 
 } // namespace prefetch
@@ -37,6 +37,7 @@
 
 #include "mem/cache/prefetch/queued.hh"
 
+#include <algorithm>
 #include <cassert>
 
 #include "arch/generic/tlb.hh"
@@ -45,6 +46,7 @@
 #include "debug/HWPrefetch.hh"
 #include "debug/HWPrefetchQueue.hh"
 #include "mem/cache/base.hh"
+#include "mem/cache/prefetch_confidence.hh"
 #include "mem/request.hh"
 #include "params/QueuedPrefetcher.hh"
 
@@ -54,11 +56,11 @@ namespace gem5
 namespace prefetch
 {
 
-void
-Queued::DeferredPacket::createPkt(Addr paddr, unsigned blk_size,
-                                            RequestorID requestor_id,
-                                            bool tag_prefetch,
-                                            Tick t) {
+PacketPtr
+Queued::DeferredPacket::createPkt(unsigned blk_size,
+                                  RequestorID requestor_id,
+                                  bool tag_prefetch) const
+{
     /* Create a prefetch memory request */
     RequestPtr req = std::make_shared<Request>(paddr, blk_size,
                                                 0, requestor_id);
@@ -67,13 +69,16 @@ Queued::DeferredPacket::createPkt(Addr paddr, unsigned blk_size,
         req->setFlags(Request::SECURE);
     }
     req->taskId(context_switch_task_id::Prefetcher);
-    pkt = new Packet(req, MemCmd::HardPFReq);
+    PacketPtr pkt = new Packet(req, MemCmd::HardPFReq);
     pkt->allocate();
     if (tag_prefetch && pfInfo.hasPC()) {
         // Tag prefetch packet with  accessing pc
         pkt->req->setPC(pfInfo.getPC());
     }
-    tick = t;
+    if (!pfInfo.isConfident()) {
+        req->setExtension(std::make_shared<PrefetchConfidence>(false));
+    }
+    return pkt;
 }
 
 void
@@ -98,7 +103,8 @@ Queued::DeferredPacket::finish(const Fault &fault,
 }
 
 Queued::Queued(const QueuedPrefetcherParams &p)
-    : Base(p), queueSize(p.queue_size),
+    : Base(p), pfq(p.queue_size), pfqMissingTranslation(p.queue_size),
+      queueSize(p.queue_size),
       missingTranslationQueueSize(
         p.max_prefetch_requests_with_pending_translation),
       latency(p.latency), queueSquash(p.queue_squash),
@@ -110,14 +116,10 @@ Queued::Queued(const QueuedPrefetcherParams &p)
 
 Queued::~Queued()
 {
-    // Delete the queued prefetch packets
-    for (DeferredPacket &p : pfq) {
-        delete p.pkt;
-    }
 }
 
 void
-Queued::printQueue(const std::list<DeferredPacket> &queue) const
+Queued::printQueue(const DeferredQueue &queue) const
 {
     int pos = 0;
     std::string queue_name = "";
@@ -128,11 +130,11 @@ Queued::printQueue(const std::list<DeferredPacket> &queue) const
         queue_name = "PFTransQ";
     }
 
-    for (const_iterator it = queue.cbegin(); it != queue.cend();
+    for (const_iterator it = queue.begin(); it != queue.end();
                                                             it++, pos++) {
         Addr vaddr = it->pfInfo.getAddr();
-        /* Set paddr to 0 if not yet translated */
-        Addr paddr = it->pkt ? it->pkt->getAddr() : 0;
+        /* paddr is 0 if not yet translated */
+        Addr paddr = it->paddr;
         DPRINTF(HWPrefetchQueue, "%s[%d]: Prefetch Req VA: %#x PA: %#x "
                 "prio: %3d\n", queue_name, pos, vaddr, paddr, it->priority);
     }
@@ -176,20 +178,14 @@ Queued::notify(const PacketPtr &pkt, const PrefetchInfo &pfi)
 
     // Squash queued prefetches if demand miss to same line
     if (queueSquash) {
-        auto itr = pfq.begin();
-        while (itr != pfq.end()) {
-            if (itr->pfInfo.getAddr() == blk_addr &&
-                itr->pfInfo.isSecure() == is_secure) {
-                DPRINTF(HWPrefetch, "Removing pf candidate addr: %#x "
-                        "(cl: %#x), demand request going to the same addr\n",
-                        itr->pfInfo.getAddr(),
-                        blockAddress(itr->pfInfo.getAddr()));
-                delete itr->pkt;
-                itr = pfq.erase(itr);
-                statsQueued.pfRemovedDemand++;
-            } else {
-                ++itr;
-            }
+        for (auto itr = pfq.find(blk_addr, is_secure); itr != pfq.end();
+             itr = pfq.find(blk_addr, is_secure)) {
+            DPRINTF(HWPrefetch, "Removing pf candidate addr: %#x "
+                    "(cl: %#x), demand request going to the same addr\n",
+                    itr->pfInfo.getAddr(),
+                    blockAddress(itr->pfInfo.getAddr()));
+            pfq.erase(itr);
+            statsQueued.pfRemovedDemand++;
         }
     }
 
@@ -218,6 +214,7 @@ Queued::notify(const PacketPtr &pkt, const PrefetchInfo &pfi)
         bool can_cross_page = (mmu != nullptr) || crossPages;
         if (can_cross_page || samePage(addr_prio.first, pfi.getAddr())) {
             PrefetchInfo new_pfi(pfi,addr_prio.first);
+            new_pfi.setConfident(addr_prio.confident);
             statsQueued.pfIdentified++;
             DPRINTF(HWPrefetch, "Found a pf candidate addr: %#x, "
                     "inserting into prefetch queue.\n", new_pfi.getAddr());
@@ -249,8 +246,8 @@ Queued::getPacket()
         return nullptr;
     }
 
-    PacketPtr pkt = pfq.front().pkt;
-    pfq.pop_front();
+    PacketPtr pkt = pfq.front().createPkt(blkSize, requestorId, tagPrefetch);
+    pfq.erase(pfq.begin());
 
     prefetchStats.pfIssued++;
     issuedPrefetches += 1;
@@ -277,7 +274,13 @@ Queued::QueuedStats::QueuedStats(statistics::Group *parent)
     ADD_STAT(pfSpanPage, statistics::units::Count::get(),
              "number of prefetches that crossed the page"),
     ADD_STAT(pfUsefulSpanPage, statistics::units::Count::get(),
-             "number of prefetches that is useful and crossed the page")
+             "number of prefetches that is useful and crossed the page"),
+    ADD_STAT(pfTranslationFailed, statistics::units::Count::get(),
+             "number of page crossing prefetches dropped due to a failed "
+             "translation"),
+    ADD_STAT(pfUntranslatable, statistics::units::Count::get(),
+             "number of page crossing prefetches dropped as they could "
+             "not be sent for translation")
 {
 }
 
@@ -300,14 +303,17 @@ Queued::processMissingTranslations(unsigned max)
 void
 Queued::translationComplete(DeferredPacket *dp, bool failed)
 {
-    auto it = pfqMissingTranslation.begin();
-    while (it != pfqMissingTranslation.end()) {
-        if (&(*it) == dp) {
-            break;
-        }
-        it++;
+    auto it = pfqMissingTranslation.find(dp);
+    if (it == pfqMissingTranslation.end()) {
+        // The prefetch was evicted from the full queue while it was being
+        // translated, so there is nothing left to queue
+        [[maybe_unused]] const bool evicted =
+            pfqMissingTranslation.release(dp);
+        assert(evicted);
+        DPRINTF(HWPrefetch, "Dropping translation of evicted prefetch "
+                "addr:%#x\n", dp->pfInfo.getAddr());
+        return;
     }
-    assert(it != pfqMissingTranslation.end());
     if (!failed) {
         DPRINTF(HWPrefetch, "%s Translation of vaddr %#x succeeded: "
                 "paddr %#x \n", mmu->name(),
@@ -322,11 +328,11 @@ Queued::translationComplete(DeferredPacket *dp, bool failed)
                     "cache/MSHR prefetch addr:%#x\n", target_paddr);
         } else {
             Tick pf_time = curTick() + clockPeriod() * latency;
-            it->createPkt(target_paddr, blkSize, requestorId, tagPrefetch,
-                          pf_time);
+            it->setTarget(target_paddr, pf_time);
             addToQueue(pfq, *it);
         }
     } else {
+        statsQueued.pfTranslationFailed++;
         DPRINTF(HWPrefetch, "%s Translation of vaddr %#x failed, dropping "
                 "prefetch request %#x \n", mmu->name(),
                 it->translationRequest->getVaddr());
@@ -335,30 +341,17 @@ Queued::translationComplete(DeferredPacket *dp, bool failed)
 }
 
 bool
-Queued::alreadyInQueue(std::list<DeferredPacket> &queue,
+Queued::alreadyInQueue(DeferredQueue &queue,
                                  const PrefetchInfo &pfi, int32_t priority)
 {
-    bool found = false;
-    iterator it;
-    for (it = queue.begin(); it != queue.end() && !found; it++) {
-        found = it->pfInfo.sameAddr(pfi);
-    }
+    iterator it = queue.find(pfi.getAddr(), pfi.isSecure());
 
     /* If the address is already in the queue, update priority and leave */
     if (it != queue.end()) {
         statsQueued.pfBufferHit++;
         if (it->priority < priority) {
             /* Update priority value and position in the queue */
-            it->priority = priority;
-            iterator prev = it;
-            while (prev != queue.begin()) {
-                prev--;
-                /* If the packet has higher priority, swap */
-                if (*it > *prev) {
-                    std::swap(*it, *prev);
-                    it = prev;
-                }
-            }
+            queue.setPriority(it, priority);
             DPRINTF(HWPrefetch, "Prefetch addr already in "
                 "prefetch queue, priority updated\n");
         } else {
@@ -366,7 +359,7 @@ Queued::alreadyInQueue(std::list<DeferredPacket> &queue,
                 "prefetch queue\n");
         }
     }
-    return found;
+    return it != queue.end();
 }
 
 RequestPtr
@@ -414,7 +407,10 @@ Queued::insert(const PacketPtr &pkt, PrefetchInfo &new_pfi,
     Addr target_paddr;
     bool has_target_pa = false;
     RequestPtr translation_req = nullptr;
-    if (samePage(orig_addr, new_pfi.getAddr()) || crossPages) {
+    // Adding a virtual stride to the physical address only holds within
+    // a page, so page crossing virtual prefetches are always translated
+    if (samePage(orig_addr, new_pfi.getAddr()) ||
+        (crossPages && !useVirtualAddresses)) {
         if (useVirtualAddresses) {
             // if we trained with virtual addresses,
             // compute the target PA using the original PA and adding the
@@ -428,8 +424,9 @@ Queued::insert(const PacketPtr &pkt, PrefetchInfo &new_pfi,
     } else {
         // Page crossing reference
 
-        // ContextID is needed for translation
-        if (!pkt->req->hasContextId()) {
+        // ContextID and an MMU are needed for translation
+        if (!pkt->req->hasContextId() || mmu == nullptr) {
+            statsQueued.pfUntranslatable++;
             return;
         }
         if (useVirtualAddresses) {
@@ -447,10 +444,28 @@ Queued::insert(const PacketPtr &pkt, PrefetchInfo &new_pfi,
         } else {
             // Using PA for training but the request does not have a VA,
             // unable to process this page crossing prefetch.
+            statsQueued.pfUntranslatable++;
             return;
         }
     }
-    if (has_target_pa && cacheSnoop &&
+    if (has_target_pa) {
+        insertPhysical(target_paddr, new_pfi, priority);
+    } else {
+        // Add the translation request and try to resolve it later
+        DeferredPacket dpp(this, new_pfi, 0, priority);
+        dpp.setTranslationRequest(translation_req);
+        dpp.tc = cache->system->threads[translation_req->contextId()];
+        DPRINTF(HWPrefetch, "Prefetch queued with no translation. "
+                "addr:%#x priority: %3d\n", new_pfi.getAddr(), priority);
+        addToQueue(pfqMissingTranslation, dpp);
+    }
+}
+
+void
+Queued::insertPhysical(Addr target_paddr, PrefetchInfo &new_pfi,
+                       int32_t priority)
+{
+    if (cacheSnoop &&
             (inCache(target_paddr, new_pfi.isSecure()) ||
             inMissQueue(target_paddr, new_pfi.isSecure()))) {
         statsQueued.pfInCache++;
@@ -461,69 +476,51 @@ Queued::insert(const PacketPtr &pkt, PrefetchInfo &new_pfi,
 
     /* Create the packet and find the spot to insert it */
     DeferredPacket dpp(this, new_pfi, 0, priority);
-    if (has_target_pa) {
-        Tick pf_time = curTick() + clockPeriod() * priority;
-        dpp.createPkt(target_paddr, blkSize, requestorId, tagPrefetch,
-                      pf_time);
-        DPRINTF(HWPrefetch, "Prefetch queued. "
-                "addr:%#x priority: %3d tick:%lld.\n",
-                new_pfi.getAddr(), priority, pf_time);
-        addToQueue(pfq, dpp);
-    } else {
-        // Add the translation request and try to resolve it later
-        dpp.setTranslationRequest(translation_req);
-        dpp.tc = cache->system->threads[translation_req->contextId()];
-        DPRINTF(HWPrefetch, "Prefetch queued with no translation. "
-                "addr:%#x priority: %3d\n", new_pfi.getAddr(), priority);
-        addToQueue(pfqMissingTranslation, dpp);
+    Tick pf_time = curTick() + clockPeriod() * priority;
+    dpp.setTarget(target_paddr, pf_time);
+    DPRINTF(HWPrefetch, "Prefetch queued. "
+            "addr:%#x priority: %3d tick:%lld.\n",
+            new_pfi.getAddr(), priority, pf_time);
+    addToQueue(pfq, dpp);
+}
+
+void
+Queued::insertDeferred(PrefetchInfo &new_pfi, int32_t priority)
+{
+    panic_if(useVirtualAddresses,
+             "Deferred prefetches need physical addresses\n");
+    statsQueued.pfIdentified++;
+    if (queueFilter && (alreadyInQueue(pfq, new_pfi, priority) ||
+            alreadyInQueue(pfqMissingTranslation, new_pfi, priority))) {
+        return;
+    }
+    insertPhysical(blockAddress(new_pfi.getAddr()), new_pfi, priority);
+
+    // No access is in flight to pick the new prefetch up, so wake the
+    // cache ourselves
+    if (!pfq.empty()) {
+        cache->schedMemSideSendEvent(
+            std::max(nextPrefetchReadyTime(), cache->clockEdge()));
     }
 }
 
 void
-Queued::addToQueue(std::list<DeferredPacket> &queue,
+Queued::addToQueue(DeferredQueue &queue,
                              DeferredPacket &dpp)
 {
     /* Verify prefetch buffer space for request */
     if (queue.size() == queueSize) {
         statsQueued.pfRemovedFull++;
-        /* Lowest priority packet */
-        iterator it = queue.end();
-        panic_if (it == queue.begin(),
-            "Prefetch queue is both full and empty!");
-        --it;
-        /* Look for oldest in that level of priority */
-        panic_if (it == queue.begin(),
+        panic_if (queue.size() == 1,
             "Prefetch queue is full with 1 element!");
-        iterator prev = it;
-        bool cont = true;
-        /* While not at the head of the queue */
-        while (cont && prev != queue.begin()) {
-            prev--;
-            /* While at the same level of priority */
-            cont = prev->priority == it->priority;
-            if (cont)
-                /* update pointer */
-                it = prev;
-        }
+        /* Oldest packet of the lowest priority */
+        iterator it = queue.lowestPriority();
         DPRINTF(HWPrefetch, "Prefetch queue full, removing lowest priority "
                             "oldest packet, addr: %#x\n",it->pfInfo.getAddr());
-        delete it->pkt;
         queue.erase(it);
     }
 
-    if ((queue.size() == 0) || (dpp <= queue.back())) {
-        queue.emplace_back(dpp);
-    } else {
-        iterator it = queue.end();
-        do {
-            --it;
-        } while (it != queue.begin() && dpp > *it);
-        /* If we reach the head, we have to see if the new element is new head
-         * or not */
-        if (it == queue.begin() && dpp <= *it)
-            it++;
-        queue.insert(it, dpp);
-    }
+    queue.insert(dpp);
 
     if (debug::HWPrefetchQueue)
         printQueue(queue);
@@ -41,11 +41,13 @@
 #include <cstdint>
 #include <list>
 #include <utility>
+#include <vector>
 
 #include "arch/generic/mmu.hh"
 #include "base/statistics.hh"
 #include "base/types.hh"
 #include "mem/cache/prefetch/base.hh"
+#include "mem/cache/prefetch/deferred_queue.hh"
 #include "mem/packet.hh"
 
 namespace gem5
@@ -67,8 +69,8 @@ class Queued : public Base
         PrefetchInfo pfInfo;
         /** Time when this prefetch becomes ready */
         Tick tick;
-        /** The memory packet generated by this prefetch */
-        PacketPtr pkt;
+        /** Physical address to prefetch, 0 until known */
+        Addr paddr;
         /** The priority of this prefetch */
         int32_t priority;
         /** Request used when a translation is needed */
@@ -85,7 +87,7 @@ class Queued : public Base
          * @param prio This prefetch priority
          */
         DeferredPacket(Queued *o, PrefetchInfo const &pfi, Tick t,
-            int32_t prio) : owner(o), pfInfo(pfi), tick(t), pkt(nullptr),
+            int32_t prio) : owner(o), pfInfo(pfi), tick(t), paddr(0),
             priority(prio), translationRequest(), tc(nullptr),
             ongoingTranslation(false) {
         }
@@ -104,17 +106,30 @@ class Queued : public Base
         }
 
         /**
-         * Create the associated memory packet
-         * @param paddr physical address of this packet
+         * Set the physical address to prefetch, once known
+         * @param target_paddr physical address of the prefetch
+         * @param t time when the prefetch becomes ready
+         */
+        void
+        setTarget(Addr target_paddr, Tick t)
+        {
+            paddr = target_paddr;
+            tick = t;
+        }
+
+        /**
+         * Create the memory packet of this prefetch. Packets are only
+         * created as prefetches issue, so dropped prefetches never
+         * allocate one.
          * @param blk_size block size used by the prefetcher
          * @param requestor_id Requestor ID of the access that generated
          * this prefetch
          * @param tag_prefetch flag to indicate if the packet needs to be
          *        tagged
-         * @param t time when the prefetch becomes ready
+         * @return The packet, owned by the caller
          */
-        void createPkt(Addr paddr, unsigned blk_size, RequestorID requestor_id,
-                       bool tag_prefetch, Tick t);
+        PacketPtr createPkt(unsigned blk_size, RequestorID requestor_id,
+                            bool tag_prefetch) const;
 
         /**
          * Sets the translation request needed to obtain the physical address
@@ -139,11 +154,13 @@ class Queued : public Base
         void startTranslation(BaseMMU *mmu);
     };
 
-    std::list<DeferredPacket> pfq;
-    std::list<DeferredPacket> pfqMissingTranslation;
+    using DeferredQueue = prefetch::DeferredQueue<DeferredPacket>;
+
+    DeferredQueue pfq;
+    DeferredQueue pfqMissingTranslation;
 
-    using const_iterator = std::list<DeferredPacket>::const_iterator;
-    using iterator = std::list<DeferredPacket>::iterator;
+    using const_iterator = DeferredQueue::const_iterator;
+    using iterator = DeferredQueue::iterator;
 
     // PARAMETERS
 
@@ -185,9 +202,22 @@ class Queued : public Base
         statistics::Scalar pfRemovedFull;
         statistics::Scalar pfSpanPage;
         statistics::Scalar pfUsefulSpanPage;
+        statistics::Scalar pfTranslationFailed;
+        statistics::Scalar pfUntranslatable;
     } statsQueued;
   public:
-    using AddrPriority = std::pair<Addr, int32_t>;
+    /**
+     * A prefetch candidate and its priority. Candidates the prefetcher is
+     * not confident in are hinted as such to the caches they fill.
+     */
+    struct AddrPriority : public std::pair<Addr, int32_t>
+    {
+        bool confident;
+
+        AddrPriority(Addr addr, int32_t priority, bool confident = true)
+          : std::pair<Addr, int32_t>(addr, priority), confident(confident)
+        {}
+    };
 
     Queued(const QueuedPrefetcherParams &p);
     virtual ~Queued();
@@ -196,6 +226,15 @@ class Queued : public Base
 
     void insert(const PacketPtr &pkt, PrefetchInfo &new_pfi, int32_t priority);
 
+    /**
+     * Queue a prefetch generated after its triggering access has been
+     * handled, e.g. once a metadata read has returned. The prefetch must
+     * target a physical address, as there is no packet to translate with.
+     * @param new_pfi Prefetch to queue.
+     * @param priority Delay, in cycles, before it may issue.
+     */
+    void insertDeferred(PrefetchInfo &new_pfi, int32_t priority);
+
     virtual void calculatePrefetch(const PrefetchInfo &pfi,
                                    std::vector<AddrPriority> &addresses) = 0;
     PacketPtr getPacket() override;
@@ -205,7 +244,7 @@ class Queued : public Base
         return pfq.empty() ? MaxTick : pfq.front().tick;
     }
 
-    void printQueue(const std::list<DeferredPacket> &queue) const;
+    void printQueue(const DeferredQueue &queue) const;
 
   private:
 
@@ -214,7 +253,17 @@ class Queued : public Base
      * @param queue selected queue to use
      * @param dpp DeferredPacket to add
      */
-    void addToQueue(std::list<DeferredPacket> &queue, DeferredPacket &dpp);
+    void addToQueue(DeferredQueue &queue, DeferredPacket &dpp);
+
+    /**
+     * Queue a prefetch to a known physical address, unless it is already
+     * cached or in flight.
+     * @param target_paddr Physical address to prefetch
+     * @param new_pfi Prefetch being queued
+     * @param priority Delay, in cycles, before it may issue
+     */
+    void insertPhysical(Addr target_paddr, PrefetchInfo &new_pfi,
+                        int32_t priority);
 
     /**
      * Starts the translations of the queued prefetches with a
@@ -242,7 +291,7 @@ class Queued : public Base
      * @param priority priority of the prefetch request to be added
      * @return True if the prefetch request was found in the queue
      */
-    bool alreadyInQueue(std::list<DeferredPacket> &queue,
+    bool alreadyInQueue(DeferredQueue &queue,
                         const PrefetchInfo &pfi, int32_t priority);
 
     /**
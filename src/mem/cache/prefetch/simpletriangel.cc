@@ -47,6 +47,7 @@
 
 #include "debug/HWPrefetch.hh"
 #include "mem/cache/prefetch/associative_set_impl.hh"
+#include "mem/cache/prefetch/temporal_checkpoint.hh"
 #include "params/SimpleTriangelPrefetcher.hh"
 #include <cmath>
 
@@ -61,9 +62,10 @@ namespace prefetch
 int SimpleTriangel::target_size=0;
 int SimpleTriangel::current_size=0;
 int64_t SimpleTriangel::global_timestamp=0;
-AssociativeSet<SimpleTriangel::MarkovMapping>* SimpleTriangel::markovTablePtr=NULL;
+SimpleTriangel::MarkovTable* SimpleTriangel::markovTablePtr=NULL;
 std::vector<uint32_t> SimpleTriangel::setPrefetch(17,0);
-SimpleTriangel::SizeDuel* SimpleTriangel::sizeDuelPtr=nullptr;
+SizeDuel* SimpleTriangel::sizeDuelPtr=nullptr;
+LLCWayPartition* SimpleTriangel::llcWaysPtr=nullptr;
 
 SimpleTriangel::SimpleTriangel(
     const SimpleTriangelPrefetcherParams &p)
@@ -98,7 +100,8 @@ SimpleTriangel::SimpleTriangel(
                           p.address_map_rounded_entries,
                           p.address_map_cache_indexing_policy,
                           p.address_map_cache_replacement_policy,
-                          MarkovMapping()),                   
+                          MarkovMapping()),
+    llcWays(cachetags, maxWays),
     metadataReuseBuffer(p.metadata_reuse_assoc,
                           p.metadata_reuse_entries,
                           p.metadata_reuse_indexing_policy,
@@ -106,7 +109,10 @@ SimpleTriangel::SimpleTriangel(
                           MarkovMapping()),
     lastAccessFromPFCache(false)
 {	
+	fatal_if(!dynamic_cast<SimpleTriangelHashedSetAssociative*>(markovTable.indexingPolicy),
+		"%s: the Markov table must use SimpleTriangelHashedSetAssociative indexing\n", name());
 	markovTablePtr = &markovTable;
+	llcWaysPtr = &llcWays;
 
 	setPrefetch.resize(cachetags->getWayAllocationMax()+1,0);
 	assert(p.address_map_rounded_entries / p.address_map_rounded_cache_assoc == p.address_map_actual_entries / p.address_map_actual_cache_assoc);
@@ -151,11 +157,7 @@ SimpleTriangel::calculatePrefetch(const PrefetchInfo &pfi,
 	    for(int x=0;x<64;x++) {
 		int res =    	sizeDuelPtr[x].checkAndInsert(addr,false);
 		if(res==0)continue;
-		int cache_hit = res%128; //Because we encode cache hits as the first 7 bits of this result here.
-		int cache_set = cache_hit-1;
-		assert(!cache_hit || (cache_set<setPrefetch.size()-1 && cache_set>=0));
-		if(cache_hit) for(int y= setPrefetch.size()-2-cache_set; y>=0; y--) setPrefetch[y]++; 
-		// cache partition hit at this size or bigger. So hit in way 14 = y=17-2-14=1 and 0: would hit with 0 ways reserved or 1, not 2.
+		creditDuel(setPrefetch, res, 0);
 
 	    }
         return;
@@ -190,7 +192,7 @@ SimpleTriangel::calculatePrefetch(const PrefetchInfo &pfi,
 	if(entry->highPatternConfidence >= superHistory) entry->currently_twodist_pf=true;
 	if(entry->patternConfidence < upperHistory) entry->currently_twodist_pf=false; 
         //if very sure, index should be lastLastAddress. TODO: We could also try to learn timeliness here, by tracking PCs at the MSHRs.
-        if(entry->currently_twodist_pf && should_lookahead) index = entry->lastLastAddress;
+        if(entry->currently_twodist_pf && should_lookahead) index = entry->addressAt(2);
         target = addr;
         should_pf = (entry->reuseConfidence > upperReuse) && (entry->patternConfidence > upperHistory); //8 is the reset point.
 
@@ -322,16 +324,7 @@ SimpleTriangel::calculatePrefetch(const PrefetchInfo &pfi,
 		if(res==0)continue;
 		const int ratioNumer=2;
 		const int ratioDenom=4;//should_pf && entry->highHistoryConfidence >=upperHistory? 4 : 8;
-		int cache_hit = res%128; //This is just bit encoding of cache hits.
-		int pref_hit = res/128; //This is just bit encoding of prefetch hits.
-		int cache_set = cache_hit-1; //Encodes which nth most used replacement-state we hit at, if any.
-		int pref_set = pref_hit-1; //Encodes which nth most used replacement-state we hit at, if any.
-		assert(!cache_hit || (cache_set<setPrefetch.size()-1 && cache_set>=0));
-		assert(!pref_hit || (pref_set<setPrefetch.size()-1 && pref_set>=0));
-		if(cache_hit) for(int y= setPrefetch.size()-2-cache_set; y>=0; y--) setPrefetch[y]++; 
-		// cache partition hit at this size or bigger. So hit in way 14 = y=17-2-14=1 and 0: would hit with 0 ways reserved or 1, not 2.
-		if(pref_hit)for(int y=pref_set+1;y<setPrefetch.size();y++) setPrefetch[y]+=(ratioNumer*sizeDuelPtr[x].temporalModMax)/ratioDenom; 
-		// ^ pf hit at this size or bigger. one-indexed (since 0 is an alloc on 0 ways). So hit in way 0 = y=1--16 ways reserved, not 0.
+		creditDuel(setPrefetch, res, (ratioNumer*sizeDuelPtr[x].temporalModMax)/ratioDenom);
 		
 	    }
 	    
@@ -367,9 +360,8 @@ SimpleTriangel::calculatePrefetch(const PrefetchInfo &pfi,
 				    		am.invalidate(); //for RRIP's sake
 				    	}
 			    	}
-			    	SimpleTriangelHashedSetAssociative* thsa = dynamic_cast<SimpleTriangelHashedSetAssociative*>(markovTablePtr->indexingPolicy);
-		  				if(thsa) { thsa->ways = current_size/size_increment; thsa->max_ways = maxWays; assert(thsa->ways <= thsa->max_ways);}
-		  				else assert(0);
+			    	SimpleTriangelHashedSetAssociative* thsa = static_cast<SimpleTriangelHashedSetAssociative*>(markovTablePtr->indexingPolicy);
+		  				thsa->ways = current_size/size_increment; thsa->max_ways = maxWays; assert(thsa->ways <= thsa->max_ways);
 			    	//rearrange conditionally
 				if(should_rearrange) {        	
 				    	if(current_size >0) {
@@ -386,7 +378,7 @@ SimpleTriangel::calculatePrefetch(const PrefetchInfo &pfi,
 			    	for(MarkovMapping& am: *markovTablePtr) {
 				    if(thsa->ways==0 || (thsa->extractSet(am.index) % maxWays)>=thsa->ways)  am.invalidate();
 				}
-			    	cachetags->setWayAllocationMax(setPrefetch.size()-1-thsa->ways);  	
+			    	llcWaysPtr->reserve(thsa->ways);
 	    } 
 
 	    	global_timestamp=0;
@@ -459,10 +451,7 @@ SimpleTriangel::calculatePrefetch(const PrefetchInfo &pfi,
 
         // Update the entry
     if(entry != nullptr) {
-    	entry->lastLastAddress = entry->lastAddress;
-    	entry->lastLastAddressSecure = entry->lastAddressSecure;
-    	entry->lastAddress = addr;
-    	entry->lastAddressSecure = is_secure;
+    	entry->pushAddress(addr, is_secure);
     	entry->local_timestamp ++;
     }
 
@@ -473,10 +462,9 @@ SimpleTriangel::MarkovMapping*
 SimpleTriangel::getHistoryEntry(Addr paddr, bool is_secure, bool add, bool readonly, bool clearing, bool hawk)
 {
 	//The weird parameters above control whether we replace entries, and how the number of metadata accesses are updated, for instance. They're basically a simulation thing.
-  	    SimpleTriangelHashedSetAssociative* thsa = dynamic_cast<SimpleTriangelHashedSetAssociative*>(markovTablePtr->indexingPolicy);
-	  				if(!thsa)  assert(0);  
+  	    SimpleTriangelHashedSetAssociative* thsa = static_cast<SimpleTriangelHashedSetAssociative*>(markovTablePtr->indexingPolicy);
 
-    	cachetags->clearSetWay(thsa->extractSet(paddr)/maxWays, thsa->extractSet(paddr)%maxWays); 
+    	llcWaysPtr->claim(thsa->extractSet(paddr));
 
 
     if(should_rearrange) {    
@@ -526,44 +514,138 @@ SimpleTriangel::getHistoryEntry(Addr paddr, bool is_secure, bool add, bool reado
     return ps_entry;
 }
 
-
-
-
-uint32_t
-SimpleTriangelHashedSetAssociative::extractSet(const Addr addr) const
+void
+SimpleTriangel::serialize(CheckpointOut &cp) const
 {
-	//Input is already blockIndex so no need to remove block again.
-    Addr offset = addr;
-    
-        offset = ((offset) * max_ways) + (extractTag(addr) % ways);
-        return offset & setMask;   //setMask is numSets-1
-
+	const bool owner = markovTablePtr == &markovTable;
+	std::vector<uint64_t> geometry = {owner, trainingUnit.entries.size(),
+		historySampler.entries.size(), secondChanceUnit.entries.size(),
+		markovTable.entries.size(), setPrefetch.size()};
+	SERIALIZE_CONTAINER(geometry);
+
+	SERIALIZE_SCALAR(second_chance_timestamp);
+	SERIALIZE_CONTAINER(way_idx);
+	paramOut(cp, "globalReuseConfidence", (unsigned)globalReuseConfidence);
+	paramOut(cp, "globalPatternConfidence", (unsigned)globalPatternConfidence);
+	paramOut(cp, "globalHighPatternConfidence",
+		(unsigned)globalHighPatternConfidence);
+
+	serializeSet(cp, "trainingUnit", trainingUnit,
+		[](const TrainingUnitEntry &e, std::vector<uint64_t> &out) {
+			e.packHistory(out);
+			out.insert(out.end(), {(uint64_t)e.local_timestamp,
+				e.reuseConfidence, e.patternConfidence,
+				e.highPatternConfidence, e.replaceRate, e.hawkConfidence,
+				e.lastAddressSecure, e.currently_twodist_pf});
+		});
+	//Samples point at their training entry, saved by its position.
+	const TrainingUnitEntry *first_entry = trainingUnit.entries.data();
+	serializeSet(cp, "historySampler", historySampler,
+		[first_entry](const SampleEntry &e, std::vector<uint64_t> &out) {
+			out.insert(out.end(), {e.entry ? (uint64_t)(e.entry - first_entry) : MaxAddr,
+				e.reused, e.local_timestamp, e.next, e.confident});
+		});
+	serializeSet(cp, "secondChanceUnit", secondChanceUnit,
+		[](const SecondChanceEntry &e, std::vector<uint64_t> &out) {
+			out.insert(out.end(), {e.pc, e.global_timestamp, e.used});
+		});
+	auto pack_mapping = [](const MarkovMapping &am, std::vector<uint64_t> &out) {
+		out.insert(out.end(), {am.index, am.address, am.confident, am.cycle_issued});
+	};
+	serializeSet(cp, "metadataReuseBuffer", metadataReuseBuffer, pack_mapping);
+
+	if(!owner) return;
+	SERIALIZE_SCALAR(global_timestamp);
+	SERIALIZE_SCALAR(current_size);
+	SERIALIZE_SCALAR(target_size);
+	SERIALIZE_CONTAINER(setPrefetch);
+	const SimpleTriangelHashedSetAssociative* thsa = static_cast<SimpleTriangelHashedSetAssociative*>(markovTable.indexingPolicy);
+	int ways = thsa->ways;
+	SERIALIZE_SCALAR(ways);
+	std::vector<uint64_t> duels;
+	for(int x=0;x<64;x++) sizeDuels[x].pack(duels);
+	SERIALIZE_CONTAINER(duels);
+	serializeSet(cp, "markov", markovTable, pack_mapping);
 }
 
-
-Addr
-SimpleTriangelHashedSetAssociative::extractTag(const Addr addr) const
+void
+SimpleTriangel::unserialize(CheckpointIn &cp)
 {
-    //Input is already blockIndex so no need to remove block again.
-
-    //Description in Triage-ISR confuses whether the index is just the 16 least significant bits,
-    //or the weird index above. The tag can't be the remaining bits if we use the literal representation!
-
-
-    Addr offset = addr / (numSets/max_ways); //Remove the index bits first. Not clear how important, but it seemed helpful experimentally.
-    int result = 0;
-    
-    //This is a tag# as described in the Triangel paper.
-    const int shiftwidth=10;
-
-    for(int x=0; x<64; x+=shiftwidth) {
-       result ^= (offset & ((1<<shiftwidth)-1));
-       offset = offset >> shiftwidth;
-    }
-    return result;
+	const bool owner = markovTablePtr == &markovTable;
+	std::vector<uint64_t> geometry = {owner, trainingUnit.entries.size(),
+		historySampler.entries.size(), secondChanceUnit.entries.size(),
+		markovTable.entries.size(), setPrefetch.size()};
+	if(!checkpointGeometryMatches(cp, name(), geometry)) return;
+
+	UNSERIALIZE_SCALAR(second_chance_timestamp);
+	UNSERIALIZE_CONTAINER(way_idx);
+	unsigned conf;
+	paramIn(cp, "globalReuseConfidence", conf);
+	restoreCounter(globalReuseConfidence, conf);
+	paramIn(cp, "globalPatternConfidence", conf);
+	restoreCounter(globalPatternConfidence, conf);
+	paramIn(cp, "globalHighPatternConfidence", conf);
+	restoreCounter(globalHighPatternConfidence, conf);
+
+	unserializeSet(cp, "trainingUnit", trainingUnit,
+		TrainingUnitEntry::historyWords + 8,
+		[](TrainingUnitEntry &e, const uint64_t *in) {
+			in = e.unpackHistory(in);
+			e.local_timestamp = in[0];
+			restoreCounter(e.reuseConfidence, in[1]);
+			restoreCounter(e.patternConfidence, in[2]);
+			restoreCounter(e.highPatternConfidence, in[3]);
+			restoreCounter(e.replaceRate, in[4]);
+			restoreCounter(e.hawkConfidence, in[5]);
+			e.lastAddressSecure = in[6];
+			e.currently_twodist_pf = in[7];
+		});
+	TrainingUnitEntry *first_entry = trainingUnit.entries.data();
+	const uint64_t num_entries = trainingUnit.entries.size();
+	unserializeSet(cp, "historySampler", historySampler, 5,
+		[first_entry, num_entries](SampleEntry &e, const uint64_t *in) {
+			e.entry = in[0] < num_entries ? first_entry + in[0] : nullptr;
+			e.reused = in[1];
+			e.local_timestamp = in[2];
+			e.next = in[3];
+			e.confident = in[4];
+		});
+	unserializeSet(cp, "secondChanceUnit", secondChanceUnit, 3,
+		[](SecondChanceEntry &e, const uint64_t *in) {
+			e.pc = in[0];
+			e.global_timestamp = in[1];
+			e.used = in[2];
+		});
+	auto unpack_mapping = [](MarkovMapping &am, const uint64_t *in) {
+		am.index = in[0];
+		am.address = in[1];
+		am.confident = in[2];
+		am.cycle_issued = Cycles(in[3]);
+	};
+	unserializeSet(cp, "metadataReuseBuffer", metadataReuseBuffer, 4,
+		unpack_mapping);
+
+	if(!owner) return;
+	UNSERIALIZE_SCALAR(global_timestamp);
+	UNSERIALIZE_SCALAR(current_size);
+	UNSERIALIZE_SCALAR(target_size);
+	UNSERIALIZE_CONTAINER(setPrefetch);
+	SimpleTriangelHashedSetAssociative* thsa = static_cast<SimpleTriangelHashedSetAssociative*>(markovTable.indexingPolicy);
+	int ways;
+	UNSERIALIZE_SCALAR(ways);
+	fatal_if(ways < 0 || ways > maxWays, "%s: checkpointed partition of %d ways\n",
+		name(), ways);
+	thsa->ways = ways;
+	thsa->max_ways = maxWays;
+	std::vector<uint64_t> duels;
+	UNSERIALIZE_CONTAINER(duels);
+	const uint64_t duel_words = SizeDuel::packedWords(sizeDuels[0].cacheMaxAssoc);
+	fatal_if(duels.size() < 64 * duel_words,
+		"%s: checkpoint holds too few set duellers\n", name());
+	for(int x=0;x<64;x++) sizeDuels[x].unpack(&duels[x * duel_words]);
+	unserializeSet(cp, "markov", markovTable, 4, unpack_mapping);
+	llcWays.reserve(ways);
 }
 
-
-
 } // namespace prefetch
 } // namespace gem5
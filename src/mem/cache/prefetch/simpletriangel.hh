@@ -3,8 +3,8 @@
  * Describes a history prefetcher.
  */
 
-#ifndef __MEM_CACHE_PREFETCH_TRIANGEL_HH__
-#define __MEM_CACHE_PREFETCH_TRIANGEL_HH__
+#ifndef __MEM_CACHE_PREFETCH_SIMPLETRIANGEL_HH__
+#define __MEM_CACHE_PREFETCH_SIMPLETRIANGEL_HH__
 
 #include <string>
 #include <unordered_map>
@@ -15,6 +15,7 @@
 #include "mem/cache/tags/base.hh"
 #include "mem/cache/prefetch/associative_set.hh"
 #include "mem/cache/prefetch/queued.hh"
+#include "mem/cache/prefetch/temporal.hh"
 #include "mem/cache/replacement_policies/replaceable_entry.hh"
 #include "mem/cache/tags/indexing_policies/set_associative.hh"
 #include "mem/packet.hh"
@@ -36,24 +37,17 @@ namespace prefetch
 {
 
 /**
- * Override the default set associative to apply a specific hash function
- * when extracting a set.
+ * Indexing of the SimpleTriangel Markov table, see
+ * TemporalHashedSetAssociative
  */
-class SimpleTriangelHashedSetAssociative : public SetAssociative
+class SimpleTriangelHashedSetAssociative : public TemporalHashedSetAssociative
 {
   public:
-    uint32_t extractSet(const Addr addr) const override;
-    Addr extractTag(const Addr addr) const override;
-
-  public:
-    int ways;
-    int max_ways;
     SimpleTriangelHashedSetAssociative(
         const SimpleTriangelHashedSetAssociativeParams &p)
-      : SetAssociative(p), ways(0),max_ways(8)
+      : TemporalHashedSetAssociative(p)
     {
     }
-    ~SimpleTriangelHashedSetAssociative() = default;
 };
 
 
@@ -96,31 +90,25 @@ class SimpleTriangel : public Queued
         SatCounter8 globalHighPatternConfidence;    
    
 
-    struct TrainingUnitEntry : public TaggedEntry
+    struct TrainingUnitEntry : public TemporalTrainingEntry<2>
     {
-        Addr lastAddress;
-        Addr lastLastAddress;
         int64_t local_timestamp;
         SatCounter8  reuseConfidence;
         SatCounter8  patternConfidence;
         SatCounter8 highPatternConfidence;
         SatCounter8 replaceRate;
         SatCounter8 hawkConfidence;
-        bool lastAddressSecure;
-        bool lastLastAddressSecure;
         bool currently_twodist_pf;
 
 
 
-        TrainingUnitEntry() : lastAddress(0), lastLastAddress(0), local_timestamp(0),reuseConfidence(4,8), patternConfidence(4,8), highPatternConfidence(4,8), replaceRate(4,8), hawkConfidence(4,8), lastAddressSecure(false), lastLastAddressSecure(false),currently_twodist_pf(false)
+        TrainingUnitEntry() : local_timestamp(0),reuseConfidence(4,8), patternConfidence(4,8), highPatternConfidence(4,8), replaceRate(4,8), hawkConfidence(4,8), currently_twodist_pf(false)
         {}
 
         void
         invalidate() override
         {
-        	TaggedEntry::invalidate();
-                lastAddress = 0;
-                lastLastAddress = 0;
+        	TemporalTrainingEntry<2>::invalidate();
                 //local_timestamp=0; //Don't reset this, to handle replacement and still give contiguity of timestamp
                 reuseConfidence.reset();
                 patternConfidence.reset();
@@ -131,109 +119,13 @@ class SimpleTriangel : public Queued
         }
     };
     /** Map of PCs to Training unit entries */
-    AssociativeSet<TrainingUnitEntry> trainingUnit;
+    AssociativeSet<TrainingUnitEntry, replacement_policy::InlineLRU>
+        trainingUnit;
     
 
    
   static std::vector<uint32_t> setPrefetch; 
  
-public:
-  struct SizeDuel
-  {
-  	int idx;
-  	uint64_t set;
-  	uint64_t setMask;
-  	uint64_t temporalMod; //[0..12] Entries Per Line
-  	
-  	uint64_t temporalModMax; //12 by default
-  	uint64_t cacheMaxAssoc;
-  	
-  	
-  	std::vector<Addr> cacheAddrs; // [0..16] should be set by the nsets of the L3 cache.
-  	std::vector<uint64_t> cacheAddrTick;
-  	std::vector<Addr> temporalAddrs;
-  	std::vector<uint64_t> temporalAddrTick;
-  	std::vector<bool> inserted;
-
-  	SizeDuel()
-        {
-        }
-        void reset(uint64_t mask, uint64_t modMax, uint64_t cacheAssoc) {
-        	setMask=mask;
-        	temporalModMax = modMax;
-        	cacheMaxAssoc=cacheAssoc;
-        	cacheAddrTick.resize(cacheMaxAssoc);
-        	temporalAddrs.resize(cacheMaxAssoc);
-        	cacheAddrs.resize(cacheMaxAssoc);
-        	temporalAddrTick.resize(cacheMaxAssoc);
-        	inserted.resize(cacheMaxAssoc,false);
-        	for(int x=0;x<cacheMaxAssoc;x++) {
-			cacheAddrTick[x]=0;
-			temporalAddrs[x]=0;
-			cacheAddrs[x]=0;
-			temporalAddrTick[x]=0;
-		}
-		set = random_mt.random<uint64_t>(0,setMask);
-		temporalMod = random_mt.random<uint64_t>(0,modMax-1); // N-1, as range is inclusive.	
-        }
-  	
-  	int checkAndInsert(Addr addr, bool should_pf) {
-	  	int ret = 0;
-	  	bool foundInCache=false;
-	  	bool foundInTemp=false;
-	  	if((addr & setMask) != set) return ret;
-  		for(int x=0;x<cacheMaxAssoc;x++) {
-  			if(addr == cacheAddrs[x]) {
-  				foundInCache=true; 
-	  				int index=cacheMaxAssoc-1;
-	  				for(int y=0;y<cacheMaxAssoc;y++) {
-	  					if(cacheAddrTick[x]>cacheAddrTick[y]) index--;
-	  					assert(index>=0);
-	  				}  
-	  				cacheAddrTick[x] = curTick();
-	  				ret += index+1;	
-  			}
-  			if(should_pf && addr == temporalAddrs[x]) {
-  				
-  				
-  				foundInTemp=true;
-  				
-	  				int index=cacheMaxAssoc-1;
-	  				for(int y=0;y<cacheMaxAssoc;y++) {
-	  					if(temporalAddrTick[x]>temporalAddrTick[y]) index--;
-	  					assert(index>=0);
-	  				}  
-
-	  				ret += 128*(index+1);
-	  			
-	  			temporalAddrTick[x] = curTick();
-	  			inserted[x]=true;
-	  		}
-  		}
-  		if(!foundInCache) {
-  			uint64_t oldestTick = (uint64_t)-1;
-  			int idx = -1;
-  			for(int x=0; x<cacheMaxAssoc;x++) {
-  				if(cacheAddrTick[x]<oldestTick) {idx = x; oldestTick = cacheAddrTick[x];}
-  			}
-  			assert(idx>=0);
-  			cacheAddrs[idx]=addr;
-  			cacheAddrTick[idx]=curTick();
-  		}
-  		if(!foundInTemp && should_pf && (((addr / (setMask+1)) % temporalModMax) == temporalMod)) {
-  			uint64_t oldestTick = (uint64_t)-1;
-  			int idx = -1;
-  			for(int x=0; x<cacheMaxAssoc;x++) {
-  				if(temporalAddrTick[x]<oldestTick) {idx = x; oldestTick = temporalAddrTick[x]; }
-			}  			
-assert(idx>=0);
-  			temporalAddrs[idx]=addr;
-  			temporalAddrTick[idx]=curTick();
-  		}  
-  		return ret;		
-  	}
-  
-  };
   SizeDuel sizeDuels[256];
   static SizeDuel* sizeDuelPtr;
 
@@ -298,9 +190,14 @@ assert(idx>=0);
     };
     AssociativeSet<SecondChanceEntry> secondChanceUnit;
 
-    /** History mappings table */
-    AssociativeSet<MarkovMapping> markovTable;
-    static AssociativeSet<MarkovMapping>* markovTablePtr;
+    /** History mappings table, whose RRIP state is kept inline */
+    using MarkovTable =
+        AssociativeSet<MarkovMapping, replacement_policy::InlineBRRIP>;
+    MarkovTable markovTable;
+    static MarkovTable* markovTablePtr;
+    /** LLC ways taken by the Markov table, shared like the table itself */
+    LLCWayPartition llcWays;
+    static LLCWayPartition* llcWaysPtr;
     
 
     AssociativeSet<MarkovMapping> metadataReuseBuffer;
@@ -314,9 +211,16 @@ assert(idx>=0);
 
     void calculatePrefetch(const PrefetchInfo &pfi,
                            std::vector<AddrPriority> &addresses) override;
+
+    /**
+     * The sizing state and Markov table are static, used through the last
+     * instance built; only that instance checkpoints them.
+     */
+    void serialize(CheckpointOut &cp) const override;
+    void unserialize(CheckpointIn &cp) override;
 };
 
 } // namespace prefetch
 } // namespace gem5
 
-#endif // __MEM_CACHE_PREFETCH_TRIANGEL_HH__
+#endif // __MEM_CACHE_PREFETCH_SIMPLETRIANGEL_HH__
@@ -0,0 +1,130 @@
+/**
+ * @file
+ * Sketch estimating how many distinct Markov indexes are live.
+ */
+
+#include "mem/cache/prefetch/sizing_sketch.hh"
+
+#include <algorithm>
+#include <cmath>
+
+#include "base/bitfield.hh"
+#include "base/intmath.hh"
+#include "base/logging.hh"
+
+namespace gem5
+{
+
+GEM5_DEPRECATED_NAMESPACE(Prefetcher, prefetch);
+namespace prefetch
+{
+
+SizingSketch::SizingSketch(uint64_t expected, unsigned sampled_slices,
+                           unsigned lifetime)
+  : sampledSlices(sampled_slices), lifetime(lifetime), occupied(0)
+{
+    fatal_if(sampledSlices < 1 || sampledSlices > sampleSlices,
+             "The sizing sketch must sample between 1 and %d slices\n",
+             sampleSlices);
+    fatal_if(lifetime < 1 || lifetime > 255,
+             "The sizing sketch lifetime must be between 1 and 255\n");
+    // About ten counters per sampled index keeps the false positive rate
+    // near 1%, as the Bloom filter this replaces was sized for
+    const uint64_t sampled =
+        std::max<uint64_t>(1024, expected * sampledSlices / sampleSlices);
+    numBlocks = divCeil(sampled * 10, blockCounters);
+    counters.assign(numBlocks * blockCounters, 0);
+}
+
+uint64_t
+SizingSketch::hash(Addr index)
+{
+    // Finaliser of splitmix64: every output bit depends on every input bit
+    uint64_t h = index + 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+bool
+SizingSketch::insert(Addr index)
+{
+    // The top bits chose the sample, the next ones pick the block and the
+    // low ones the counters within it
+    const uint64_t h = hash(index);
+    uint8_t *block =
+        &counters[(((h >> (6 * countersPerIndex)) & mask(21)) % numBlocks) *
+                  blockCounters];
+    bool fresh = false;
+    for (unsigned i = 0; i < countersPerIndex; i++) {
+        uint8_t &counter = block[(h >> (6 * i)) & (blockCounters - 1)];
+        if (counter == 0) {
+            fresh = true;
+            occupied++;
+        }
+        counter = lifetime;
+    }
+    return fresh;
+}
+
+uint64_t
+SizingSketch::estimate() const
+{
+    // Swamidass and Baldi's estimate of the number of indexes that set a
+    // given fraction of the counters. The counters an index sets are
+    // picked within one block and may coincide, so each index sets a
+    // given counter with the chance its block is picked times the chance
+    // any of its picks lands on the counter.
+    const double m = counters.size();
+    const double fill = std::min(occupied / m, 1.0 - 1.0 / m);
+    const double per_index =
+        -std::expm1(countersPerIndex * std::log1p(-1.0 / blockCounters)) /
+        numBlocks;
+    const double sampled = std::log1p(-fill) / std::log1p(-per_index);
+    return sampled * sampleSlices / sampledSlices;
+}
+
+void
+SizingSketch::decay()
+{
+    for (uint8_t &counter : counters) {
+        if (counter != 0 && --counter == 0) {
+            occupied--;
+        }
+    }
+}
+
+void
+SizingSketch::clear()
+{
+    std::fill(counters.begin(), counters.end(), 0);
+    occupied = 0;
+}
+
+void
+SizingSketch::serializeSection(CheckpointOut &cp,
+                               const std::string &name) const
+{
+    std::vector<uint64_t> words(divCeil(counters.size(), 8), 0);
+    for (size_t i = 0; i < counters.size(); i++) {
+        words[i / 8] |= (uint64_t)counters[i] << (8 * (i % 8));
+    }
+    arrayParamOut(cp, name, words);
+}
+
+void
+SizingSketch::unserializeSection(CheckpointIn &cp, const std::string &name)
+{
+    std::vector<uint64_t> words;
+    arrayParamIn(cp, name, words);
+    fatal_if(words.size() != divCeil(counters.size(), 8),
+             "%s: checkpointed sizing sketch has a different size\n", name);
+    occupied = 0;
+    for (size_t i = 0; i < counters.size(); i++) {
+        counters[i] = words[i / 8] >> (8 * (i % 8));
+        occupied += counters[i] != 0;
+    }
+}
+
+} // namespace prefetch
+} // namespace gem5
@@ -0,0 +1,98 @@
+/**
+ * @file
+ * Sketch estimating how many distinct Markov indexes are live, which
+ * sizes the temporal prefetchers' Markov tables without set duelling.
+ */
+
+#ifndef __MEM_CACHE_PREFETCH_SIZING_SKETCH_HH__
+#define __MEM_CACHE_PREFETCH_SIZING_SKETCH_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "base/compiler.hh"
+#include "base/types.hh"
+#include "sim/serialize.hh"
+
+namespace gem5
+{
+
+GEM5_DEPRECATED_NAMESPACE(Prefetcher, prefetch);
+namespace prefetch
+{
+
+/**
+ * Estimate of how many distinct Markov indexes are live, used to size the
+ * table without set duelling. A sample of the indexes, chosen by hash, is
+ * kept in a counting Bloom filter whose counters hold how many more
+ * epochs an index stays live since it was last seen, so indexes age out
+ * instead of the whole filter being reset. A single hash picks one block
+ * of counters and every counter set within it, so an index touches one
+ * cache line; the estimate is kept up to date from the fill of the
+ * filter, so reading it costs no scan.
+ */
+class SizingSketch
+{
+    /** Counters per block, one cache line of bytes */
+    static constexpr unsigned blockCounters = 64;
+    /** Counters set per index, each picked by 6 bits of the hash */
+    static constexpr unsigned countersPerIndex = 6;
+    /** Sampling is decided by the top bits, out of this many slices */
+    static constexpr unsigned sampleSlices = 128;
+
+    /** Epochs an index stays live since last seen, per counter */
+    std::vector<uint8_t> counters;
+    size_t numBlocks;
+    /** Slices of the hash space sampled, out of sampleSlices */
+    const unsigned sampledSlices;
+    /** Epochs an index stays live for */
+    const uint8_t lifetime;
+    /** Counters currently non-zero */
+    size_t occupied;
+
+    static uint64_t hash(Addr index);
+
+  public:
+    /**
+     * @param expected Largest number of distinct indexes to estimate.
+     * @param sampled_slices Hash slices sampled, out of 128.
+     * @param lifetime Epochs an index is kept for since last seen.
+     */
+    SizingSketch(uint64_t expected, unsigned sampled_slices,
+                 unsigned lifetime);
+
+    /** Whether an index is among those sampled. */
+    bool
+    samples(Addr index) const
+    {
+        return (hash(index) >> 57) < sampledSlices;
+    }
+
+    /**
+     * Record a sampled index as seen this epoch.
+     * @return Whether the index was not already live.
+     */
+    bool insert(Addr index);
+
+    /** Estimated number of live indexes, over all of them. */
+    uint64_t estimate() const;
+
+    /** End an epoch, forgetting indexes not seen for lifetime epochs. */
+    void decay();
+
+    void clear();
+
+    /** Size a checkpoint of the sketch must have been taken with. */
+    size_t size() const { return counters.size(); }
+
+    void serializeSection(CheckpointOut &cp,
+                          const std::string &name) const;
+    void unserializeSection(CheckpointIn &cp, const std::string &name);
+};
+
+} // namespace prefetch
+} // namespace gem5
+
+#endif // __MEM_CACHE_PREFETCH_SIZING_SKETCH_HH__
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2023
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <sstream>
+
+#include "base/gtest/serialization_fixture.hh"
+#include "mem/cache/prefetch/sizing_sketch.hh"
+
+using namespace gem5;
+
+namespace
+{
+
+/**
+ * Insert the sampled ones out of count distinct indexes, starting at
+ * first.
+ * @return The number of indexes sampled.
+ */
+uint64_t
+insertRange(prefetch::SizingSketch &sketch, Addr first, uint64_t count)
+{
+    uint64_t sampled = 0;
+    for (Addr index = first; index < first + count; index++) {
+        if (sketch.samples(index)) {
+            sketch.insert(index);
+            sampled++;
+        }
+    }
+    return sampled;
+}
+
+} // anonymous namespace
+
+/**
+ * Test that the estimate tracks known cardinalities for several sampling
+ * rates. The error allowed is three standard deviations of the number of
+ * indexes sampled, plus a few percent for the filter itself.
+ */
+TEST(SizingSketchTest, Estimate)
+{
+    for (unsigned slices : {128, 32, 8}) {
+        for (uint64_t distinct : {2000, 20000, 100000}) {
+            prefetch::SizingSketch sketch(100000, slices, 4);
+            const uint64_t sampled = insertRange(sketch, 0x1000, distinct);
+            ASSERT_GT(sampled, 0);
+
+            const double p = slices / 128.0;
+            const double tolerance =
+                3 * std::sqrt((1 - p) / (distinct * p)) + 0.03;
+            EXPECT_NEAR(sketch.estimate(), distinct, distinct * tolerance)
+                << "with " << slices << " slices sampled";
+        }
+    }
+}
+
+/** Test that only about the requested share of indexes is sampled. */
+TEST(SizingSketchTest, Samples)
+{
+    prefetch::SizingSketch all(1024, 128, 1);
+    prefetch::SizingSketch quarter(1024, 32, 1);
+    uint64_t sampled = 0;
+    for (Addr index = 0; index < 65536; index++) {
+        ASSERT_TRUE(all.samples(index));
+        sampled += quarter.samples(index);
+    }
+    EXPECT_NEAR(sampled, 16384, 16384 * 0.05);
+}
+
+/** Test that re-inserting a live index is not counted again. */
+TEST(SizingSketchTest, InsertFresh)
+{
+    prefetch::SizingSketch sketch(1024, 128, 2);
+    ASSERT_EQ(sketch.estimate(), 0);
+    ASSERT_TRUE(sketch.insert(0x40));
+    const uint64_t estimate = sketch.estimate();
+    ASSERT_GT(estimate, 0);
+    ASSERT_FALSE(sketch.insert(0x40));
+    ASSERT_EQ(sketch.estimate(), estimate);
+}
+
+/** Test that indexes expire lifetime epochs after they were last seen. */
+TEST(SizingSketchTest, DecayExpiry)
+{
+    const unsigned lifetime = 3;
+    prefetch::SizingSketch sketch(4096, 128, lifetime);
+    insertRange(sketch, 0, 1000);
+    insertRange(sketch, 0x100000, 1000);
+    const uint64_t both = sketch.estimate();
+
+    // Keep the second range live while the first one ages out
+    for (unsigned epoch = 1; epoch < lifetime; epoch++) {
+        sketch.decay();
+        ASSERT_EQ(sketch.estimate(), both) << "after " << epoch << " epochs";
+        insertRange(sketch, 0x100000, 1000);
+    }
+    sketch.decay();
+    const uint64_t second = sketch.estimate();
+    EXPECT_NEAR(second, 1000, 1000 * 0.05);
+
+    // The second range was last seen one epoch ago
+    for (unsigned epoch = 1; epoch < lifetime; epoch++) {
+        sketch.decay();
+    }
+    ASSERT_EQ(sketch.estimate(), 0);
+
+    // A re-inserted index is live for the full lifetime again
+    ASSERT_TRUE(sketch.insert(0x40));
+    for (unsigned epoch = 1; epoch < lifetime; epoch++) {
+        sketch.decay();
+        ASSERT_GT(sketch.estimate(), 0);
+    }
+    sketch.decay();
+    ASSERT_EQ(sketch.estimate(), 0);
+}
+
+/** Test that clearing the sketch forgets every index. */
+TEST(SizingSketchTest, Clear)
+{
+    prefetch::SizingSketch sketch(4096, 128, 4);
+    insertRange(sketch, 0, 1000);
+    ASSERT_GT(sketch.estimate(), 0);
+    sketch.clear();
+    ASSERT_EQ(sketch.estimate(), 0);
+    ASSERT_TRUE(sketch.insert(0x40));
+}
+
+/** Test that the sampling rate and lifetime are checked. */
+TEST(SizingSketchTest, InvalidParameters)
+{
+    ASSERT_ANY_THROW(prefetch::SizingSketch(1024, 0, 4));
+    ASSERT_ANY_THROW(prefetch::SizingSketch(1024, 129, 4));
+    ASSERT_ANY_THROW(prefetch::SizingSketch(1024, 128, 0));
+    ASSERT_ANY_THROW(prefetch::SizingSketch(1024, 128, 256));
+}
+
+using SizingSketchSerializationFixture = SerializationFixture;
+
+/**
+ * Test that a checkpoint restores the counters' ages along with the count
+ * of occupied counters the estimate is kept from.
+ */
+TEST_F(SizingSketchSerializationFixture, Serialization)
+{
+    const unsigned lifetime = 4;
+    prefetch::SizingSketch sketch(4096, 64, lifetime);
+    insertRange(sketch, 0, 2000);
+    sketch.decay();
+    insertRange(sketch, 0x100000, 1000);
+
+    std::ostringstream cp_out;
+    {
+        Serializable::ScopedCheckpointSection scs(cp_out, "Section1");
+        sketch.serializeSection(cp_out, "sketch");
+    }
+    simulateSerialization(cp_out.str());
+
+    // The restored sketch starts from stale contents, which must not leak
+    // into its occupancy
+    prefetch::SizingSketch restored(4096, 64, lifetime);
+    insertRange(restored, 0x200000, 3000);
+    ASSERT_EQ(restored.size(), sketch.size());
+    CheckpointIn cp(getDirName());
+    Serializable::ScopedCheckpointSection scs(cp, "Section1");
+    restored.unserializeSection(cp, "sketch");
+
+    // Both age identically, so the first range expires one epoch before
+    // the second and then nothing is left
+    for (unsigned epoch = 0; epoch <= lifetime; epoch++) {
+        ASSERT_EQ(restored.estimate(), sketch.estimate())
+            << "after " << epoch << " epochs";
+        sketch.decay();
+        restored.decay();
+    }
+    ASSERT_EQ(restored.estimate(), 0);
+
+    // A differently sized sketch cannot be restored from the checkpoint
+    prefetch::SizingSketch larger(1 << 20, 64, lifetime);
+    ASSERT_ANY_THROW(larger.unserializeSection(cp, "sketch"));
+}
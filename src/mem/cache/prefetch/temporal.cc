@@ -0,0 +1,190 @@
+/**
+ * @file
+ * Indexing shared by the temporal prefetchers' Markov tables and the
+ * structural address map.
+ */
+
+#include "mem/cache/prefetch/temporal.hh"
+
+#include "base/intmath.hh"
+#include "mem/cache/prefetch/associative_set_impl.hh"
+#include "mem/cache/prefetch/temporal_checkpoint.hh"
+
+namespace gem5
+{
+
+GEM5_DEPRECATED_NAMESPACE(Prefetcher, prefetch);
+namespace prefetch
+{
+
+uint32_t
+TemporalHashedSetAssociative::extractSet(const Addr addr) const
+{
+    //Input is already blockIndex so no need to remove block again.
+    const Addr offset = (addr * max_ways) + (extractTag(addr) % ways);
+    return offset & setMask;   //setMask is numSets-1
+}
+
+Addr
+TemporalHashedSetAssociative::extractTag(const Addr addr) const
+{
+    //Description in Triage-ISR confuses whether the index is just the 16
+    //least significant bits, or the weird index above. The tag can't be the
+    //remaining bits if we use the literal representation!
+
+    //Remove the index bits first. Not clear how important, but it seemed
+    //helpful experimentally.
+    Addr offset = addr / (numSets / max_ways);
+    int result = 0;
+
+    //This is a tag# as described in the Triangel paper.
+    const int shiftwidth = 10;
+
+    for (int x = 0; x < 64; x += shiftwidth) {
+       result ^= (offset & ((1 << shiftwidth) - 1));
+       offset = offset >> shiftwidth;
+    }
+    return result;
+}
+
+StructuralAddressMap::StructuralAddressMap(size_t chunk_size,
+    unsigned entries_per_line, unsigned counter_bits, int assoc,
+    int num_entries, BaseIndexingPolicy *ps_indexing_policy,
+    replacement_policy::Base *ps_replacement_policy,
+    BaseIndexingPolicy *sp_indexing_policy,
+    replacement_policy::Base *sp_replacement_policy)
+  : chunkSize(chunk_size), entriesPerLine(entries_per_line),
+    structuralCounter(0),
+    psCache(assoc, num_entries, ps_indexing_policy, ps_replacement_policy,
+            MappingEntry(entries_per_line, counter_bits)),
+    spCache(assoc, num_entries, sp_indexing_policy, sp_replacement_policy,
+            MappingEntry(entries_per_line, counter_bits))
+{
+    assert(isPowerOf2(entriesPerLine));
+}
+
+StructuralAddressMap::Mapping &
+StructuralAddressMap::psMapping(Addr paddr, bool is_secure)
+{
+    const Addr line = paddr / entriesPerLine;
+    MappingEntry *ps_entry = psCache.findEntry(line, is_secure);
+    if (ps_entry != nullptr) {
+        psCache.accessEntry(ps_entry);
+    } else {
+        ps_entry = psCache.findVictim(line);
+        assert(ps_entry != nullptr);
+        psCache.insertEntry(line, is_secure, ps_entry);
+    }
+    return ps_entry->mappings[paddr % entriesPerLine];
+}
+
+void
+StructuralAddressMap::setPhysical(Addr saddr, bool is_secure, Addr paddr)
+{
+    const Addr line = saddr / entriesPerLine;
+    MappingEntry *sp_entry = spCache.findEntry(line, is_secure);
+    if (sp_entry != nullptr) {
+        spCache.accessEntry(sp_entry);
+    } else {
+        sp_entry = spCache.findVictim(line);
+        assert(sp_entry != nullptr);
+        spCache.insertEntry(line, is_secure, sp_entry);
+    }
+    Mapping &mapping = sp_entry->mappings[saddr % entriesPerLine];
+    mapping.address = paddr;
+    mapping.counter.reset();
+    mapping.counter++;
+}
+
+void
+StructuralAddressMap::train(Addr prev, Addr next, bool is_secure)
+{
+    Mapping &mapping_a = psMapping(prev, is_secure);
+    Mapping &mapping_b = psMapping(next, is_secure);
+    if (mapping_a.counter > 0 && mapping_b.counter > 0) {
+        if (mapping_b.address == mapping_a.address + 1) {
+            mapping_b.counter++;
+        } else if (mapping_b.counter == 1) {
+            // Counter would hit 0: move B behind A, keeping it at 1
+            mapping_b.address = mapping_a.address + 1;
+            setPhysical(mapping_b.address, is_secure, next);
+        } else {
+            mapping_b.counter--;
+        }
+        return;
+    }
+    if (mapping_a.counter == 0) {
+        // A starts a new stream
+        mapping_a.counter++;
+        mapping_a.address = structuralCounter;
+        structuralCounter += chunkSize;
+        setPhysical(mapping_a.address, is_secure, prev);
+    }
+    mapping_b.counter.reset();
+    mapping_b.counter++;
+    mapping_b.address = mapping_a.address + 1;
+    setPhysical(mapping_b.address, is_secure, next);
+}
+
+bool
+StructuralAddressMap::followers(Addr paddr, bool is_secure,
+    unsigned distance, unsigned count, std::vector<Addr> &out) const
+{
+    const MappingEntry *ps_entry =
+        psCache.findEntry(paddr / entriesPerLine, is_secure);
+    if (ps_entry == nullptr) {
+        return false;
+    }
+    const Mapping &mapping = ps_entry->mappings[paddr % entriesPerLine];
+    if (mapping.counter == 0) {
+        return false;
+    }
+    const Addr first = mapping.address + distance;
+    const MappingEntry *sp_entry =
+        spCache.findEntry(first / entriesPerLine, is_secure);
+    if (sp_entry == nullptr) {
+        // The line has been evicted, so the stream is lost
+        return false;
+    }
+    const Addr end = std::min<Addr>(first + count,
+        (first / entriesPerLine + 1) * entriesPerLine);
+    for (Addr s = first; s < end; s++) {
+        const Mapping &spm = sp_entry->mappings[s % entriesPerLine];
+        if (spm.counter > 0) {
+            out.push_back(spm.address);
+        }
+    }
+    return true;
+}
+
+void
+StructuralAddressMap::serializeSection(CheckpointOut &cp,
+                                       const std::string &name) const
+{
+    paramOut(cp, name + ".counter", structuralCounter);
+    auto pack = [](const MappingEntry &e, std::vector<uint64_t> &out) {
+        for (const auto &m : e.mappings) {
+            out.insert(out.end(), {m.address, (uint8_t)m.counter});
+        }
+    };
+    serializeSet(cp, name + ".ps", psCache, pack);
+    serializeSet(cp, name + ".sp", spCache, pack);
+}
+
+void
+StructuralAddressMap::unserializeSection(CheckpointIn &cp,
+                                         const std::string &name)
+{
+    paramIn(cp, name + ".counter", structuralCounter);
+    auto unpack = [](MappingEntry &e, const uint64_t *in) {
+        for (auto &m : e.mappings) {
+            m.address = *in++;
+            restoreCounter(m.counter, *in++);
+        }
+    };
+    unserializeSet(cp, name + ".ps", psCache, 2 * entriesPerLine, unpack);
+    unserializeSet(cp, name + ".sp", spCache, 2 * entriesPerLine, unpack);
+}
+
+} // namespace prefetch
+} // namespace gem5
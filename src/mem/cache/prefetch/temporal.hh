@@ -0,0 +1,486 @@
+/**
+ * @file
+ * Building blocks shared by the temporal prefetchers (Triage, Triangel and
+ * SimpleTriangel): the hashed indexing of a Markov table held in LLC ways,
+ * the per-PC address history of the training unit, the set duellers that
+ * size the table, the bookkeeping of the LLC ways it takes, and the
+ * structural address map that linearises per-PC streams. The sketch that
+ * estimates the table's size lives in sizing_sketch.hh, the OPTgen sampler
+ * in hawkeye_sampler.hh and the checkpoint helpers in
+ * temporal_checkpoint.hh.
+ */
+
+#ifndef __MEM_CACHE_PREFETCH_TEMPORAL_HH__
+#define __MEM_CACHE_PREFETCH_TEMPORAL_HH__
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "base/random.hh"
+#include "base/sat_counter.hh"
+#include "base/types.hh"
+#include "mem/cache/prefetch/associative_set.hh"
+#include "mem/cache/prefetch/sizing_sketch.hh"
+#include "mem/cache/tags/base.hh"
+#include "mem/cache/tags/indexing_policies/set_associative.hh"
+#include "sim/cur_tick.hh"
+#include "sim/serialize.hh"
+
+#include "params/TemporalHashedSetAssociative.hh"
+
+namespace gem5
+{
+
+GEM5_DEPRECATED_NAMESPACE(Prefetcher, prefetch);
+namespace prefetch
+{
+
+/**
+ * Indexing of a Markov table whose sets are LLC lines. Each index hashes
+ * to a tag#, and the tag# picks which of the ways currently given to the
+ * table holds the index, so the table can grow and shrink a way at a time.
+ * Indexes are block addresses, so no block offset is removed.
+ */
+class TemporalHashedSetAssociative : public SetAssociative
+{
+  public:
+    uint32_t extractSet(const Addr addr) const override;
+    Addr extractTag(const Addr addr) const override;
+
+    /** LLC ways currently holding the table */
+    int ways;
+    /** Largest number of LLC ways the table may take */
+    int max_ways;
+
+    TemporalHashedSetAssociative(
+        const TemporalHashedSetAssociativeParams &p)
+      : SetAssociative(p), ways(0), max_ways(8)
+    {
+    }
+    ~TemporalHashedSetAssociative() = default;
+};
+
+/**
+ * Training unit entry keeping the last Depth addresses accessed by a PC,
+ * so the Markov index can trail the target by up to Depth accesses.
+ */
+template <unsigned Depth>
+struct TemporalTrainingEntry : public TaggedEntry
+{
+    static_assert(Depth >= 2, "Keep at least the last two addresses");
+
+    /** Number of checkpointed words the history takes */
+    static const unsigned historyWords = Depth;
+
+    Addr lastAddress;
+    /** Addresses 2..Depth accesses ago, most recent first */
+    Addr olderAddresses[Depth - 1];
+    bool lastAddressSecure;
+
+    TemporalTrainingEntry() : lastAddress(0), lastAddressSecure(false)
+    {
+        std::fill(std::begin(olderAddresses), std::end(olderAddresses), 0);
+    }
+
+    /** Address seen distance accesses ago at this PC, 1 being the last */
+    Addr
+    addressAt(unsigned distance) const
+    {
+        return distance <= 1 ? lastAddress : olderAddresses[distance - 2];
+    }
+
+    /** Shift addr into the history as the most recent access */
+    void
+    pushAddress(Addr addr, bool is_secure)
+    {
+        std::copy_backward(std::begin(olderAddresses),
+                           std::end(olderAddresses) - 1,
+                           std::end(olderAddresses));
+        olderAddresses[0] = lastAddress;
+        lastAddress = addr;
+        lastAddressSecure = is_secure;
+    }
+
+    void
+    packHistory(std::vector<uint64_t> &out) const
+    {
+        out.push_back(lastAddress);
+        out.insert(out.end(), std::begin(olderAddresses),
+                   std::end(olderAddresses));
+    }
+
+    /** @return The words after the history. */
+    const uint64_t *
+    unpackHistory(const uint64_t *in)
+    {
+        lastAddress = *in++;
+        std::copy_n(in, Depth - 1, std::begin(olderAddresses));
+        return in + Depth - 1;
+    }
+
+    void
+    invalidate() override
+    {
+        TaggedEntry::invalidate();
+        lastAddress = 0;
+        std::fill(std::begin(olderAddresses), std::end(olderAddresses), 0);
+    }
+};
+
+/**
+ * Set dueller comparing, for one sampled LLC set, how the set would fare
+ * as LLC ways and as Markov table entries. The cache side replays every
+ * access through an LRU stack as deep as the LLC; the temporal side
+ * replays the accesses the prefetcher would store, for one slice of the
+ * entries a line holds.
+ */
+struct SizeDuel
+{
+    int idx;
+    uint64_t set;
+    uint64_t setMask;
+    uint64_t temporalMod; //[0..12] Entries Per Line
+
+    uint64_t temporalModMax; //12 by default
+    uint64_t cacheMaxAssoc;
+
+    std::vector<Addr> cacheAddrs; // [0..16] should be set by the nsets of the L3 cache.
+    std::vector<uint64_t> cacheAddrTick;
+    std::vector<Addr> temporalAddrs;
+    std::vector<uint64_t> temporalAddrTick;
+    std::vector<bool> inserted;
+
+    SizeDuel()
+    {
+    }
+
+    void
+    reset(uint64_t mask, uint64_t modMax, uint64_t cacheAssoc)
+    {
+        setMask = mask;
+        temporalModMax = modMax;
+        cacheMaxAssoc = cacheAssoc;
+        cacheAddrTick.assign(cacheMaxAssoc, 0);
+        temporalAddrs.assign(cacheMaxAssoc, 0);
+        cacheAddrs.assign(cacheMaxAssoc, 0);
+        temporalAddrTick.assign(cacheMaxAssoc, 0);
+        inserted.resize(cacheMaxAssoc, false);
+        set = random_mt.random<uint64_t>(0, setMask);
+        // N-1, as range is inclusive.
+        temporalMod = random_mt.random<uint64_t>(0, modMax - 1);
+    }
+
+    /**
+     * Position of a way in its recency stack, 0 being most recently used.
+     * Ways last touched in the same tick share a position, which is what
+     * keeps the duelling histograms identical to a per-tick LRU.
+     */
+    int
+    stackPosition(const std::vector<uint64_t> &ticks, int way) const
+    {
+        int older = 0;
+        const uint64_t tick = ticks[way];
+        for (int y = 0; y < cacheMaxAssoc; y++) {
+            older += tick > ticks[y];
+        }
+        assert(older <= cacheMaxAssoc - 1);
+        return cacheMaxAssoc - 1 - older;
+    }
+
+    /**
+     * Look an address up in one side of the dueller in a single pass,
+     * touching every matching way and otherwise picking the LRU victim.
+     * @return Sum of (stack position + 1) over the matching ways, or 0.
+     */
+    int
+    touchOrReplace(std::vector<Addr> &addrs, std::vector<uint64_t> &ticks,
+                   Addr addr, bool may_insert, bool is_temporal)
+    {
+        int ret = 0;
+        bool found = false;
+        int victim = -1;
+        uint64_t oldestTick = (uint64_t)-1;
+        for (int x = 0; x < cacheMaxAssoc; x++) {
+            if (addr == addrs[x]) {
+                found = true;
+                ret += stackPosition(ticks, x) + 1;
+                ticks[x] = curTick();
+                if (is_temporal) {
+                    inserted[x] = true;
+                }
+            } else if (!found && ticks[x] < oldestTick) {
+                victim = x;
+                oldestTick = ticks[x];
+            }
+        }
+        if (!found && may_insert) {
+            assert(victim >= 0);
+            addrs[victim] = addr;
+            ticks[victim] = curTick();
+        }
+        return ret;
+    }
+
+    bool samples(Addr addr) const { return (addr & setMask) == set; }
+
+    /**
+     * Replay an access.
+     * @return The cache side's result, plus 128 times the temporal side's.
+     */
+    int
+    checkAndInsert(Addr addr, bool should_pf)
+    {
+        if (!samples(addr)) {
+            return 0;
+        }
+        int ret = touchOrReplace(cacheAddrs, cacheAddrTick, addr, true,
+                                 false);
+        if (should_pf) {
+            const bool in_slice =
+                ((addr / (setMask + 1)) % temporalModMax) == temporalMod;
+            ret += 128 * touchOrReplace(temporalAddrs, temporalAddrTick,
+                                        addr, in_slice, true);
+        }
+        return ret;
+    }
+
+    /** Checkpointed words per dueller, given the LLC associativity */
+    static uint64_t packedWords(uint64_t assoc) { return 2 + 5 * assoc; }
+
+    void
+    pack(std::vector<uint64_t> &out) const
+    {
+        out.push_back(set);
+        out.push_back(temporalMod);
+        for (int y = 0; y < cacheMaxAssoc; y++) {
+            out.insert(out.end(), {cacheAddrs[y], cacheAddrTick[y],
+                temporalAddrs[y], temporalAddrTick[y], inserted[y]});
+        }
+    }
+
+    void
+    unpack(const uint64_t *in)
+    {
+        set = *in++;
+        temporalMod = *in++;
+        for (int y = 0; y < cacheMaxAssoc; y++) {
+            cacheAddrs[y] = *in++;
+            cacheAddrTick[y] = *in++;
+            temporalAddrs[y] = *in++;
+            temporalAddrTick[y] = *in++;
+            inserted[y] = *in++;
+        }
+    }
+};
+
+/**
+ * Credit one dueller result to the score of every partition size, indexed
+ * by the number of LLC ways given to the Markov table.
+ * @param res Result of SizeDuel::checkAndInsert().
+ * @param pf_credit Score of a prefetch hit.
+ */
+inline void
+creditDuel(std::vector<uint32_t> &score, int res, uint32_t pf_credit)
+{
+    const int cache_hit = res % 128; //This is just bit encoding of cache hits.
+    const int pref_hit = res / 128; //This is just bit encoding of prefetch hits.
+    //Which nth most used replacement-state we hit at, if any.
+    const int cache_set = cache_hit - 1;
+    const int pref_set = pref_hit - 1;
+    assert(!cache_hit || (cache_set < score.size() - 1 && cache_set >= 0));
+    assert(!pref_hit || (pref_set < score.size() - 1 && pref_set >= 0));
+    // cache partition hit at this size or smaller. So hit in way 14 = y=17-2-14=1 and 0: would hit with 0 ways reserved or 1, not 2.
+    if (cache_hit) {
+        for (int y = score.size() - 2 - cache_set; y >= 0; y--) {
+            score[y]++;
+        }
+    }
+    // pf hit at this size or bigger. one-indexed (since 0 is an alloc on 0 ways). So hit in way 0 = y=1--16 ways reserved, not 0.
+    if (pref_hit) {
+        for (int y = pref_set + 1; y < score.size(); y++) {
+            score[y] += pf_credit;
+        }
+    }
+}
+
+/**
+ * LLC ways lent to a Markov table or history buffer. Only the ways this
+ * owner took are handed back, so several prefetchers may take ways from
+ * the same LLC. Ways are counted from the top of the LLC, past the first
+ * firstWay ones, which other owners hold.
+ */
+class LLCWayPartition
+{
+    BaseTags* const tags;
+    /** Markov table sets sharing one LLC set, one per way it may take */
+    const int maxWays;
+    /** Ways above this partition's, held by other owners */
+    int firstWay;
+    /** Ways currently taken from the LLC */
+    int held;
+    /** Whether ways are really taken, or the partition only modelled */
+    bool attached;
+
+  public:
+    LLCWayPartition(BaseTags *llc_tags, int max_ways)
+      : tags(llc_tags), maxWays(max_ways), firstWay(0), held(0),
+        attached(true)
+    {
+    }
+
+    /**
+     * Move this partition down past ways another owner takes from the
+     * top of the LLC. Only call before any line has been claimed.
+     * @return The first of the ways handed over.
+     */
+    int
+    yieldTopWays(int ways)
+    {
+        const int first = firstWay;
+        firstWay += ways;
+        return first;
+    }
+
+    /** Place this partition first_way ways from the top of the LLC. */
+    void moveTo(int first_way) { firstWay = first_way; }
+
+    /** Take or give back ways so that ways are held. */
+    void
+    reserve(int ways)
+    {
+        if (!attached) {
+            return;
+        }
+        const int llc_ways = tags->getWayAllocationMax() - (ways - held);
+        assert(llc_ways >= 1);
+        tags->setWayAllocationMax(llc_ways);
+        held = ways;
+    }
+
+    /** Evict the LLC line backing a Markov set so the table can use it. */
+    void
+    claim(uint32_t markov_set)
+    {
+        claimLine(markov_set / maxWays, markov_set % maxWays);
+    }
+
+    /** Evict the LLC line at a way of this partition, in an LLC set. */
+    void
+    claimLine(uint32_t llc_set, int way)
+    {
+        if (attached) {
+            tags->clearSetWay(llc_set, firstWay + way);
+        }
+    }
+
+    /**
+     * Keep the partition to the table's own bookkeeping, leaving the LLC's
+     * ways and contents alone from now on.
+     */
+    void
+    detach()
+    {
+        reserve(0);
+        attached = false;
+    }
+};
+
+/**
+ * Structural address space of the Irregular Stream Buffer. Addresses that
+ * follow each other at a PC are given consecutive structural addresses, so
+ * a chain of successors becomes a run of slots in one structural line.
+ * Both directions of the mapping are cached a line at a time, in tables
+ * replaced like a TLB.
+ */
+class StructuralAddressMap
+{
+  public:
+    /** One address of a line, with a confidence counter */
+    struct Mapping
+    {
+        Addr address;
+        SatCounter8 counter;
+        Mapping(unsigned bits) : address(0), counter(bits)
+        {}
+    };
+
+    /** Mappings of a line of consecutive addresses */
+    struct MappingEntry : public TaggedEntry
+    {
+        std::vector<Mapping> mappings;
+        MappingEntry(size_t num_mappings, unsigned counter_bits)
+          : TaggedEntry(), mappings(num_mappings, counter_bits)
+        {
+        }
+
+        void
+        invalidate() override
+        {
+            TaggedEntry::invalidate();
+            for (auto &entry : mappings) {
+                entry.address = 0;
+                entry.counter.reset();
+            }
+        }
+    };
+
+  private:
+    /** Structural addresses given to each new stream */
+    const size_t chunkSize;
+    /** Mappings per line of either table */
+    const unsigned entriesPerLine;
+    /** Next unallocated structural address */
+    uint64_t structuralCounter;
+
+    /** Physical-to-structural table */
+    AssociativeSet<MappingEntry, replacement_policy::InlineLRU> psCache;
+    /** Structural-to-physical table */
+    AssociativeSet<MappingEntry, replacement_policy::InlineLRU> spCache;
+
+    /** Get the structural mapping of a block, allocating its line. */
+    Mapping &psMapping(Addr paddr, bool is_secure);
+
+    /** Point a structural address at a block. */
+    void setPhysical(Addr saddr, bool is_secure, Addr paddr);
+
+  public:
+    StructuralAddressMap(size_t chunk_size, unsigned entries_per_line,
+                         unsigned counter_bits, int assoc, int num_entries,
+                         BaseIndexingPolicy *ps_indexing_policy,
+                         replacement_policy::Base *ps_replacement_policy,
+                         BaseIndexingPolicy *sp_indexing_policy,
+                         replacement_policy::Base *sp_replacement_policy);
+
+    /** Record that block next followed block prev at the same PC. */
+    void train(Addr prev, Addr next, bool is_secure);
+
+    /**
+     * Read the blocks following a block in its stream, from distance on,
+     * stopping at the end of the structural line holding the first.
+     * @param out Receives up to count blocks.
+     * @return Whether the structural line was cached, and so read.
+     */
+    bool followers(Addr paddr, bool is_secure, unsigned distance,
+                   unsigned count, std::vector<Addr> &out) const;
+
+    /** Sizes a checkpoint of the map must have been taken with. */
+    void
+    geometry(std::vector<uint64_t> &out) const
+    {
+        out.insert(out.end(), {psCache.entries.size(),
+                               spCache.entries.size(), entriesPerLine});
+    }
+
+    void serializeSection(CheckpointOut &cp,
+                          const std::string &name) const;
+    void unserializeSection(CheckpointIn &cp, const std::string &name);
+};
+
+} // namespace prefetch
+} // namespace gem5
+
+#endif // __MEM_CACHE_PREFETCH_TEMPORAL_HH__
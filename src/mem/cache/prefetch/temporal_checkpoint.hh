@@ -0,0 +1,160 @@
+/**
+ * @file
+ * Checkpoint helpers shared by the temporal prefetchers.
+ */
+
+#ifndef __MEM_CACHE_PREFETCH_TEMPORAL_CHECKPOINT_HH__
+#define __MEM_CACHE_PREFETCH_TEMPORAL_CHECKPOINT_HH__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "base/logging.hh"
+#include "base/sat_counter.hh"
+#include "mem/cache/prefetch/associative_set.hh"
+#include "sim/serialize.hh"
+
+#include "bloom.h"
+
+namespace gem5
+{
+
+GEM5_DEPRECATED_NAMESPACE(Prefetcher, prefetch);
+namespace prefetch
+{
+
+/**
+ * Packed word layout of one valid entry: its position in the set, its tag
+ * and secure bit, then whatever the owner's pack function appends.
+ */
+static const unsigned checkpointEntryHeader = 3;
+
+/**
+ * Write the valid entries of an associative set as a single packed array,
+ * which keeps tables of hundreds of thousands of entries to one line of
+ * the checkpoint. Replacement state is not kept.
+ * @param name Prefix of the checkpoint entries.
+ * @param pack Appends an entry's own fields to a word vector.
+ */
+template <class Entry, class InlinePolicy, class Pack>
+void
+serializeSet(CheckpointOut &cp, const std::string &name,
+             const AssociativeSet<Entry, InlinePolicy> &set, Pack pack)
+{
+    std::vector<uint64_t> data;
+    for (size_t i = 0; i < set.entries.size(); i++) {
+        const Entry &entry = set.entries[i];
+        if (!entry.isValid()) {
+            continue;
+        }
+        data.push_back(i);
+        data.push_back(entry.getTag());
+        data.push_back(entry.isSecure());
+        pack(entry, data);
+    }
+    paramOut(cp, name + ".entries", set.entries.size());
+    arrayParamOut(cp, name + ".data", data);
+}
+
+/**
+ * Restore entries written by serializeSet() to their original positions,
+ * invalidating every other entry. Restored entries look freshly inserted
+ * to the replacement policy.
+ * @param words Number of words pack appended per entry.
+ * @param unpack Reads an entry's own fields back from its words.
+ */
+template <class Entry, class InlinePolicy, class Unpack>
+void
+unserializeSet(CheckpointIn &cp, const std::string &name,
+               AssociativeSet<Entry, InlinePolicy> &set, unsigned words,
+               Unpack unpack)
+{
+    size_t num_entries;
+    paramIn(cp, name + ".entries", num_entries);
+    fatal_if(num_entries != set.entries.size(),
+             "%s: checkpoint holds %d entries for a %d-entry table\n",
+             name, num_entries, set.entries.size());
+
+    std::vector<uint64_t> data;
+    arrayParamIn(cp, name + ".data", data);
+    const size_t stride = checkpointEntryHeader + words;
+    fatal_if(data.size() % stride != 0,
+             "%s: malformed checkpoint data\n", name);
+
+    for (auto &entry : set.entries) {
+        if (entry.isValid()) {
+            set.invalidate(&entry);
+        }
+    }
+    for (size_t i = 0; i < data.size(); i += stride) {
+        fatal_if(data[i] >= set.entries.size(),
+                 "%s: checkpointed entry out of range\n", name);
+        Entry &entry = set.entries[data[i]];
+        set.restoreEntry(data[i + 1], data[i + 2], &entry);
+        unpack(entry, &data[i + checkpointEntryHeader]);
+    }
+}
+
+/** Set a saturating counter to a checkpointed value. */
+inline void
+restoreCounter(SatCounter8 &counter, uint64_t value)
+{
+    counter -= (uint8_t)counter;
+    counter += value;
+}
+
+/** Write the bits of a Bloom filter, packed eight bytes to a word. */
+inline void
+serializeBloom(CheckpointOut &cp, const std::string &name, const bloom &bl)
+{
+    std::vector<uint64_t> words((bl.bytes + 7) / 8, 0);
+    for (size_t i = 0; i < bl.bytes; i++) {
+        words[i / 8] |= (uint64_t)bl.bf[i] << (8 * (i % 8));
+    }
+    arrayParamOut(cp, name, words);
+}
+
+/** Restore the bits of a Bloom filter of the same size. */
+inline void
+unserializeBloom(CheckpointIn &cp, const std::string &name, bloom &bl)
+{
+    std::vector<uint64_t> words;
+    arrayParamIn(cp, name, words);
+    fatal_if(words.size() != (bl.bytes + 7) / 8,
+             "%s: checkpointed Bloom filter has a different size\n", name);
+    for (size_t i = 0; i < bl.bytes; i++) {
+        bl.bf[i] = words[i / 8] >> (8 * (i % 8));
+    }
+}
+
+/**
+ * Check that a checkpoint section holds state for a table layout identical
+ * to ours. Prefetcher state is only worth restoring as a whole, so a
+ * missing or different layout leaves the prefetcher cold.
+ * @param geometry Sizes that must match for the state to be reused.
+ * @return Whether the rest of the state should be restored.
+ */
+inline bool
+checkpointGeometryMatches(CheckpointIn &cp, const std::string &owner,
+                          const std::vector<uint64_t> &geometry)
+{
+    if (!cp.entryExists(Serializable::currentSection(), "geometry")) {
+        warn("%s: no prefetcher state in checkpoint, starting cold\n",
+             owner);
+        return false;
+    }
+    std::vector<uint64_t> saved;
+    arrayParamIn(cp, "geometry", saved);
+    if (saved != geometry) {
+        warn("%s: checkpointed prefetcher state was taken with a different "
+             "configuration, starting cold\n", owner);
+        return false;
+    }
+    return true;
+}
+
+} // namespace prefetch
+} // namespace gem5
+
+#endif // __MEM_CACHE_PREFETCH_TEMPORAL_CHECKPOINT_HH__
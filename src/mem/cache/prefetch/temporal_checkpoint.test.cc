@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2023
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <vector>
+
+#include "base/gtest/cur_tick_fake.hh"
+#include "base/gtest/serialization_fixture.hh"
+#include "mem/cache/prefetch/associative_set_impl.hh"
+#include "mem/cache/prefetch/temporal.hh"
+#include "mem/cache/prefetch/temporal_checkpoint.hh"
+#include "mem/cache/replacement_policies/lru_rp.hh"
+#include "params/LRURP.hh"
+#include "params/TemporalHashedSetAssociative.hh"
+
+using namespace gem5;
+
+namespace
+{
+
+GTestTickHandler tickHandler;
+
+/** Entry with a payload of its own to checkpoint */
+struct PayloadEntry : public TaggedEntry
+{
+    uint64_t payload = 0;
+};
+
+const int assoc = 8;
+const int numEntries = 1024;
+
+/** @return Parameters of a Markov table's indexing. */
+TemporalHashedSetAssociativeParams
+indexingParams()
+{
+    TemporalHashedSetAssociativeParams params;
+    params.name = "indexing";
+    params.eventq_index = 0;
+    params.assoc = assoc;
+    params.entry_size = 1;
+    params.size = numEntries;
+    return params;
+}
+
+LRURPParams
+lruParams()
+{
+    LRURPParams params;
+    params.name = "lru";
+    params.eventq_index = 0;
+    return params;
+}
+
+/** Fill a set with count indexes whose payload is the index. */
+template <class InlinePolicy>
+std::vector<Addr>
+fill(AssociativeSet<PayloadEntry, InlinePolicy> &set, unsigned count)
+{
+    std::vector<Addr> indexes;
+    for (Addr index = 0x12345; indexes.size() < count; index += 0x9e37) {
+        if (set.findEntry(index, false) != nullptr) {
+            continue;
+        }
+        tickHandler.setCurTick(curTick() + 1);
+        PayloadEntry *entry = set.findVictim(index);
+        set.insertEntry(index, false, entry);
+        entry->payload = index;
+        indexes.push_back(index);
+    }
+    return indexes;
+}
+
+} // anonymous namespace
+
+/**
+ * Save and restore a set of the given inline policy, and check that every
+ * index found in the saved set is found in the restored one, in the same
+ * entry and with the same payload.
+ */
+template <class InlinePolicy>
+void
+checkRoundTrip(SerializationFixture &fixture)
+{
+    // Hash indexes to tags over all the ways the table may take
+    prefetch::TemporalHashedSetAssociative indexing(indexingParams());
+    indexing.ways = indexing.max_ways;
+    replacement_policy::LRU lru(lruParams());
+    AssociativeSet<PayloadEntry, InlinePolicy> saved(assoc, numEntries,
+                                                     &indexing, &lru);
+    // Twice the capacity, so that some indexes get evicted
+    const std::vector<Addr> indexes = fill(saved, 2 * numEntries);
+
+    std::ostringstream cp_out;
+    {
+        Serializable::ScopedCheckpointSection scs(cp_out, "Section1");
+        prefetch::serializeSet(cp_out, "table", saved,
+            [](const PayloadEntry &entry, std::vector<uint64_t> &data) {
+                data.push_back(entry.payload);
+            });
+    }
+    fixture.simulateSerialization(cp_out.str());
+
+    // Start the restored set from different contents, which must be lost
+    AssociativeSet<PayloadEntry, InlinePolicy> restored(assoc, numEntries,
+                                                        &indexing, &lru);
+    fill(restored, numEntries / 2);
+    CheckpointIn cp(fixture.getDirName());
+    Serializable::ScopedCheckpointSection scs(cp, "Section1");
+    prefetch::unserializeSet(cp, "table", restored, 1,
+        [](PayloadEntry &entry, const uint64_t *data) {
+            entry.payload = data[0];
+        });
+
+    unsigned found = 0;
+    for (Addr index : indexes) {
+        const PayloadEntry *entry = saved.findEntry(index, false);
+        const PayloadEntry *restored_entry = restored.findEntry(index, false);
+        if (entry == nullptr) {
+            EXPECT_EQ(restored_entry, nullptr) << std::hex << index;
+            continue;
+        }
+        found++;
+        ASSERT_NE(restored_entry, nullptr) << std::hex << index;
+        EXPECT_EQ(restored_entry - &*restored.begin(),
+                  entry - &*saved.begin());
+        // Folded tags alias, so this may be another index's entry
+        EXPECT_EQ(restored_entry->payload, entry->payload);
+    }
+    EXPECT_GT(found, numEntries / 2);
+
+    // Restored entries can be accessed and replaced like inserted ones
+    const Addr index = indexes.back();
+    restored.accessEntry(restored.findEntry(index, false));
+    PayloadEntry *victim = restored.findVictim(index);
+    ASSERT_NE(victim, nullptr);
+    EXPECT_FALSE(victim->isValid());
+}
+
+using TemporalCheckpointFixture = SerializationFixture;
+
+/** Test restoring a hashed set through the virtual replacement policy. */
+TEST_F(TemporalCheckpointFixture, HashedSetRoundTrip)
+{
+    checkRoundTrip<void>(*this);
+}
+
+/** Test restoring a hashed set with its replacement state inline. */
+TEST_F(TemporalCheckpointFixture, HashedSetRoundTripInline)
+{
+    checkRoundTrip<replacement_policy::InlineLRU>(*this);
+}
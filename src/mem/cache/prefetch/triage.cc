@@ -47,6 +47,7 @@
 
 #include "debug/HWPrefetch.hh"
 #include "mem/cache/prefetch/associative_set_impl.hh"
+#include "mem/cache/prefetch/temporal_checkpoint.hh"
 #include "params/TriagePrefetcher.hh"
 #include <cmath>
 
@@ -80,16 +81,17 @@ Triage::Triage(
                  p.training_unit_replacement_policy),
     lookupAssoc(p.lookup_assoc),
     lookupOffset(p.lookup_offset),
+    hawksets(this, &TrainingUnitEntry::temporal),
     markovTable(p.address_map_rounded_cache_assoc,
                           p.address_map_rounded_entries,
                           p.address_map_cache_indexing_policy,
                           p.address_map_cache_replacement_policy,
-                          MarkovMapping())
+                          MarkovMapping()),
+    thsa(dynamic_cast<TriageHashedSetAssociative*>(p.address_map_cache_indexing_policy)),
+    llcWays(cachetags, maxWays)
 {
-	for(int x=0;x<64;x++) {
-		hawksets[x].setMask = p.address_map_rounded_entries/ hawksets[x].maxElems - 1;
-		hawksets[x].reset();
-	}
+	fatal_if(!thsa, "%s: the Markov table must use TriageHashedSetAssociative indexing\n", name());
+	hawksets.reset(p.address_map_rounded_entries);
 	for(int x=0;x<1024;x++) {
 		lookupTable[x]=0;
     		lookupTick[x]=0;
@@ -129,9 +131,9 @@ Triage::calculatePrefetch(const PrefetchInfo &pfi,
     if (entry != nullptr) {
         trainingUnit.accessEntry(entry);
         correlated_addr_found = true;
-        index = lookahead_two? entry->lastLastAddress : entry->lastAddress;
+        index = entry->addressAt(lookahead_two ? 2 : 1);
 
-    	for(int x=0; x<64; x++)hawksets[x].add(addr,pc,&trainingUnit);
+    	hawksets.add(addr,pc,trainingUnit);
         temporal = entry->temporal>=hawkeyeThreshold;
 
         if(addr == index) return; // to avoid repeat trainings on sequence.
@@ -157,8 +159,6 @@ Triage::calculatePrefetch(const PrefetchInfo &pfi,
             		     && current_size < max_size) {
             	current_size += size_increment;
             	assert(current_size <= max_size);
-            	assert(cachetags->getWayAllocationMax()>1);
-            	cachetags->setWayAllocationMax(cachetags->getWayAllocationMax()-1);
             	std::vector<MarkovMapping> ams;
 
              	if(should_rearrange) {
@@ -170,9 +170,8 @@ Triage::calculatePrefetch(const PrefetchInfo &pfi,
 		    	}
             	}
 
-            	TriageHashedSetAssociative* thsa = dynamic_cast<TriageHashedSetAssociative*>(markovTable.indexingPolicy);
-  		if(thsa) { thsa->ways++; thsa->max_ways = maxWays; assert(thsa->ways <= thsa->max_ways);}
-  		else assert(0);
+  		thsa->ways++; thsa->max_ways = maxWays; assert(thsa->ways <= thsa->max_ways);
+  		llcWays.reserve(thsa->ways);
             	if(should_rearrange) {
 			for(MarkovMapping am: ams) {
 			    		   MarkovMapping *mapping = getHistoryEntry(am.index, am.isSecure(),true,false,true,true);
@@ -207,9 +206,7 @@ Triage::calculatePrefetch(const PrefetchInfo &pfi,
 		    		am.invalidate(); //for RRIP's sake
 		    	}
             	}
-	    	TriageHashedSetAssociative* thsa = dynamic_cast<TriageHashedSetAssociative*>(markovTable.indexingPolicy);
-  				if(thsa) { assert(thsa->ways >0); thsa->ways--; }
-  				else assert(0);
+  				assert(thsa->ways >0); thsa->ways--;
             	//rearrange conditionally
                 if(should_rearrange) {
 		    	if(current_size >0) {
@@ -231,7 +228,7 @@ Triage::calculatePrefetch(const PrefetchInfo &pfi,
 
 
 
-    		cachetags->setWayAllocationMax(cachetags->getWayAllocationMax()+1);
+    		llcWays.reserve(thsa->ways);
     	}
     	target_size = 0;
     	global_timestamp=0;
@@ -308,8 +305,7 @@ Triage::calculatePrefetch(const PrefetchInfo &pfi,
 
     // Update the entry
     if(entry != nullptr) {
-        entry->lastLastAddress = entry->lastAddress;
-    	entry->lastAddress = addr;
+        entry->pushAddress(addr, is_secure);
 
     }
 
@@ -319,9 +315,7 @@ Triage::calculatePrefetch(const PrefetchInfo &pfi,
 Triage::MarkovMapping*
 Triage::getHistoryEntry(Addr paddr, bool is_secure, bool add, bool readonly, bool temporal, bool clearing)
 {
-	    TriageHashedSetAssociative* thsa = dynamic_cast<TriageHashedSetAssociative*>(markovTable.indexingPolicy);
-	  				if(!thsa)  assert(0);
-    	cachetags->clearSetWay(thsa->extractSet(paddr)/maxWays, thsa->extractSet(paddr)%maxWays);
+    	llcWays.claim(thsa->extractSet(paddr));
     if(should_rearrange) {
 
 	    int index= paddr % (way_idx.size()); //Not quite the same indexing strategy, but close enough.
@@ -342,7 +336,7 @@ Triage::getHistoryEntry(Addr paddr, bool is_secure, bool add, bool readonly, boo
         if(!add) return nullptr;
         ps_entry = markovTable.findVictim(paddr);
         assert(ps_entry != nullptr);
-        if(!clearing) for(int x=0;x<64;x++) hawksets[x].decrementOnLRU(ps_entry->index,&trainingUnit);
+        if(!clearing) hawksets.decrementOnLRU(ps_entry->index,trainingUnit);
 	assert(!ps_entry->isValid());
         markovTable.insertEntry(paddr, is_secure, ps_entry);
         markovTable.weightedAccessEntry(ps_entry,temporal?1:0, true); //For RRIP, don't touch
@@ -354,43 +348,74 @@ Triage::getHistoryEntry(Addr paddr, bool is_secure, bool add, bool readonly, boo
 
 
 
-uint32_t
-TriageHashedSetAssociative::extractSet(const Addr addr) const
+void
+Triage::serialize(CheckpointOut &cp) const
 {
-	//Input is already blockIndex so no need to remove block again.
-    Addr offset = addr;
-
-   /* const Addr hash1 = offset & ((1<<16)-1);
-    const Addr hash2 = (offset >> 16) & ((1<<16)-1);
-        const Addr hash3 = (offset >> 32) & ((1<<16)-1);
-    */
-        offset = ((offset) * max_ways) + (extractTag(addr) % ways);
-        return offset & setMask;   //setMask is numSets-1
-
+	std::vector<uint64_t> geometry = {trainingUnit.entries.size(),
+		markovTable.entries.size(), (uint64_t)maxWays, bl.bytes};
+	SERIALIZE_CONTAINER(geometry);
+
+	SERIALIZE_SCALAR(global_timestamp);
+	SERIALIZE_SCALAR(current_size);
+	SERIALIZE_SCALAR(target_size);
+	int ways = thsa->ways;
+	SERIALIZE_SCALAR(ways);
+	SERIALIZE_CONTAINER(way_idx);
+	SERIALIZE_ARRAY(lookupTable, 1024);
+	SERIALIZE_ARRAY(lookupTick, 1024);
+	serializeBloom(cp, "bloom", bl);
+
+	serializeSet(cp, "trainingUnit", trainingUnit,
+		[](const TrainingUnitEntry &e, std::vector<uint64_t> &out) {
+			e.packHistory(out);
+			out.push_back(e.temporal);
+		});
+	serializeSet(cp, "markov", markovTable,
+		[](const MarkovMapping &am, std::vector<uint64_t> &out) {
+			out.insert(out.end(), {am.index, am.address,
+				(uint64_t)am.lookupIndex, am.confident});
+		});
+	hawksets.serializeSection(cp, "hawkeye");
 }
 
-
-Addr
-TriageHashedSetAssociative::extractTag(const Addr addr) const
+void
+Triage::unserialize(CheckpointIn &cp)
 {
-    //Input is already blockIndex so no need to remove block again.
-
-    //Description in Triage-ISR confuses whether the index is just the 16 least significant bits,
-    //or the weird index above. The tag can't be the remaining bits if we use the literal representation!
-
-
-    Addr offset = addr / (numSets/max_ways);
-    int result = 0;
-
-    const int shiftwidth=10;
-
-    for(int x=0; x<64; x+=shiftwidth) {
-       result ^= (offset & ((1<<shiftwidth)-1));
-       offset = offset >> shiftwidth;
-    }
-    return result;
+	std::vector<uint64_t> geometry = {trainingUnit.entries.size(),
+		markovTable.entries.size(), (uint64_t)maxWays, bl.bytes};
+	if(!checkpointGeometryMatches(cp, name(), geometry)) return;
+
+	UNSERIALIZE_SCALAR(global_timestamp);
+	UNSERIALIZE_SCALAR(current_size);
+	UNSERIALIZE_SCALAR(target_size);
+	int ways;
+	UNSERIALIZE_SCALAR(ways);
+	fatal_if(ways < 0 || ways > maxWays, "%s: checkpointed partition of %d ways\n",
+		name(), ways);
+	thsa->ways = ways;
+	thsa->max_ways = maxWays;
+	UNSERIALIZE_CONTAINER(way_idx);
+	UNSERIALIZE_ARRAY(lookupTable, 1024);
+	UNSERIALIZE_ARRAY(lookupTick, 1024);
+	unserializeBloom(cp, "bloom", bl);
+
+	unserializeSet(cp, "trainingUnit", trainingUnit, 3,
+		[](TrainingUnitEntry &e, const uint64_t *in) {
+			in = e.unpackHistory(in);
+			restoreCounter(e.temporal, *in);
+		});
+	unserializeSet(cp, "markov", markovTable, 4,
+		[](MarkovMapping &am, const uint64_t *in) {
+			am.index = in[0];
+			am.address = in[1];
+			am.lookupIndex = in[2];
+			am.confident = in[3];
+		});
+	hawksets.unserializeSection(cp, "hawkeye");
+
+	//The LLC still has every way, as nothing was partitioned before restoring.
+	llcWays.reserve(ways);
 }
 
-
 } // namespace prefetch
 } // namespace gem5
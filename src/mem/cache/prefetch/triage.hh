@@ -14,7 +14,9 @@
 #include "base/types.hh"
 #include "mem/cache/tags/base.hh"
 #include "mem/cache/prefetch/associative_set.hh"
+#include "mem/cache/prefetch/hawkeye_sampler.hh"
 #include "mem/cache/prefetch/queued.hh"
+#include "mem/cache/prefetch/temporal.hh"
 #include "mem/cache/replacement_policies/replaceable_entry.hh"
 #include "mem/cache/tags/indexing_policies/set_associative.hh"
 #include "mem/packet.hh"
@@ -35,26 +37,15 @@ GEM5_DEPRECATED_NAMESPACE(Prefetcher, prefetch);
 namespace prefetch
 {
 
-/**
- * Override the default set associative to apply a specific hash function
- * when extracting a set.
- */
-class TriageHashedSetAssociative : public SetAssociative
+/** Indexing of the Triage Markov table, see TemporalHashedSetAssociative */
+class TriageHashedSetAssociative : public TemporalHashedSetAssociative
 {
   public:
-    uint32_t extractSet(const Addr addr) const override;
-   protected:
-    Addr extractTag(const Addr addr) const override;
-
-  public:
-    int ways;
-    int max_ways;
     TriageHashedSetAssociative(
         const TriageHashedSetAssociativeParams &p)
-      : SetAssociative(p), ways(0),max_ways(8)
+      : TemporalHashedSetAssociative(p)
     {
     }
-    ~TriageHashedSetAssociative() = default;
 };
 
 
@@ -89,120 +80,34 @@ class Triage : public Queued
 
     std::vector<int> way_idx;
 
-    struct TrainingUnitEntry : public TaggedEntry
+    /** The address two accesses ago is only used for lookahead_two */
+    struct TrainingUnitEntry : public TemporalTrainingEntry<2>
     {
-        Addr lastAddress;
-        Addr lastLastAddress; //Not in base triage -- for option of lookahead-2
         SatCounter8  temporal;
 
-        TrainingUnitEntry() : lastAddress(0),lastLastAddress(0), temporal(4,8)
+        TrainingUnitEntry() : temporal(4,8)
         {}
 
         void
         invalidate() override
         {
-        	TaggedEntry::invalidate();
-                lastAddress = 0;
-                lastLastAddress = 0;
+        	TemporalTrainingEntry<2>::invalidate();
                 temporal.reset();
         }
 
 
     };
-    /** Map of PCs to Training unit entries */
-    AssociativeSet<TrainingUnitEntry> trainingUnit;
+    /** Map of PCs to Training unit entries, RRIP by default */
+    AssociativeSet<TrainingUnitEntry, replacement_policy::InlineBRRIP>
+        trainingUnit;
 
     Addr lookupTable[1024];
     uint64_t lookupTick[1024];
     const int lookupAssoc;
     const int lookupOffset;
 
-    struct Hawkeye
-    {
-      int iteration;
-      uint64_t set;
-      uint64_t setMask; // address_map_rounded_entries/ maxElems - 1
-      Addr logaddrs[64];
-      Addr logpcs[64];
-      int logsize[64];
-      int maxElems = 8;
-
-      Hawkeye(uint64_t mask) : iteration(0), set(0), setMask(mask)
-        {
-           reset();
-        }
-
-      Hawkeye() : iteration(0), set(0)
-        {       }
-
-      void reset() {
-        iteration=0;
-        for(int x=0;x<64;x++) {
-        	logsize[x]=0;
-        	logaddrs[x]=0;
-        	logpcs[x]=0;
-        }
-        set = random_mt.random<uint64_t>(0,setMask);
-      }
-
-      void decrementOnLRU(Addr addr,AssociativeSet<TrainingUnitEntry>* trainer) {
-      	 if((addr & setMask) != set) return;
-         for(int y=iteration;y!=((iteration+1)&63);y=(y-1)&63) {
-               if(addr==logaddrs[y]) {
-               	    Addr pc = logpcs[y];
-               	    TrainingUnitEntry *entry = trainer->findEntry(pc, false); //TODO: is secure
-               	    if(entry!=nullptr) {
-               	    	if(entry->temporal>=8) {
-               	    		entry->temporal--;
-               	    		//printf("%s evicted, pc %s, temporality %d\n",addr, pc,entry->temporal);
-               	    	}
-
-               	    }
-               	    return;
-               }
-         }
-      }
-
-      void add(Addr addr, Addr pc,AssociativeSet<TrainingUnitEntry>* trainer) {
-        if((addr & setMask) != set) return;
-        logaddrs[iteration]=addr;
-        logpcs[iteration]=pc;
-        logsize[iteration]=0;
-
-
-        TrainingUnitEntry *entry = trainer->findEntry(pc, false); //TODO: is secure
-        if(entry!=nullptr) {
-          for(int y=(iteration-1)&63;y!=iteration;y=(y-1)&63) {
-
-               if(logsize[y] == maxElems) {
-                 //no match
-                 //printf("%s above max elems, pc %s, temporality %d\n",addr, pc,entry->temporal-1);
-                 entry->temporal--;
-                 break;
-               }
-               if(addr==logaddrs[y]) {
-                 //found a match
-                 //printf("%s fits, pc %s, temporality %d\n",addr, pc,entry->temporal+1);
-                   entry->temporal++;
-                   for(int z=y;z!=iteration;z=(z+1)&63){
-                   	logsize[z]++;
-                   }
-
-                break;
-               }
-            }
-        }
-        iteration++;
-        iteration = iteration % 64;
-      }
-
-    };
-
-
-
-
-
-    Hawkeye hawksets[64];
+    /** OPTgen sampler training the temporal counter */
+    HawkeyeSampler<TrainingUnitEntry> hawksets;
 
     /** Address Mapping entry, holds an address and a confidence counter */
     struct MarkovMapping : public TaggedEntry
@@ -225,8 +130,13 @@ class Triage : public Queued
         }
     };
 
-    /** History mappings table */
-    AssociativeSet<MarkovMapping> markovTable;
+    /** History mappings table, WeightedLRU by default */
+    AssociativeSet<MarkovMapping, replacement_policy::InlineWeightedLRU>
+        markovTable;
+    /** Indexing policy of the Markov table, which holds the partition size */
+    TriageHashedSetAssociative* const thsa;
+    /** LLC ways taken by the Markov table */
+    LLCWayPartition llcWays;
 
     MarkovMapping* getHistoryEntry(Addr index, bool is_secure, bool replace, bool readonly, bool temporal, bool clearing);
 
@@ -236,6 +146,9 @@ class Triage : public Queued
 
     void calculatePrefetch(const PrefetchInfo &pfi,
                            std::vector<AddrPriority> &addresses) override;
+
+    void serialize(CheckpointOut &cp) const override;
+    void unserialize(CheckpointIn &cp) override;
 };
 
 } // namespace prefetch
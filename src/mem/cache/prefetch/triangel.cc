@@ -45,10 +45,15 @@
  */
 #include "mem/cache/prefetch/triangel.hh"
 
+#include "base/intmath.hh"
 #include "debug/HWPrefetch.hh"
+#include "mem/cache/base.hh"
 #include "mem/cache/prefetch/associative_set_impl.hh"
+#include "mem/cache/prefetch/temporal_checkpoint.hh"
+#include "params/TriangelMetadataStore.hh"
 #include "params/TriangelPrefetcher.hh"
 #include <cmath>
+#include <limits>
 
 
 namespace gem5
@@ -58,21 +63,625 @@ GEM5_DEPRECATED_NAMESPACE(Prefetcher, prefetch);
 namespace prefetch
 {
 
-int Triangel::target_size=0;
-int Triangel::current_size=0;
-int64_t Triangel::global_timestamp=0;
-AssociativeSet<Triangel::MarkovMapping>* Triangel::markovTablePtr=NULL;
-std::vector<uint32_t> Triangel::setPrefetch(17,0);
-Triangel::SizeDuel* Triangel::sizeDuelPtr=nullptr;
-bloom* Triangel::blptr = nullptr;
+namespace
+{
+
+/** Markov entries that fit in one LLC line under the configured encoding */
+unsigned
+markovEntriesPerLine(const TriangelMetadataStoreParams &p)
+{
+	if(p.address_map_actual_cache_assoc) return p.address_map_actual_cache_assoc;
+
+	const unsigned line_bits = p.block_size * 8;
+	//Every successor has its own confidence bit, and its recency
+	//position when there are several.
+	const unsigned successors = p.address_map_successors;
+	const unsigned per_successor = 1 + ceilLog2(successors);
+	auto entry_bits = [&](unsigned target_bits) {
+		return p.address_map_tag_bits + successors * (per_successor + target_bits);
+	};
+	switch(p.address_map_encoding) {
+	  case TriangelMarkovEncoding::full:
+		return line_bits / entry_bits(p.address_map_target_bits);
+	  case TriangelMarkovEncoding::lookup_table:
+		return line_bits / entry_bits(ceilLog2(1024) + p.lookup_offset);
+	  case TriangelMarkovEncoding::delta:
+		fatal_if(p.address_map_delta_bits == 0 || p.address_map_delta_bits >= 64,
+			"%s: delta encoding needs 1 to 63 delta bits\n", p.name);
+		return line_bits / entry_bits(p.address_map_delta_bits);
+	  case TriangelMarkovEncoding::page_shared:
+		fatal_if(p.address_map_page_bits >= p.address_map_target_bits,
+			"%s: page_shared needs fewer page bits than target bits\n", p.name);
+		return (line_bits - (p.address_map_target_bits - p.address_map_page_bits))
+			/ entry_bits(p.address_map_page_bits);
+	  default:
+		panic("%s: unknown Markov encoding\n", p.name);
+	}
+}
+
+} // anonymous namespace
+
+TriangelMetadataStore::TriangelMetadataStore(
+    const TriangelMetadataStoreParams &p)
+  : SimObject(p),
+    cachetags(p.cachetags),
+    encoding(p.address_map_encoding),
+    numSuccessors(p.address_map_successors),
+    entriesPerLine(markovEntriesPerLine(p)),
+    deltaBits(p.address_map_delta_bits),
+    pageBits(p.address_map_page_bits),
+    max_size(p.address_map_rounded_entries / p.address_map_rounded_cache_assoc * entriesPerLine),
+    size_increment(max_size/p.address_map_max_ways),
+    maxWays(p.address_map_max_ways),
+    global_timestamp(0),
+    current_size(0),
+    target_size(0),
+    setPrefetch(cachetags->getWayAllocationMax()+1,0),
+    sizing(max_size, p.sizing_sample_slices, p.sizing_lifetime),
+    way_idx(max_size/(p.address_map_max_ways*entriesPerLine),0),
+    markovTable(p.address_map_rounded_cache_assoc,
+                          p.address_map_rounded_entries,
+                          p.address_map_cache_indexing_policy,
+                          p.address_map_cache_replacement_policy,
+                          MarkovMapping()),
+    lookupAssoc(p.lookup_assoc),
+    lookupOffset(p.lookup_offset),
+    thsa(dynamic_cast<TriangelHashedSetAssociative*>(p.address_map_cache_indexing_policy)),
+    llcAssoc(cachetags->getWayAllocationMax()),
+    rearrangeSetsPerAccess(p.rearrange_sets_per_access),
+    migrationOldWays(0),
+    migrationCursor(-1),
+    llcWays(cachetags, maxWays),
+    qosPartitioning(p.qos_partitioning),
+    qosMinEntries(p.qos_min_entries),
+    stats(this)
+{
+	fatal_if(!thsa, "%s: the Markov table must use TriangelHashedSetAssociative indexing\n", name());
+	fatal_if(numSuccessors == 0 || numSuccessors > MaxSuccessors,
+		"%s: Markov entries hold 1 to %d successors\n", name(), MaxSuccessors);
+	fatal_if(entriesPerLine == 0 || entriesPerLine > p.address_map_rounded_cache_assoc,
+		"%s: %d Markov entries per line do not fit the %d-way table; "
+		"raise address_map_rounded_cache_assoc/entries to match, as "
+		"--triangelencoding does\n",
+		name(), entriesPerLine, p.address_map_rounded_cache_assoc);
+	fatal_if(p.address_map_actual_entries && p.address_map_actual_entries != max_size,
+		"%s: address_map_actual_entries should be %d for %d entries per line\n",
+		name(), max_size, entriesPerLine);
+	fatal_if((encoding == TriangelMarkovEncoding::lookup_table) != (lookupAssoc > 0),
+		"%s: lookup_assoc must be set exactly when using the lookup_table encoding\n",
+		name());
+	fatal_if(lookupAssoc > 0 && 1024 % lookupAssoc != 0,
+		"%s: lookup_assoc must divide the 1024-entry lookup table\n", name());
+	markovTable.setWayAllocationMax(entriesPerLine);
+	victimLine.reserve(p.address_map_rounded_cache_assoc);
+	victimCandidates.reserve(p.address_map_rounded_cache_assoc);
+	fatal_if(cachetags->getWayAllocationMax() <= maxWays,
+		"%s: the Markov table cannot take every way of the LLC\n", name());
+	for(int x=0;x<numSizeDuels;x++) {
+		sizeDuels[x].reset(size_increment/entriesPerLine - 1 ,entriesPerLine,cachetags->getWayAllocationMax());
+	}
+	duelSetMask = sizeDuels[0].setMask;
+	duelledSets.resize(duelSetMask+1, false);
+	for(int x=0;x<numSizeDuels;x++) duelledSets[sizeDuels[x].set] = true;
+	for(int x=0;x<1024;x++) {
+		lookupTable[x]=0;
+		lookupTick[x]=0;
+	}
+}
+
+void
+TriangelMetadataStore::regStats()
+{
+	SimObject::regStats();
+	const size_t num_tenants = std::max<size_t>(tenants.size(), 1);
+	stats.tenantShare.init(num_tenants);
+	stats.tenantInsertions.init(num_tenants);
+	stats.successorHits.init(numSuccessors);
+	for(size_t t=0;t<tenants.size();t++) {
+		stats.tenantShare.subname(t, tenants[t].name);
+		stats.tenantInsertions.subname(t, tenants[t].name);
+	}
+}
+
+int
+TriangelMetadataStore::addTenant(const std::string &name)
+{
+	Tenant tenant;
+	tenant.name = name;
+	tenant.duels.assign(sizeDuels, sizeDuels + numSizeDuels);
+	tenant.utility.assign(setPrefetch.size(), 0);
+	tenants.push_back(tenant);
+	victimHeld.assign(tenants.size(), 0);
+	fatal_if(qosPartitioning && tenants.size() > entriesPerLine,
+		"%s: %d tenants cannot share %d-entry Markov lines\n",
+		this->name(), tenants.size(), entriesPerLine);
+	equalShares();
+	return tenants.size() - 1;
+}
+
+void
+TriangelMetadataStore::equalShares()
+{
+	for(size_t t=0;t<tenants.size();t++) {
+		tenants[t].share = entriesPerLine / tenants.size()
+			+ (t < entriesPerLine % tenants.size());
+	}
+}
+
+void
+TriangelMetadataStore::rebalanceTenants()
+{
+	if(!qosPartitioning || tenants.empty()) return;
+	stats.rebalances++;
+
+	const unsigned num_tenants = tenants.size();
+	const unsigned min_entries = std::min<unsigned>(qosMinEntries, entriesPerLine / num_tenants);
+	for(Tenant &t : tenants) t.share = min_entries;
+
+	//Holding n entries of every line is worth what n/entriesPerLine of the
+	//current partition would be to the tenant on its own.
+	const unsigned ways = thsa->ways;
+	auto utility = [&](const Tenant &t, unsigned entries) {
+		const size_t size = (entries * ways + entriesPerLine - 1) / entriesPerLine;
+		return t.utility[std::min(size, t.utility.size() - 1)];
+	};
+	for(unsigned left = entriesPerLine - min_entries*num_tenants; left > 0; left--) {
+		//Equal gains go to the tenant holding least, which splits evenly
+		//when nobody's duellers see a benefit.
+		Tenant *best = nullptr;
+		int64_t best_gain = -1;
+		for(Tenant &t : tenants) {
+			const int64_t gain = (int64_t)utility(t, t.share + 1) - utility(t, t.share);
+			if(gain > best_gain || (gain == best_gain && t.share < best->share)) {
+				best = &t;
+				best_gain = gain;
+			}
+		}
+		best->share++;
+	}
+
+	for(unsigned t=0;t<num_tenants;t++) {
+		stats.tenantShare[t] = tenants[t].share;
+		std::fill(tenants[t].utility.begin(), tenants[t].utility.end(), 0);
+	}
+}
+
+TriangelMetadataStore::MarkovMapping*
+TriangelMetadataStore::findVictim(Addr index, int tenant)
+{
+	if(!qosPartitioning || tenants.size() < 2) return markovTable.findVictim(index);
+
+	markovTable.getPossibleEntries(index, victimLine);
+	std::fill(victimHeld.begin(), victimHeld.end(), 0);
+	for(MarkovMapping* am : victimLine) {
+		if(!am->isValid()) return am;
+		//Entries restored from a run with more tenants belong to nobody.
+		if(am->owner >= 0 && am->owner < tenants.size()) victimHeld[am->owner]++;
+	}
+
+	auto over_share = [&](const MarkovMapping* am) {
+		return am->owner < 0 || am->owner >= tenants.size()
+			|| victimHeld[am->owner] > tenants[am->owner].share;
+	};
+	const bool at_share = victimHeld[tenant] > 0 && victimHeld[tenant] >= tenants[tenant].share;
+	victimCandidates.clear();
+	for(MarkovMapping* am : victimLine) {
+		if(at_share ? am->owner == tenant : over_share(am)) victimCandidates.push_back(am);
+	}
+	//Shares changed since the line was filled and nobody is over theirs yet.
+	if(victimCandidates.empty()) victimCandidates = victimLine;
+
+	MarkovMapping* victim = markovTable.findVictim(victimCandidates);
+	if(victim->owner != tenant) stats.crossTenantEvictions++;
+	return victim;
+}
+
+void
+TriangelMetadataStore::duel(Addr addr, bool should_pf, int num_duellers, int pf_weight,
+                            int tenant)
+{
+	//Only a handful of LLC sets are sampled, so most accesses stop here.
+	if(!duelledSets[addr & duelSetMask]) return;
+
+	assert(num_duellers <= numSizeDuels);
+	const int ratioDenom=4;//should_pf && entry->highPatternConfidence >=upperHistory? 4 : 8;
+	for(int x=0;x<num_duellers;x++) {
+		int res = sizeDuels[x].checkAndInsert(addr,should_pf);
+		if(res==0)continue;
+		creditDuel(setPrefetch, res, (pf_weight*sizeDuels[x].temporalModMax)/ratioDenom);
+	}
+
+	//Each tenant's own duellers only see its accesses, so their prefetch
+	//hits measure what a share of the table is worth to that tenant alone.
+	if(!qosPartitioning || !should_pf) return;
+	Tenant &t = tenants[tenant];
+	for(int x=0;x<num_duellers;x++) {
+		int pref_hit = t.duels[x].checkAndInsert(addr,true)/128;
+		if(pref_hit)for(int y=pref_hit;y<t.utility.size();y++) t.utility[y]+=(pf_weight*t.duels[x].temporalModMax)/ratioDenom;
+	}
+}
+
+void
+TriangelMetadataStore::serialize(CheckpointOut &cp) const
+{
+	std::vector<uint64_t> geometry = {markovTable.entries.size(),
+		entriesPerLine, (uint64_t)maxWays, (uint64_t)encoding, numSuccessors,
+		setPrefetch.size(), sizing.size(), MarkovMapping::packedWords};
+	SERIALIZE_CONTAINER(geometry);
+
+	SERIALIZE_SCALAR(global_timestamp);
+	SERIALIZE_SCALAR(current_size);
+	SERIALIZE_SCALAR(target_size);
+	SERIALIZE_SCALAR(migrationOldWays);
+	SERIALIZE_SCALAR(migrationCursor);
+	int ways = thsa->ways;
+	SERIALIZE_SCALAR(ways);
+	SERIALIZE_CONTAINER(setPrefetch);
+	SERIALIZE_CONTAINER(way_idx);
+	SERIALIZE_ARRAY(lookupTable, 1024);
+	SERIALIZE_ARRAY(lookupTick, 1024);
+
+	std::vector<uint64_t> duels;
+	for(int x=0;x<numSizeDuels;x++) sizeDuels[x].pack(duels);
+	SERIALIZE_CONTAINER(duels);
+
+	std::vector<uint64_t> tenant_shares, tenant_utility, tenant_duels;
+	for(const Tenant &t : tenants) {
+		tenant_shares.push_back(t.share);
+		tenant_utility.insert(tenant_utility.end(), t.utility.begin(), t.utility.end());
+		for(const SizeDuel &sd : t.duels) sd.pack(tenant_duels);
+	}
+	SERIALIZE_CONTAINER(tenant_shares);
+	SERIALIZE_CONTAINER(tenant_utility);
+	SERIALIZE_CONTAINER(tenant_duels);
+	sizing.serializeSection(cp, "sizing");
+
+	serializeSet(cp, "markov", markovTable,
+		[](const MarkovMapping &am, std::vector<uint64_t> &out) { am.pack(out); });
+}
+
+void
+TriangelMetadataStore::unserialize(CheckpointIn &cp)
+{
+	std::vector<uint64_t> geometry = {markovTable.entries.size(),
+		entriesPerLine, (uint64_t)maxWays, (uint64_t)encoding, numSuccessors,
+		setPrefetch.size(), sizing.size(), MarkovMapping::packedWords};
+	if(!checkpointGeometryMatches(cp, name(), geometry)) return;
+
+	UNSERIALIZE_SCALAR(global_timestamp);
+	UNSERIALIZE_SCALAR(current_size);
+	UNSERIALIZE_SCALAR(target_size);
+	UNSERIALIZE_SCALAR(migrationOldWays);
+	UNSERIALIZE_SCALAR(migrationCursor);
+	int ways;
+	UNSERIALIZE_SCALAR(ways);
+	fatal_if(ways < 0 || ways > maxWays, "%s: checkpointed partition of %d ways\n",
+		name(), ways);
+	thsa->ways = ways;
+	thsa->max_ways = maxWays;
+	UNSERIALIZE_CONTAINER(setPrefetch);
+	UNSERIALIZE_CONTAINER(way_idx);
+	UNSERIALIZE_ARRAY(lookupTable, 1024);
+	UNSERIALIZE_ARRAY(lookupTick, 1024);
+
+	const uint64_t duel_words = SizeDuel::packedWords(llcAssoc);
+	std::vector<uint64_t> duels;
+	UNSERIALIZE_CONTAINER(duels);
+	fatal_if(duels.size() != numSizeDuels * duel_words,
+		"%s: checkpoint holds a different number of set duellers\n", name());
+	std::fill(duelledSets.begin(), duelledSets.end(), false);
+	for(int x=0;x<numSizeDuels;x++) {
+		sizeDuels[x].unpack(&duels[x * duel_words]);
+		duelledSets[sizeDuels[x].set & duelSetMask] = true;
+	}
+
+	//Tenants are only restored if the same prefetchers share the table.
+	std::vector<uint64_t> tenant_shares, tenant_utility, tenant_duels;
+	if(cp.entryExists(Serializable::currentSection(), "tenant_shares")) {
+		UNSERIALIZE_CONTAINER(tenant_shares);
+		UNSERIALIZE_CONTAINER(tenant_utility);
+		UNSERIALIZE_CONTAINER(tenant_duels);
+	}
+	if(tenant_shares.size() == tenants.size()
+	   && tenant_utility.size() == tenants.size() * setPrefetch.size()
+	   && tenant_duels.size() == tenants.size() * numSizeDuels * duel_words) {
+		for(size_t t=0;t<tenants.size();t++) {
+			Tenant &tenant = tenants[t];
+			tenant.share = tenant_shares[t];
+			std::copy_n(&tenant_utility[t * setPrefetch.size()],
+				setPrefetch.size(), tenant.utility.begin());
+			for(int x=0;x<numSizeDuels;x++) {
+				tenant.duels[x].unpack(
+					&tenant_duels[(t * numSizeDuels + x) * duel_words]);
+			}
+		}
+	} else if(!tenants.empty()) {
+		warn("%s: checkpoint was taken with different tenants, "
+		     "splitting the table evenly\n", name());
+		equalShares();
+	}
+	sizing.unserializeSection(cp, "sizing");
+
+	unserializeSet(cp, "markov", markovTable, MarkovMapping::packedWords,
+		[](MarkovMapping &am, const uint64_t *in) { am.unpack(in); });
+
+	//Mid-migration, the LLC has not yet got back the ways being vacated.
+	const int held = std::max(ways, migrationCursor >= 0 ? migrationOldWays : 0);
+	llcWays.reserve(held);
+}
+
+TriangelMetadataStore::StatGroup::StatGroup(statistics::Group *parent)
+  : statistics::Group(parent),
+    ADD_STAT(resizes, statistics::units::Count::get(),
+        "number of Markov table partition size changes"),
+    ADD_STAT(migratedSets, statistics::units::Count::get(),
+        "number of Markov sets walked after a resize"),
+    ADD_STAT(migratedEntries, statistics::units::Count::get(),
+        "number of Markov entries moved to a new set after a resize"),
+    ADD_STAT(oldGeometryHits, statistics::units::Count::get(),
+        "number of Markov lookups served from the pre-resize geometry"),
+    ADD_STAT(encodingFailures, statistics::units::Count::get(),
+        "number of correlations dropped as the encoding could not hold them"),
+    ADD_STAT(lookupReplacements, statistics::units::Count::get(),
+        "number of lookup table slots reassigned to new upper bits"),
+    ADD_STAT(rebalances, statistics::units::Count::get(),
+        "number of times the Markov lines were re-split between tenants"),
+    ADD_STAT(crossTenantEvictions, statistics::units::Count::get(),
+        "number of Markov entries replaced by a tenant that did not own them"),
+    ADD_STAT(tenantShare, statistics::units::Count::get(),
+        "entries per Markov line given to each tenant at the last rebalance"),
+    ADD_STAT(tenantInsertions, statistics::units::Count::get(),
+        "number of Markov entries inserted by each tenant"),
+    ADD_STAT(successorHits, statistics::units::Count::get(),
+        "number of trained targets found at each successor position"),
+    ADD_STAT(successorPrefetches, statistics::units::Count::get(),
+        "number of prefetches issued to other than the first successor")
+{
+}
+
+void
+TriangelMetadataStore::updateLLCWays()
+{
+	//The LLC gets back every way the Markov table isn't using.
+	llcWays.reserve(thsa->ways);
+}
+
+void
+TriangelMetadataStore::resize(int new_ways, bool rearrange)
+{
+	assert(new_ways >= 0 && new_ways <= maxWays);
+	//A new resize can only start from a consistent table.
+	finishMigration();
+	stats.resizes++;
+
+	const int old_ways = thsa->ways;
+	thsa->ways = new_ways;
+	thsa->max_ways = maxWays;
+
+	if(!rearrange || old_ways == 0 || new_ways == 0) {
+		//Nothing to keep: drop whatever now sits in ways that went back to the LLC.
+		for(MarkovMapping& am: markovTable) {
+		    if(am.isValid() && (new_ways==0 || (am.getSet() % maxWays) >= new_ways)) markovTable.invalidate(&am);
+		}
+		updateLLCWays();
+		return;
+	}
+
+	//Growing takes the ways from the LLC now, as new entries need them.
+	//Shrinking hands them back once the entries in them have been moved.
+	if(new_ways > old_ways) updateLLCWays();
+
+	migrationOldWays = old_ways;
+	migrationCursor = 0;
+	if(rearrangeSetsPerAccess == 0) finishMigration();
+}
+
+void
+TriangelMetadataStore::migrate(unsigned num_sets)
+{
+	if(migrationCursor < 0) return;
+
+	const uint64_t num_markov_sets = markovTable.numEntries / thsa->assoc;
+	for(unsigned x=0; x<num_sets && migrationCursor < num_markov_sets; x++) {
+		migrateSet(migrationCursor++);
+	}
+
+	if(migrationCursor >= num_markov_sets) {
+		migrationCursor = -1;
+		updateLLCWays();
+	}
+}
+
+void
+TriangelMetadataStore::finishMigration()
+{
+	migrate(std::numeric_limits<unsigned>::max());
+}
+
+void
+TriangelMetadataStore::migrateSet(uint64_t set)
+{
+	stats.migratedSets++;
+	//Sets in ways the table never covered hold nothing.
+	if((set % maxWays) >= std::max(migrationOldWays, thsa->ways)) return;
+
+	const unsigned assoc = thsa->assoc;
+	for(unsigned way=0; way<assoc; way++) {
+		MarkovMapping* am = &markovTable.entries[set*assoc + way];
+		if(!am->isValid() || thsa->extractSet(am->index) == set) continue;
+		relocate(am);
+	}
+}
+
+TriangelMetadataStore::MarkovMapping*
+TriangelMetadataStore::relocate(MarkovMapping* entry)
+{
+	MarkovMapping moved = *entry;
+	markovTable.invalidate(entry);
+
+	llcWays.claim(thsa->extractSet(moved.index));
+	MarkovMapping *mapping = findVictim(moved.index, moved.owner);
+	assert(mapping != nullptr);
+	markovTable.insertEntry(moved.index, moved.isSecure(), mapping);
+	mapping->owner = moved.owner;
+	mapping->copySuccessors(moved);
+	mapping->index = moved.index;
+	markovTable.weightedAccessEntry(mapping,1,false); //For RRIP, touch
+	stats.migratedEntries++;
+	return mapping;
+}
+
+TriangelMetadataStore::MarkovMapping*
+TriangelMetadataStore::findEntry(Addr index, bool is_secure)
+{
+	MarkovMapping *entry = markovTable.findEntry(index, is_secure);
+	if(entry != nullptr || migrationCursor < 0) return entry;
+
+	//Not found where the new geometry puts it, so it may not have been moved yet.
+	const int new_ways = thsa->ways;
+	thsa->ways = migrationOldWays;
+	entry = markovTable.findEntry(index, is_secure);
+	thsa->ways = new_ways;
+	if(entry == nullptr) return nullptr;
+
+	stats.oldGeometryHits++;
+	return relocate(entry);
+}
+
+bool
+TriangelMetadataStore::canEncode(Addr index, Addr target)
+{
+	bool fits = true;
+	switch(encoding) {
+	  case TriangelMarkovEncoding::delta: {
+		const int64_t delta = target - index;
+		const int64_t limit = int64_t(1) << (deltaBits - 1);
+		fits = delta >= -limit && delta < limit;
+		break;
+	  }
+	  case TriangelMarkovEncoding::page_shared: {
+		//Every other target in the line must share the target's upper bits.
+		//With one successor, the entry's own target is the one replaced.
+		const uint64_t set = thsa->extractSet(index);
+		for(int x=0;x<thsa->assoc && fits;x++) {
+			const MarkovMapping &other = markovTable.entries[set*thsa->assoc + x];
+			if(!other.isValid() || (numSuccessors == 1 && other.index == index)) continue;
+			for(const Successor &succ : other.successors) {
+				if(succ.valid && (succ.address >> pageBits) != (target >> pageBits)) {
+					fits = false;
+					break;
+				}
+			}
+		}
+		break;
+	  }
+	  default:
+		break;
+	}
+	if(!fits) stats.encodingFailures++;
+	return fits;
+}
+
+void
+TriangelMetadataStore::encode(Successor &successor)
+{
+	if(encoding != TriangelMarkovEncoding::lookup_table) return;
+
+	const Addr target = successor.address;
+	int index=0;
+	uint64_t time = -1;
+	int lookupMask = (1024/lookupAssoc)-1;
+	int set = (target>>lookupOffset)&lookupMask;
+	bool found = false;
+	for(int x=lookupAssoc*set;x<lookupAssoc*(set+1);x++) {
+		if(target>>lookupOffset == lookupTable[x]) {
+			index=x;
+			found = true;
+			break;
+		}
+		if(time > lookupTick[x]) {
+			time = lookupTick[x];
+			index=x;
+		}
+	}
+	if(!found && lookupTick[index] != 0) stats.lookupReplacements++;
+
+	lookupTable[index]=target>>lookupOffset;
+	lookupTick[index]=curTick();
+	successor.lookupIndex=index;
+}
+
+Addr
+TriangelMetadataStore::decode(const Successor &successor)
+{
+	if(encoding != TriangelMarkovEncoding::lookup_table) return successor.address;
+
+	//Entries keep the full address in simulation; rebuild what hardware
+	//would see, which is wrong if the slot was since reassigned.
+	int index=successor.lookupIndex;
+	int lookupMask = (1<<lookupOffset)-1;
+	lookupTick[index]=curTick();
+	return (lookupTable[index]<<lookupOffset) + ((successor.address)&lookupMask);
+}
+
+bool
+TriangelMetadataStore::train(MarkovMapping* mapping, Addr target)
+{
+	Successor *succ = mapping->successors;
+	for(unsigned x=0;x<numSuccessors;x++) {
+		if(!succ[x].valid || succ[x].address != target) continue;
+		stats.successorHits[x]++;
+		const bool was_confident = succ[x].confident;
+		Successor hit = succ[x];
+		hit.confident = true;
+		std::copy_backward(succ, succ + x, succ + x + 1);
+		succ[0] = hit;
+		encode(succ[0]);
+		return was_confident;
+	}
+
+	//An empty slot is filled as if the target had always been there, as a
+	//newly inserted entry was with a single successor.
+	int victim = -1;
+	bool fresh = false;
+	for(unsigned x=0;x<numSuccessors;x++) {
+		if(!succ[x].valid) {
+			victim = x;
+			fresh = true;
+			break;
+		}
+	}
+	for(int x=numSuccessors-1;x>=0 && victim<0;x--) {
+		if(!succ[x].confident) victim = x;
+	}
+	if(victim < 0) {
+		succ[numSuccessors-1].confident = false;
+		return false;
+	}
+
+	std::copy_backward(succ, succ + victim, succ + victim + 1);
+	succ[0].address = target;
+	succ[0].confident = fresh;
+	succ[0].valid = true;
+	encode(succ[0]);
+	return false;
+}
 
 Triangel::Triangel(
     const TriangelPrefetcherParams &p)
   : Queued(p),
     degree(p.degree),
-    cachetags(p.cachetags),
+    prefetchSuccessors(p.prefetch_successors),
+    metadata(p.metadata),
+    tenant(metadata->addTenant(name())),
+    cachetags(metadata->cachetags),
     cacheDelay(p.cache_delay),
     should_lookahead(p.should_lookahead),
+    maxLookahead(p.max_lookahead),
+    adaptiveLookahead(p.adaptive_lookahead),
+    throttling(p.throttling),
+    mshrThreshold(p.throttle_mshr_threshold),
+    throttleCache(p.throttle_cache),
     should_rearrange(p.should_rearrange),
     use_scs(p.use_scs),
     use_bloom(p.use_bloom),
@@ -85,25 +694,18 @@ Triangel::Triangel(
     timed_scs(p.timed_scs),
     useSampleConfidence(p.useSampleConfidence),    
     sctags(p.sctags),
-    max_size(p.address_map_actual_entries),
-    size_increment(p.address_map_actual_entries/p.address_map_max_ways),
+    max_size(metadata->max_size),
+    size_increment(metadata->size_increment),
     second_chance_timestamp(0),
-    //global_timestamp(0),
-    //current_size(0),
-    //target_size(0),
-    maxWays(p.address_map_max_ways),    
-    bl(),
-    bloomset(-1),
-    way_idx(p.address_map_actual_entries/(p.address_map_max_ways*p.address_map_actual_cache_assoc),0),
+    maxWays(metadata->maxWays),    
     globalReuseConfidence(7,64),
     globalPatternConfidence(7,64),
     globalHighPatternConfidence(7,64),
     trainingUnit(p.training_unit_assoc, p.training_unit_entries,
                  p.training_unit_indexing_policy,
                  p.training_unit_replacement_policy),
-    lookupAssoc(p.lookup_assoc),
-    lookupOffset(p.lookup_offset),        
     //setPrefetch(cachetags->getWayAllocationMax()+1,0),      
+    hawksets(this, &TrainingUnitEntry::hawkConfidence),
     useHawkeye(p.use_hawkeye),
     historySampler(p.sample_assoc,
     		  p.sample_entries,
@@ -113,43 +715,603 @@ Triangel::Triangel(
     		  p.secondchance_entries,
     		  p.secondchance_indexing_policy,
     		  p.secondchance_replacement_policy),
-    markovTable(p.address_map_rounded_cache_assoc,
-                          p.address_map_rounded_entries,
-                          p.address_map_cache_indexing_policy,
-                          p.address_map_cache_replacement_policy,
-                          MarkovMapping()),                   
+    markovTablePtr(&metadata->markovTable),
     metadataReuseBuffer(p.metadata_reuse_assoc,
                           p.metadata_reuse_entries,
                           p.metadata_reuse_indexing_policy,
                           p.metadata_reuse_replacement_policy,
                           MarkovMapping()),
-    lastAccessFromPFCache(false)
+    lastAccessFromPFCache(false),
+    metadataPrefetchDegree(p.metadata_prefetch_degree),
+    confidenceHints(p.confidence_hints),
+    mrbStats(this),
+    metadataPort(name() + ".metadata_port", *this),
+    metadataRequestorId(p.sys->getRequestorId(this, "metadata")),
+    metadataBaseAddr(p.metadata_base_addr),
+    metadataTimingStats(this),
+    lookaheadStats(this, maxLookahead),
+    throttleStats(this, degree),
+    shadows(p.shadows.begin(), p.shadows.end()),
+    shadowScoreEntries(p.shadow_score_entries),
+    globalHistory(p.global_history),
+    ghbDegree(p.ghb_degree),
+    ghbWays(p.ghb_ways),
+    ghbEntriesPerLine(blkSize * 8 / p.address_map_target_bits),
+    ghbLLCSets(metadata->size_increment / metadata->entriesPerLine),
+    ghbIndex(p.ghb_index_assoc, p.ghb_index_entries,
+             p.ghb_index_indexing_policy, p.ghb_index_replacement_policy),
+    ghb(globalHistory ? ghbWays * ghbLLCSets * ghbEntriesPerLine : 0, 0),
+    ghbHead(0),
+    ghbPartition(cachetags, ghbWays),
+    ghbStats(this),
+    structuralAddresses(p.structural_addresses),
+    structuralMap(p.structural_chunk_size, p.structural_entries_per_line,
+                  p.structural_counter_bits, p.structural_map_assoc,
+                  p.structural_map_entries,
+                  p.ps_structural_map_indexing_policy,
+                  p.ps_structural_map_replacement_policy,
+                  p.sp_structural_map_indexing_policy,
+                  p.sp_structural_map_replacement_policy),
+    structuralStats(this)
 {	
-	markovTablePtr = &markovTable;
+	fatal_if(globalHistory && (ghbWays == 0 || ghbEntriesPerLine == 0),
+		"%s: the global history buffer needs at least one way of lines\n", name());
+	fatal_if(maxLookahead < 1 || maxLookahead > MaxLookahead,
+		"%s: max_lookahead must be between 1 and %d\n", name(), MaxLookahead);
+	if(throttling) {
+		fatal_if(!isPowerOf2(p.issued_prefetch_entries),
+			"%s: issued_prefetch_entries must be a power of 2\n", name());
+		issuedTable.assign(p.issued_prefetch_entries, {MaxAddr, 0, false});
+	}
+	hawksets.reset(max_size);
+	for(Triangel* shadow : shadows) {
+		fatal_if(shadow->metadata == metadata,
+			"%s: shadow %s must have its own metadata store\n",
+			name(), shadow->name());
+		shadow->makeShadow();
+	}
+}
 
-	setPrefetch.resize(cachetags->getWayAllocationMax()+1,0);
-	assert(p.address_map_rounded_entries / p.address_map_rounded_cache_assoc == p.address_map_actual_entries / p.address_map_actual_cache_assoc);
-	markovTable.setWayAllocationMax(p.address_map_actual_cache_assoc);
-	assert(cachetags->getWayAllocationMax()> maxWays);
-	int bloom_size = p.address_map_actual_entries/128 < 1024? 1024: p.address_map_actual_entries/128;
-	assert(bloom_init2(&bl,bloom_size, 0.01)==0);
-	blptr = &bl;
-	for(int x=0;x<64;x++) {
-		hawksets[x].setMask = p.address_map_actual_entries/ hawksets[x].maxElems;
-		hawksets[x].reset();
+void
+Triangel::init()
+{
+	Queued::init();
+	//Prefetches released by metadata reads are queued without the access
+	//that found them, so have no request to translate through.
+	fatal_if(useVirtualAddresses && timedMetadata(),
+		"%s: timed metadata accesses need physical addresses\n", name());
+	//Unused prefetches are reported by physical address, so would never
+	//match the virtual blocks the degree is trained on.
+	fatal_if(useVirtualAddresses && throttling,
+		"%s: throttling needs physical addresses\n", name());
+	//Shadows were detached from the LLC when their primary was built.
+	if(globalHistory && !shadowStats) {
+		//The history takes the top ways, and the Markov table moves below it.
+		const int first = metadata->llcWays.yieldTopWays(ghbWays);
+		fatal_if(metadata->llcAssoc <= metadata->maxWays + first + (int)ghbWays,
+			"%s: the Markov table and history buffers cannot take every way of the LLC\n",
+			name());
+		ghbPartition.moveTo(first);
+		ghbPartition.reserve(ghbWays);
 	}
-		sizeDuelPtr= sizeDuels;	
-	for(int x=0;x<64;x++) {
-		sizeDuelPtr[x].reset(size_increment/p.address_map_actual_cache_assoc - 1 ,p.address_map_actual_cache_assoc,cachetags->getWayAllocationMax());
+}
+
+Port &
+Triangel::getPort(const std::string &if_name, PortID idx)
+{
+	if(if_name == "metadata_port") return metadataPort;
+	return Queued::getPort(if_name, idx);
+}
+
+Triangel::MetadataTimingStats::MetadataTimingStats(statistics::Group *parent)
+  : statistics::Group(parent, "metadataTiming"),
+    ADD_STAT(reads, statistics::units::Count::get(),
+        "number of timed Markov reads sent to the LLC"),
+    ADD_STAT(writes, statistics::units::Count::get(),
+        "number of timed Markov updates sent to the LLC"),
+    ADD_STAT(readLatency, statistics::units::Tick::get(),
+        "total ticks spent waiting for timed Markov reads"),
+    ADD_STAT(avgReadLatency, statistics::units::Rate<
+                statistics::units::Tick, statistics::units::Count>::get(),
+        "average latency of a timed Markov read", readLatency / reads),
+    ADD_STAT(retries, statistics::units::Count::get(),
+        "number of metadata accesses the LLC asked to retry")
+{
+}
+
+Triangel::LookaheadStats::LookaheadStats(statistics::Group *parent,
+                                         unsigned max_lookahead)
+  : statistics::Group(parent, "lookahead"),
+    ADD_STAT(latePrefetches, statistics::units::Count::get(),
+        "number of prefetches dropped as their block was already in flight"),
+    ADD_STAT(timelyPrefetches, statistics::units::Count::get(),
+        "number of demand hits on blocks prefetched in time"),
+    ADD_STAT(distanceIncreases, statistics::units::Count::get(),
+        "number of times a PC's lookahead distance grew"),
+    ADD_STAT(distanceDecreases, statistics::units::Count::get(),
+        "number of times a PC's lookahead distance shrank"),
+    ADD_STAT(distance, statistics::units::Count::get(),
+        "lookahead distance used by each trained access")
+{
+    distance.init(1, max_lookahead, 1);
+}
+
+void
+Triangel::trainLookahead(TrainingUnitEntry *entry, bool late)
+{
+	if(late) {
+		entry->lateness++;
+		if(!entry->lateness.isSaturated()) return;
+		if(entry->lookahead < maxLookahead) {
+			entry->lookahead++;
+			lookaheadStats.distanceIncreases++;
+		}
+	} else {
+		entry->lateness--;
+		if(entry->lateness != 0) return;
+		//Never drop below the two-distance lookahead we start from:
+		//further ahead costs accuracy, but nearer is rarely in time.
+		if(entry->lookahead > initialLookahead()) {
+			entry->lookahead--;
+			lookaheadStats.distanceDecreases++;
+		}
 	}
+	entry->lateness.reset();
+}
 
-	for(int x=0;x<1024;x++) {
-		lookupTable[x]=0;
-    		lookupTick[x]=0;
-	}	
-	current_size = 0;
-	target_size=0;
+void
+Triangel::notifyPfHitInMSHR(const PacketPtr &pkt)
+{
+	lookaheadStats.latePrefetches++;
+	if(!adaptiveLookahead || !pkt->req->hasPC()) return;
+	//With the MSHRs saturated, prefetches are late however far ahead they
+	//run, and looking further ahead would only cost accuracy.
+	if(throttling && mshrsSaturated()) return;
+	TrainingUnitEntry *entry =
+		trainingUnit.findEntry(pkt->req->getPC()>>2, pkt->isSecure());
+	if(entry != nullptr) trainLookahead(entry, true);
+}
 
+Triangel::ThrottleStats::ThrottleStats(statistics::Group *parent,
+                                       unsigned max_degree)
+  : statistics::Group(parent, "throttle"),
+    ADD_STAT(usefulPrefetches, statistics::units::Count::get(),
+        "number of demand hits credited to the PC that prefetched the block"),
+    ADD_STAT(unusedPrefetches, statistics::units::Count::get(),
+        "number of unused prefetches debited to the PC that issued them"),
+    ADD_STAT(degreeIncreases, statistics::units::Count::get(),
+        "number of times a PC's prefetch degree grew"),
+    ADD_STAT(degreeDecreases, statistics::units::Count::get(),
+        "number of times a PC's prefetch degree shrank"),
+    ADD_STAT(mshrThrottled, statistics::units::Count::get(),
+        "number of accesses whose degree was cut as the MSHRs were saturated"),
+    ADD_STAT(degree, statistics::units::Count::get(),
+        "prefetch degree used by each confident access")
+{
+	degree.init(0, max_degree, 1);
+}
+
+void
+Triangel::trainDegree(TrainingUnitEntry *entry, bool useful)
+{
+	if(useful) {
+		entry->accuracy++;
+		if(!entry->accuracy.isSaturated()) return;
+		if(entry->degree < degree) {
+			entry->degree++;
+			throttleStats.degreeIncreases++;
+		}
+	} else {
+		entry->accuracy--;
+		if(entry->accuracy != 0) return;
+		//Keep one prefetch, so the PC can still show it has become accurate.
+		if(entry->degree > 1) {
+			entry->degree--;
+			throttleStats.degreeDecreases++;
+		}
+	}
+	entry->accuracy.reset();
+}
+
+bool
+Triangel::mshrsSaturated() const
+{
+	const BaseCache *watched = throttleCache ? throttleCache : cache;
+	return watched != nullptr && watched->mshrOccupancy() >= mshrThreshold;
+}
+
+unsigned
+Triangel::prefetchDegree(const TrainingUnitEntry *entry, bool high_degree_pf)
+{
+	unsigned max = high_degree_pf ? (throttling ? entry->degree : degree) : 1;
+	if(throttling && max > 1 && mshrsSaturated()) {
+		//Memory is the bottleneck: further prefetches would only queue behind demands.
+		max = 1;
+		throttleStats.mshrThrottled++;
+	}
+	if(high_degree_pf) throttleStats.degree.sample(max);
+	return max;
+}
+
+void
+Triangel::recordIssued(Addr block, Addr pc, bool is_secure)
+{
+	if(issuedTable.empty()) return;
+	issuedTable[block & (issuedTable.size() - 1)] = {block, pc, is_secure};
+}
+
+void
+Triangel::creditIssued(Addr block, bool is_secure, bool useful)
+{
+	if(issuedTable.empty()) return;
+	IssuedPrefetch &issued = issuedTable[block & (issuedTable.size() - 1)];
+	if(issued.block != block || issued.secure != is_secure) return;
+	issued.block = MaxAddr;
+	if(useful) throttleStats.usefulPrefetches++;
+	else throttleStats.unusedPrefetches++;
+	TrainingUnitEntry *entry = trainingUnit.findEntry(issued.pc, is_secure);
+	if(entry != nullptr) trainDegree(entry, useful);
+}
+
+void
+Triangel::notifyPrefetchUnused(Addr addr, bool is_secure)
+{
+	creditIssued(blockIndex(addr), is_secure, false);
+}
+
+void
+Triangel::serialize(CheckpointOut &cp) const
+{
+	std::vector<uint64_t> geometry = {trainingUnit.entries.size(),
+		historySampler.entries.size(), secondChanceUnit.entries.size(),
+		metadataReuseBuffer.entries.size(), MaxLookahead, ghb.size(),
+		ghbIndex.entries.size(), MarkovMapping::packedWords};
+	structuralMap.geometry(geometry);
+	SERIALIZE_CONTAINER(geometry);
+
+	SERIALIZE_SCALAR(second_chance_timestamp);
+	SERIALIZE_SCALAR(lastAccessFromPFCache);
+	paramOut(cp, "globalReuseConfidence", (unsigned)globalReuseConfidence);
+	paramOut(cp, "globalPatternConfidence", (unsigned)globalPatternConfidence);
+	paramOut(cp, "globalHighPatternConfidence",
+		(unsigned)globalHighPatternConfidence);
+
+	serializeSet(cp, "trainingUnit", trainingUnit,
+		[](const TrainingUnitEntry &e, std::vector<uint64_t> &out) {
+			e.packHistory(out);
+			out.insert(out.end(), {(uint64_t)e.local_timestamp,
+				e.reuseConfidence, e.patternConfidence, e.highPatternConfidence,
+				e.replaceRate, e.hawkConfidence, e.lateness, e.accuracy,
+				e.lastAddressSecure, e.currently_twodist_pf, e.lookahead,
+				e.degree});
+		});
+	//Samples point at their training entry, saved by its position.
+	const TrainingUnitEntry *first_entry = trainingUnit.entries.data();
+	serializeSet(cp, "historySampler", historySampler,
+		[first_entry](const SampleEntry &e, std::vector<uint64_t> &out) {
+			out.insert(out.end(), {e.entry ? (uint64_t)(e.entry - first_entry) : MaxAddr,
+				e.reused, e.local_timestamp, e.next, e.confident});
+		});
+	serializeSet(cp, "secondChanceUnit", secondChanceUnit,
+		[](const SecondChanceEntry &e, std::vector<uint64_t> &out) {
+			out.insert(out.end(), {e.pc, e.global_timestamp, e.used});
+		});
+	serializeSet(cp, "metadataReuseBuffer", metadataReuseBuffer,
+		[](const MarkovMapping &am, std::vector<uint64_t> &out) { am.pack(out); });
+	hawksets.serializeSection(cp, "hawkeye");
+	if(structuralAddresses) structuralMap.serializeSection(cp, "structural");
+
+	if(!globalHistory) return;
+	SERIALIZE_CONTAINER(ghb);
+	SERIALIZE_SCALAR(ghbHead);
+	serializeSet(cp, "ghbIndex", ghbIndex,
+		[](const GHBIndexEntry &e, std::vector<uint64_t> &out) {
+			out.push_back(e.position);
+		});
+}
+
+void
+Triangel::unserialize(CheckpointIn &cp)
+{
+	std::vector<uint64_t> geometry = {trainingUnit.entries.size(),
+		historySampler.entries.size(), secondChanceUnit.entries.size(),
+		metadataReuseBuffer.entries.size(), MaxLookahead, ghb.size(),
+		ghbIndex.entries.size(), MarkovMapping::packedWords};
+	structuralMap.geometry(geometry);
+	if(!checkpointGeometryMatches(cp, name(), geometry)) return;
+
+	UNSERIALIZE_SCALAR(second_chance_timestamp);
+	UNSERIALIZE_SCALAR(lastAccessFromPFCache);
+	unsigned conf;
+	paramIn(cp, "globalReuseConfidence", conf);
+	restoreCounter(globalReuseConfidence, conf);
+	paramIn(cp, "globalPatternConfidence", conf);
+	restoreCounter(globalPatternConfidence, conf);
+	paramIn(cp, "globalHighPatternConfidence", conf);
+	restoreCounter(globalHighPatternConfidence, conf);
+
+	//History, timestamp, seven counters, two flags, lookahead and degree.
+	unserializeSet(cp, "trainingUnit", trainingUnit, MaxLookahead + 12,
+		[](TrainingUnitEntry &e, const uint64_t *in) {
+			in = e.unpackHistory(in);
+			e.local_timestamp = *in++;
+			restoreCounter(e.reuseConfidence, *in++);
+			restoreCounter(e.patternConfidence, *in++);
+			restoreCounter(e.highPatternConfidence, *in++);
+			restoreCounter(e.replaceRate, *in++);
+			restoreCounter(e.hawkConfidence, *in++);
+			restoreCounter(e.lateness, *in++);
+			restoreCounter(e.accuracy, *in++);
+			e.lastAddressSecure = *in++;
+			e.currently_twodist_pf = *in++;
+			e.lookahead = *in++;
+			e.degree = *in++;
+		});
+	TrainingUnitEntry *first_entry = trainingUnit.entries.data();
+	const uint64_t num_entries = trainingUnit.entries.size();
+	unserializeSet(cp, "historySampler", historySampler, 5,
+		[first_entry, num_entries](SampleEntry &e, const uint64_t *in) {
+			e.entry = in[0] < num_entries ? first_entry + in[0] : nullptr;
+			e.reused = in[1];
+			e.local_timestamp = in[2];
+			e.next = in[3];
+			e.confident = in[4];
+		});
+	unserializeSet(cp, "secondChanceUnit", secondChanceUnit, 3,
+		[](SecondChanceEntry &e, const uint64_t *in) {
+			e.pc = in[0];
+			e.global_timestamp = in[1];
+			e.used = in[2];
+		});
+	unserializeSet(cp, "metadataReuseBuffer", metadataReuseBuffer,
+		MarkovMapping::packedWords,
+		[](MarkovMapping &am, const uint64_t *in) { am.unpack(in); });
+	hawksets.unserializeSection(cp, "hawkeye");
+	if(structuralAddresses) structuralMap.unserializeSection(cp, "structural");
+
+	if(!globalHistory) return;
+	UNSERIALIZE_CONTAINER(ghb);
+	UNSERIALIZE_SCALAR(ghbHead);
+	unserializeSet(cp, "ghbIndex", ghbIndex, 1,
+		[](GHBIndexEntry &e, const uint64_t *in) { e.position = in[0]; });
+}
+
+Triangel::GHBStats::GHBStats(statistics::Group *parent)
+  : statistics::Group(parent, "ghb"),
+    ADD_STAT(appends, statistics::units::Count::get(),
+        "number of misses appended to the global history"),
+    ADD_STAT(indexHits, statistics::units::Count::get(),
+        "number of misses whose last occurrence was still in the history"),
+    ADD_STAT(staleIndexHits, statistics::units::Count::get(),
+        "number of misses whose last occurrence had been overwritten"),
+    ADD_STAT(prefetches, statistics::units::Count::get(),
+        "number of prefetches read from the global history"),
+    ADD_STAT(lineReads, statistics::units::Count::get(),
+        "number of global history lines read from the LLC"),
+    ADD_STAT(lineWrites, statistics::units::Count::get(),
+        "number of global history lines started in the LLC")
+{
+}
+
+void
+Triangel::globalHistoryPrefetch(Addr addr, bool is_secure,
+    std::vector<AddrPriority> &addresses)
+{
+	const uint64_t size = ghb.size();
+	GHBIndexEntry *ie = ghbIndex.findEntry(addr, is_secure);
+	if(ie != nullptr) {
+		ghbIndex.accessEntry(ie);
+		//The misses after the last occurrence are valid until the buffer wraps over them.
+		if(ghbHead - ie->position <= size) {
+			ghbStats.indexHits++;
+			uint64_t line = MaxAddr;
+			for(uint64_t pos = ie->position + 1;
+			    pos < ghbHead && pos <= ie->position + ghbDegree; pos++) {
+				//The stream is read a line at a time, all within one LLC access latency.
+				const uint64_t slot = pos % size;
+				if(slot / ghbEntriesPerLine != line) {
+					line = slot / ghbEntriesPerLine;
+					prefetchStats.metadataAccesses++;
+					ghbStats.lineReads++;
+				}
+				if(ghb[slot] == addr) continue;
+				addresses.push_back(AddrPriority(ghb[slot] << lBlkSize, cacheDelay));
+				ghbStats.prefetches++;
+			}
+		} else {
+			ghbStats.staleIndexHits++;
+		}
+	} else {
+		ie = ghbIndex.findVictim(addr);
+		ghbIndex.insertEntry(addr, is_secure, ie);
+	}
+
+	//Each new history line evicts whatever the LLC kept in its slot.
+	const uint64_t slot = ghbHead % size;
+	if(slot % ghbEntriesPerLine == 0) {
+		const uint64_t line = slot / ghbEntriesPerLine;
+		ghbPartition.claimLine(line % ghbLLCSets, line / ghbLLCSets);
+		ghbStats.lineWrites++;
+	}
+	ghb[slot] = addr;
+	ie->position = ghbHead++;
+	ghbStats.appends++;
+}
+
+Triangel::StructuralStats::StructuralStats(statistics::Group *parent)
+  : statistics::Group(parent, "structural"),
+    ADD_STAT(lookups, statistics::units::Count::get(),
+        "number of confident accesses looked up in the structural map"),
+    ADD_STAT(lineHits, statistics::units::Count::get(),
+        "number of lookups that found their structural line"),
+    ADD_STAT(prefetches, statistics::units::Count::get(),
+        "number of prefetches read from structural lines")
+{
+}
+
+bool
+Triangel::structuralPrefetch(const PrefetchInfo &pfi,
+    const TrainingUnitEntry *entry, bool high_degree_pf, Addr target,
+    unsigned distance, std::vector<AddrPriority> &addresses)
+{
+	structuralStats.lookups++;
+	structuralFollowers.clear();
+	if(!structuralMap.followers(target, pfi.isSecure(), distance,
+			high_degree_pf ? degree : 1, structuralFollowers)) return false;
+	structuralStats.lineHits++;
+	//The whole chain sits in one structural line, so costs a single read.
+	prefetchStats.metadataAccesses++;
+	if(structuralFollowers.empty()) return false;
+	const unsigned max = prefetchDegree(entry, high_degree_pf);
+	if(structuralFollowers.size() > max) structuralFollowers.resize(max);
+
+	const Addr pc = pfi.getPC()>>2;
+	const bool confident = !confidenceHints || high_degree_pf;
+	MetadataChain *chain = timedMetadata() ? new MetadataChain(pfi) : nullptr;
+	Addr read = target;
+	for(Addr block : structuralFollowers) {
+		if(chain) {
+			chain->steps.push_back({read, block << lBlkSize, confident});
+			read = MaxAddr;
+		} else addresses.push_back(AddrPriority(block << lBlkSize, cacheDelay, confident));
+		recordIssued(block, pc, pfi.isSecure());
+		structuralStats.prefetches++;
+	}
+	if(chain) advanceChain(chain);
+	return true;
+}
+
+Triangel::ShadowStats::ShadowStats(statistics::Group *parent)
+  : statistics::Group(parent, "shadow"),
+    ADD_STAT(accesses, statistics::units::Count::get(),
+        "number of accesses the shadow variant was trained on"),
+    ADD_STAT(predictions, statistics::units::Count::get(),
+        "number of prefetches the shadow variant would have issued"),
+    ADD_STAT(useful, statistics::units::Count::get(),
+        "number of shadow predictions accessed before being replaced"),
+    ADD_STAT(accuracy, statistics::units::Ratio::get(),
+        "fraction of shadow predictions that were accessed",
+        useful / predictions),
+    ADD_STAT(coverage, statistics::units::Ratio::get(),
+        "fraction of accesses the shadow variant predicted",
+        useful / accesses)
+{
+}
+
+void
+Triangel::makeShadow()
+{
+	fatal_if(shadowScoreEntries == 0 || !isPowerOf2(shadowScoreEntries),
+		"%s: shadow_score_entries must be a power of two\n", name());
+	fatal_if(timedMetadata(),
+		"%s: a shadow cannot send metadata accesses to the LLC\n", name());
+	metadata->detachFromLLC();
+	ghbPartition.detach();
+	shadowPredictions.assign(shadowScoreEntries, MaxAddr);
+	//Nothing reports a shadow's predictions unused, as none are issued.
+	issuedTable.clear();
+	shadowStats.reset(new ShadowStats(this));
+}
+
+void
+Triangel::shadowNotify(const PrefetchInfo &pfi)
+{
+	const Addr mask = shadowPredictions.size() - 1;
+	const Addr block = blockIndex(pfi.getAddr());
+	shadowStats->accesses++;
+	if(shadowPredictions[block & mask] == block) {
+		shadowStats->useful++;
+		shadowPredictions[block & mask] = MaxAddr;
+	}
+
+	std::vector<AddrPriority> addresses;
+	calculatePrefetch(pfi, addresses);
+	for(const AddrPriority &ap : addresses) {
+		const Addr pf_block = blockIndex(ap.first);
+		shadowPredictions[pf_block & mask] = pf_block;
+		shadowStats->predictions++;
+	}
+}
+
+Triangel::MetadataPort::MetadataPort(const std::string &name, Triangel &owner)
+  : RequestPort(name), owner(owner)
+{
+}
+
+void
+Triangel::MetadataPort::sendMetadataReq(PacketPtr pkt)
+{
+	if(!blockedPackets.empty() || !sendTimingReq(pkt)) {
+		blockedPackets.push_back(pkt);
+	}
+}
+
+bool
+Triangel::MetadataPort::recvTimingResp(PacketPtr pkt)
+{
+	owner.recvMetadataResp(pkt);
+	return true;
+}
+
+void
+Triangel::MetadataPort::recvReqRetry()
+{
+	owner.metadataTimingStats.retries++;
+	while(!blockedPackets.empty() && sendTimingReq(blockedPackets.front())) {
+		blockedPackets.pop_front();
+	}
+}
+
+void
+Triangel::sendMetadataAccess(Addr index, bool write, MetadataChain *chain)
+{
+	//Markov lines are named by their set, which is all the LLC needs to
+	//time them; they go to its metadata_side, so are never snooped and
+	//never reach the tags or memory.
+	const Addr line = metadataBaseAddr + (Addr(metadata->thsa->extractSet(index)) << lBlkSize);
+	RequestPtr req = std::make_shared<Request>(line, blkSize, 0, metadataRequestorId);
+	PacketPtr pkt = new Packet(req, write ? MemCmd::WriteReq : MemCmd::ReadReq);
+	pkt->allocate();
+	if(chain) {
+		chain->sent = curTick();
+		pkt->pushSenderState(chain);
+	}
+	if(write) metadataTimingStats.writes++;
+	else metadataTimingStats.reads++;
+	metadataPort.sendMetadataReq(pkt);
+}
+
+void
+Triangel::advanceChain(MetadataChain *chain)
+{
+	while(chain->next < chain->steps.size()) {
+		const MetadataChain::Step &step = chain->steps[chain->next];
+		if(step.read != MaxAddr && !chain->waiting) {
+			chain->waiting = true;
+			sendMetadataAccess(step.read, false, chain);
+			return;
+		}
+		chain->waiting = false;
+		if(step.prefetch != MaxAddr) {
+			PrefetchInfo new_pfi(chain->pfi, step.prefetch);
+			new_pfi.setConfident(step.confident);
+			insertDeferred(new_pfi, 0);
+		}
+		chain->next++;
+	}
+	delete chain;
+}
+
+void
+Triangel::recvMetadataResp(PacketPtr pkt)
+{
+	MetadataChain *chain = pkt->senderState ?
+		safe_cast<MetadataChain*>(pkt->popSenderState()) : nullptr;
+	delete pkt;
+	if(chain) {
+		metadataTimingStats.readLatency += curTick() - chain->sent;
+		advanceChain(chain);
+	}
 }
 
 
@@ -157,7 +1319,7 @@ bool
 Triangel::randomChance(int reuseConf, int replaceRate) {
 	replaceRate -=8;
 
-	uint64_t baseChance = 1000000000l * historySampler.numEntries / markovTable.numEntries;
+	uint64_t baseChance = 1000000000l * historySampler.numEntries / markovTablePtr->numEntries;
 	baseChance = replaceRate>0? (baseChance << replaceRate) : (baseChance >> (-replaceRate));
 	baseChance = reuseConf < 3 ? baseChance / 16 : baseChance;
 	uint64_t chance = random_mt.random<uint64_t>(0,1000000000ul);
@@ -170,23 +1332,25 @@ Triangel::calculatePrefetch(const PrefetchInfo &pfi,
     std::vector<AddrPriority> &addresses)
 {
 
+    //Virtual when use_virtual_addresses is set: the Markov table then
+    //holds virtual successors, translated by Queued at issue.
     Addr addr = blockIndex(pfi.getAddr());
     second_chance_timestamp++;
+
+    for(Triangel* shadow : shadows) shadow->shadowNotify(pfi);
+
+    //Only prefetched hits reach us without a miss: credit whoever prefetched it.
+    if(!pfi.isCacheMiss()) creditIssued(addr, pfi.isSecure(), true);
+
+    //Move a few more sets along if the Markov table is mid-resize.
+    metadata->migrate(metadata->rearrangeSetsPerAccess);
+
+    //The global history follows every miss, with or without a PC.
+    if(globalHistory && !pfi.isWrite()) globalHistoryPrefetch(addr, pfi.isSecure(), addresses);
     
     // This prefetcher requires a PC
     if (!pfi.hasPC() || pfi.isWrite()) {
-if(!use_bloom) {
-	    for(int x=0;x<(smallduel? 32 :64);x++) {
-		int res =    	sizeDuelPtr[x].checkAndInsert(addr,false);
-		if(res==0)continue;
-		int cache_hit = res%128;
-		int cache_set = cache_hit-1;
-		assert(!cache_hit || (cache_set<setPrefetch.size()-1 && cache_set>=0));
-		if(cache_hit) for(int y= setPrefetch.size()-2-cache_set; y>=0; y--) setPrefetch[y]++; 
-		// cache partition hit at this size or bigger. So hit in way 14 = y=17-2-14=1 and 0: would hit with 0 ways reserved or 1, not 2.
-
-	    }
-}
+	if(!use_bloom) metadata->duel(addr, false, smallduel? 32 :64, perfbias?4:2, tenant);
         return;
     }
 
@@ -199,6 +1363,7 @@ if(!use_bloom) {
     bool correlated_addr_found = false;
     Addr index = 0;
     Addr target = 0;
+    unsigned pf_distance = 1;
     
     const int upperHistory=globalPatternConfidence>64?7:8;
     const int highUpperHistory=globalHighPatternConfidence>64?7:8;
@@ -219,12 +1384,22 @@ if(!use_bloom) {
         if(addr == entry->lastAddress) return; // to avoid repeat trainings on sequence.
 	if(entry->highPatternConfidence >= superHistory || !use_pattern2) entry->currently_twodist_pf=true;
 	if(entry->patternConfidence < upperHistory && use_pattern2) entry->currently_twodist_pf=false; 
-        //if very sure, index should be lastLastAddress. TODO: We could also try to learn timeliness here, by tracking PCs at the MSHRs.
-        if(entry->currently_twodist_pf && should_lookahead) index = entry->lastLastAddress;
+        //Only prefetched hits reach us without a miss, so this one was in time.
+        if(!pfi.isCacheMiss()) {
+        	lookaheadStats.timelyPrefetches++;
+        	if(adaptiveLookahead) trainLookahead(entry, false);
+        }
+        //if very sure, index at the PC's lookahead distance, so prefetches run that many accesses ahead.
+        unsigned distance = entry->currently_twodist_pf && should_lookahead ? entry->lookahead : 1;
+        //An adaptive distance may outgrow a young history, so fall back to the deepest address kept.
+        if(adaptiveLookahead) while(distance > 1 && entry->addressAt(distance) == 0) distance--;
+        index = entry->addressAt(distance);
+        pf_distance = distance;
+        lookaheadStats.distance.sample(distance);
         target = addr;
         should_pf = (entry->reuseConfidence > upperReuse || !use_reuse) && (entry->patternConfidence > upperHistory || !use_pattern); //8 is the reset point.
 
-        global_timestamp++;
+        metadata->global_timestamp++;
 
     }
 
@@ -236,6 +1411,8 @@ if(!use_bloom) {
         assert(entry != nullptr);
         assert(!entry->isValid());
         trainingUnit.insertEntry(pc, is_secure, entry);
+        entry->lookahead = initialLookahead();
+        entry->degree = degree;
         //printf("local timestamp %ld\n", entry->local_timestamp);
         if(globalHighPatternConfidence>96) entry->currently_twodist_pf=true;
     }
@@ -276,7 +1453,8 @@ if(!use_bloom) {
      	    	
 		bool willBeConfident = addr == sentry->next;
     		
-    		if(addr == sentry->next ||  (use_scs && sctags->findBlock(sentry->next<<lBlkSize,is_secure) && !sctags->findBlock(sentry->next<<lBlkSize,is_secure)->wasPrefetched())) {
+    		//The LLC is tagged by physical address, so it cannot vouch for virtual successors.
+    		if(addr == sentry->next ||  (use_scs && !useVirtualAddresses && sctags->findBlock(sentry->next<<lBlkSize,is_secure) && !sctags->findBlock(sentry->next<<lBlkSize,is_secure)->wasPrefetched())) {
     			if(addr == sentry->next) {
     				entry->patternConfidence++;
     				entry->highPatternConfidence++;
@@ -351,95 +1529,42 @@ if(!use_bloom) {
     
     if(!use_bloom) {
 	    
-	    for(int x=0;x<(smallduel? 32 :64);x++) {
-	    	//Here we update the size duellers, to work out for each cache set whether it is better to be markov table or L3 cache.
-		int res =    	sizeDuelPtr[x].checkAndInsert(addr,should_pf); //TODO: combine with hawk?
-		if(res==0)continue;
-		const int ratioNumer=(perfbias?4:2);
-		const int ratioDenom=4;//should_pf && entry->highPatternConfidence >=upperHistory? 4 : 8;
-		int cache_hit = res%128; //This is just bit encoding of cache hits.
-		int pref_hit = res/128; //This is just bit encoding of prefetch hits.
-		int cache_set = cache_hit-1; //Encodes which nth most used replacement-state we hit at, if any.
-		int pref_set = pref_hit-1; //Encodes which nth most used replacement-state we hit at, if any.
-		assert(!cache_hit || (cache_set<setPrefetch.size()-1 && cache_set>=0));
-		assert(!pref_hit || (pref_set<setPrefetch.size()-1 && pref_set>=0));
-		if(cache_hit) for(int y= setPrefetch.size()-2-cache_set; y>=0; y--) setPrefetch[y]++; 
-		// cache partition hit at this size or bigger. So hit in way 14 = y=17-2-14=1 and 0: would hit with 0 ways reserved or 1, not 2.
-		if(pref_hit)for(int y=pref_set+1;y<setPrefetch.size();y++) setPrefetch[y]+=(ratioNumer*sizeDuelPtr[x].temporalModMax)/ratioDenom; 
-		// ^ pf hit at this size or bigger. one-indexed (since 0 is an alloc on 0 ways). So hit in way 0 = y=1--16 ways reserved, not 0.
-		
-		//if(cache_hit) printf("Cache hit\n");
-		//else printf("Prefetch hit\n");
-	    }
+	    //Here we update the size duellers, to work out for each cache set whether it is better to be markov table or L3 cache.
+	    metadata->duel(addr, should_pf, smallduel? 32 :64, perfbias?4:2, tenant); //TODO: combine with hawk?
 	    
 
-	    if(global_timestamp > 500000) {
+	    if(metadata->global_timestamp > 500000) {
 	    //Here we choose the size of the Markov table based on the optimum for the last epoch
 	    int counterSizeSeen = 0;
 
-	    for(int x=0;x<setPrefetch.size() && x*size_increment <= max_size;x++) {
-	    	if(setPrefetch[x]>counterSizeSeen) {
-	    		 target_size= size_increment*x;
-	    		 counterSizeSeen = setPrefetch[x];
+	    for(int x=0;x<metadata->setPrefetch.size() && x*size_increment <= max_size;x++) {
+	    	if(metadata->setPrefetch[x]>counterSizeSeen) {
+	    		 metadata->target_size= size_increment*x;
+	    		 counterSizeSeen = metadata->setPrefetch[x];
 	    	}
 	    }
 
-	    int currentscore = setPrefetch[current_size/size_increment];
+	    int currentscore = metadata->setPrefetch[metadata->current_size/size_increment];
 	    currentscore = currentscore + (currentscore>>4); //Slight bias against changing for minimal benefit.
-	    int targetscore = setPrefetch[target_size/size_increment];
-
-	    if(target_size != current_size && targetscore>currentscore) {
-	    	current_size = target_size;
-		printf("size: %d, tick %ld \n",current_size,curTick());
-		//for(int x=0;x<setPrefetch.size(); x++) {
-		//	printf("%d: %d\n", x, setPrefetch[x]);
-		//}
-		assert(current_size >= 0);
+	    int targetscore = metadata->setPrefetch[metadata->target_size/size_increment];
+
+	    if(metadata->target_size != metadata->current_size && targetscore>currentscore) {
+	    	metadata->current_size = metadata->target_size;
+		DPRINTF(HWPrefetch, "Resizing the Markov table to %d entries\n", metadata->current_size);
+		assert(metadata->current_size >= 0);
 		
 	
-		for(int x=0;x<64;x++) {
-			hawksets[x].setMask = current_size / hawksets[x].maxElems;
-			hawksets[x].reset();
-		}
-		std::vector<MarkovMapping> ams;
-			     	if(should_rearrange) {		    	
-					for(MarkovMapping am: *markovTablePtr) {
-					    		if(am.isValid()) ams.push_back(am);
-					}
-					for(MarkovMapping& am: *markovTablePtr) {
-				    		am.invalidate(); //for RRIP's sake
-				    	}
-			    	}
-			    	TriangelHashedSetAssociative* thsa = dynamic_cast<TriangelHashedSetAssociative*>(markovTablePtr->indexingPolicy);
-		  				if(thsa) { thsa->ways = current_size/size_increment; thsa->max_ways = maxWays; assert(thsa->ways <= thsa->max_ways);}
-		  				else assert(0);
-			    	//rearrange conditionally
-				if(should_rearrange) {        	
-				    	if(current_size >0) {
-					      	for(MarkovMapping am: ams) {
-					    		   MarkovMapping *mapping = getHistoryEntry(am.index, am.isSecure(),true,false,true,true);
-					    		   mapping->address = am.address;
-					    		   mapping->index=am.index;
-					    		   mapping->confident = am.confident;
-					    		   mapping->lookupIndex=am.lookupIndex;
-					    		   markovTablePtr->weightedAccessEntry(mapping,1,false); //For RRIP, touch
-					    	}    	
-				    	}
-			    	}
-			    	
-			    	for(MarkovMapping& am: *markovTablePtr) {
-				    if(thsa->ways==0 || (thsa->extractSet(am.index) % maxWays)>=thsa->ways)  am.invalidate();
-				}
-			    	cachetags->setWayAllocationMax(setPrefetch.size()-1-thsa->ways);  	
+		hawksets.reset(metadata->current_size);
+		metadata->resize(metadata->current_size/size_increment, should_rearrange);
 	    } 
-			printf("End of epoch:\n");
-		for(int x=0;x<setPrefetch.size(); x++) {
-
-			printf("%d: %d\n", x, setPrefetch[x]);
+		DPRINTF(HWPrefetch, "End of sizing epoch\n");
+		for(int x=0;x<metadata->setPrefetch.size(); x++) {
+			DPRINTF(HWPrefetch, "Prefetch score at size %d: %d\n", x, metadata->setPrefetch[x]);
 		}
-	    	global_timestamp=0;
-		for(int x=0;x<setPrefetch.size();x++) {
-		    	setPrefetch[x]=0;
+	    	metadata->global_timestamp=0;
+		metadata->rebalanceTenants();
+		for(int x=0;x<metadata->setPrefetch.size();x++) {
+		    	metadata->setPrefetch[x]=0;
 		}
 	    	//Reset after 2 million prefetch accesses -- not quite the same as after 30 million insts but close enough
 	     }
@@ -449,227 +1574,234 @@ if(!use_bloom) {
 
     if(useHawkeye && correlated_addr_found && should_pf) {
         // If a correlation was found, update the Markov table accordingly
-        	for(int x=0; x<64; x++)hawksets[x].add(addr,pc,&trainingUnit);
+        	hawksets.add(addr,pc,trainingUnit);
         	should_hawk = entry->hawkConfidence>7;
     }
     
     if(use_bloom) {
-	    if(correlated_addr_found && should_pf) {
-	    	if(bloomset==-1) bloomset = index&127;
-	    	if((index&127)==bloomset) {
-			int add = bloom_add(blptr, &index, sizeof(Addr));
-			if(!add) { target_size+=192;
-			
-			//printf("Bloom: pc %ld conf %d %d %d rate %d\n", pc, entry->reuseConfidence+0,entry->patternConfidence+0,entry->highPatternConfidence+0,entry->replaceRate+0);
-			}
-		}
-
+	    if(correlated_addr_found && should_pf && metadata->sizing.samples(index)
+	       && metadata->sizing.insert(index)) {
+	    	//With the same 50% headroom the Bloom filter sizing gave.
+	    	metadata->target_size = metadata->sizing.estimate() * 3 / 2;
 	    }
 	    
-	    while(target_size > current_size
-		    		     && target_size > size_increment / 8 && current_size < max_size) {
+	    const int bloom_start_size = metadata->current_size;
+	    while(metadata->target_size > metadata->current_size
+		    		     && metadata->target_size > size_increment / 8 && metadata->current_size < max_size) {
 		    		        //check for size_increment to leave empty if unlikely to be useful.
-		    			current_size += size_increment;
-		    			printf("size: %d, tick %ld \n",current_size,curTick());
-		    			assert(current_size <= max_size);
-		    			assert(cachetags->getWayAllocationMax()>1);
-		    			cachetags->setWayAllocationMax(cachetags->getWayAllocationMax()-1);
-
-		    	std::vector<MarkovMapping> ams;
-		        if(should_rearrange) {        	
-			     	for(MarkovMapping am: *markovTablePtr) {
-			    		if(am.isValid()) ams.push_back(am);
-			    	}
-				for(MarkovMapping& am: *markovTablePtr) {
-			    		am.invalidate(); //for RRIP's sake
-			    	}
-		    	}
-		    	TriangelHashedSetAssociative* thsa = dynamic_cast<TriangelHashedSetAssociative*>(markovTablePtr->indexingPolicy);
-	  		if(thsa) { thsa->ways++; thsa->max_ways = maxWays; assert(thsa->ways <= thsa->max_ways);}
-	  		else assert(0);
-		    	//TODO: rearrange conditionally
-		        if(should_rearrange) {        	            	
-				for(MarkovMapping am: ams) {
-				    		   MarkovMapping *mapping = getHistoryEntry(am.index, am.isSecure(),true,false, true, true);
-				    		   mapping->address = am.address;
-				    		   mapping->index=am.index;
-				    		   mapping->confident = am.confident;
-				    		   mapping->lookupIndex=am.lookupIndex;
-				    		   markovTablePtr->weightedAccessEntry(mapping,1,false); //For RRIP, touch
-				} 
-			}  
-		    			//increase associativity of the set structure by 1!
-		    			//Also, decrease LLC cache associativity by 1.
+		    			metadata->current_size += size_increment;
+		    			DPRINTF(HWPrefetch, "Resizing the Markov table to %d entries\n", metadata->current_size);
+		    			assert(metadata->current_size <= max_size);
 	    }
+	    //increase associativity of the set structure, and decrease the LLC's, in one step.
+	    if(metadata->current_size != bloom_start_size) metadata->resize(metadata->current_size/size_increment, should_rearrange);
 
-		if(global_timestamp > 2000000) {
+		if(metadata->global_timestamp > 2000000) {
 	    	//Reset after 2 million prefetch accesses -- not quite the same as after 30 million insts but close enough
 
-	    	while((target_size <= current_size - size_increment  || target_size < size_increment / 8)  && current_size >=size_increment) {
+	    	const int bloom_end_size = metadata->current_size;
+	    	while((metadata->target_size <= metadata->current_size - size_increment  || metadata->target_size < size_increment / 8)  && metadata->current_size >=size_increment) {
 	    		//reduce the assoc by 1.
 	    		//Also, increase LLC cache associativity by 1.
-	    		current_size -= size_increment;
-	    		printf("size: %d, tick %ld \n",current_size,curTick());
-		    	assert(current_size >= 0);
-		    	std::vector<MarkovMapping> ams;
-		     	if(should_rearrange) {		    	
-				for(MarkovMapping am: *markovTablePtr) {
-				    		if(am.isValid()) ams.push_back(am);
-				}
-				for(MarkovMapping& am: *markovTablePtr) {
-			    		am.invalidate(); //for RRIP's sake
-			    	}
-		    	}
-		    	TriangelHashedSetAssociative* thsa = dynamic_cast<TriangelHashedSetAssociative*>(markovTablePtr->indexingPolicy);
-	  				if(thsa) { assert(thsa->ways >0); thsa->ways--; }
-	  				else assert(0);
-		    	//rearrange conditionally
-		        if(should_rearrange) {        	
-			    	if(current_size >0) {
-				      	for(MarkovMapping am: ams) {
-				    		   MarkovMapping *mapping = getHistoryEntry(am.index, am.isSecure(),true,false,true,true);
-				    		   mapping->address = am.address;
-				    		   mapping->index=am.index;
-				    		   mapping->confident = am.confident;
-				    		   mapping->lookupIndex=am.lookupIndex;
-				    		   markovTablePtr->weightedAccessEntry(mapping,1,false); //For RRIP, touch
-				    	}    	
-			    	}
-		    	}
-		    	
-		    	for(MarkovMapping& am: *markovTablePtr) {
-			    if(thsa->ways==0 || (thsa->extractSet(am.index) % maxWays)>=thsa->ways)  am.invalidate();
-			}
-		    	
-		    	
-		    	
-
-	    		cachetags->setWayAllocationMax(cachetags->getWayAllocationMax()+1);
+	    		metadata->current_size -= size_increment;
+	    		DPRINTF(HWPrefetch, "Resizing the Markov table to %d entries\n", metadata->current_size);
+		    	assert(metadata->current_size >= 0);
 	    	}
-	    	target_size = 0;
-	    	global_timestamp=0;
-	    	bloom_reset(blptr);
-	    	bloomset=-1;
+	    	if(metadata->current_size != bloom_end_size) metadata->resize(metadata->current_size/size_increment, should_rearrange);
+	    	//Age the sketch rather than clear it, so the next epoch starts from the indexes still live.
+	    	metadata->sizing.decay();
+	    	metadata->target_size = metadata->sizing.estimate() * 3 / 2;
+	    	metadata->global_timestamp=0;
+	    	metadata->rebalanceTenants();
 	    }
     }
     
     
-    if (correlated_addr_found && should_pf && (current_size>0)) {
+    if (correlated_addr_found && should_pf && (metadata->current_size>0)
+        && metadata->canEncode(index, target)) {
         // If a correlation was found, update the Markov table accordingly
 	//DPRINTF(HWPrefetch, "Tabling correlation %x to %x, PC %x\n", index << lBlkSize, target << lBlkSize, pc);
 	MarkovMapping *mapping = getHistoryEntry(index, is_secure,false,false,false, should_hawk);
 	if(mapping == nullptr) {
         	mapping = getHistoryEntry(index, is_secure,true,false,false, should_hawk);
-        	mapping->address = target;
         	mapping->index=index; //for HawkEye
-        	mapping->confident = false;
         }
         assert(mapping != nullptr);
-        bool confident = mapping->address == target; 
-        bool wasConfident = mapping->confident;
-        mapping->confident = confident; //Confidence is just used for replacement. I haven't tested how important it is for performance to use it; this is inherited from Triage.
-        if(!wasConfident) {
-        	mapping->address = target;
-        }
-        if(wasConfident && confident && use_mrb) {
+        //Confidence is just used for replacement. I haven't tested how important it is for performance to use it; this is inherited from Triage.
+        const bool unchanged = metadata->train(mapping, target);
+        bool llc_update = true;
+        if(unchanged && use_mrb) {
         	MarkovMapping *cached_entry =
         		metadataReuseBuffer.findEntry(index, is_secure);
         	if(cached_entry != nullptr) {
         		prefetchStats.metadataAccesses--;
+        		llc_update = false;
         		//No need to access L3 again, as no updates to be done.
         	}
         }
         
-        int index=0;
-        uint64_t time = -1;
-        if(lookupAssoc>0){
-		int lookupMask = (1024/lookupAssoc)-1;
-		int set = (target>>lookupOffset)&lookupMask;
-		for(int x=lookupAssoc*set;x<lookupAssoc*(set+1);x++) {
-			if(target>>lookupOffset == lookupTable[x]) {
-				index=x;
-				break;
-			}
-			if(time > lookupTick[x]) {
-				time = lookupTick[x];
-				index=x;
-			}
-		}
-		
-		lookupTable[index]=target>>lookupOffset;
-		lookupTick[index]=curTick();
-		mapping->lookupIndex=index;
-        }
+        if(llc_update && timedMetadata()) sendMetadataAccess(index, true, nullptr);
         
     }
 
-    if(target != 0 && should_pf && (current_size>0)) {
+    if(structuralAddresses && correlated_addr_found && should_pf) {
+    	//Structural streams follow the PC's own order, whatever the lookahead.
+    	structuralMap.train(entry->lastAddress, addr, is_secure);
+    }
+
+    if(structuralAddresses && target != 0 && should_pf
+       && structuralPrefetch(pfi, entry,
+              entry->highPatternConfidence>highUpperHistory || !use_pattern2,
+              target, pf_distance, addresses)) {
+    	//The structural line covered the chain, so no Markov walk is needed.
+    } else if(target != 0 && should_pf && (metadata->current_size>0)) {
   	 MarkovMapping *pf_target = getHistoryEntry(target, is_secure,false,true,false, should_hawk);
+  	 //With timed metadata, prefetches wait on the reads that find them
+  	 //rather than on cacheDelay.
+  	 MetadataChain *chain = timedMetadata() ? new MetadataChain(pfi) : nullptr;
+  	 Addr read = target;
    	 unsigned deg = 0;
   	 unsigned delay = cacheDelay;
   	 bool high_degree_pf = pf_target != nullptr
   	         && (entry->highPatternConfidence>highUpperHistory || !use_pattern2)/*&& pf_target->confident*/;
-   	 unsigned max = high_degree_pf? degree : (should_pf? 1 : 0);
+   	 const unsigned max = prefetchDegree(entry, high_degree_pf);
+   	 const unsigned successor_pfs = prefetchSuccessors ?
+   	         std::min(prefetchSuccessors, metadata->numSuccessors) : metadata->numSuccessors;
    	 //if(pf_target == nullptr && should_pf) DPRINTF(HWPrefetch, "Target not found for %x, PC %x\n", target << lBlkSize, pc);
    	 while (pf_target != nullptr && deg < max  /*&& (pf_target->confident || entry->highPatternConfidence>upperHistory)*/
    	 ) { //TODO: do we always pf at distance 1 if not confident?
-    		DPRINTF(HWPrefetch, "Prefetching %x on miss at %x, PC \n", pf_target->address << lBlkSize, addr << lBlkSize, pc);
+    		const Successor &next = pf_target->successors[0];
+    		DPRINTF(HWPrefetch, "Prefetching %x on miss at %x, PC \n", next.address << lBlkSize, addr << lBlkSize, pc);
     		int extraDelay = cacheDelay;
+    		//Whether this step's prefetch has not been issued by an earlier chain.
+    		bool fresh = true;
     		if(lastAccessFromPFCache && use_mrb) {
     			Cycles time = curCycle() - pf_target->cycle_issued;
-    			if(time >= cacheDelay) extraDelay = 0;
-    			else if (time < cacheDelay) extraDelay = time;
+    			if(pf_target->metadataPrefetched) {
+    				//Fetched ahead of the chain, so its prefetch is still to
+    				//issue, as soon as the fetch has returned.
+    				pf_target->metadataPrefetched = false;
+    				extraDelay = time >= cacheDelay ? 0 : cacheDelay - time;
+    				mrbStats.prefetchHits++;
+    			} else {
+    				fresh = false;
+    				if(time >= cacheDelay) extraDelay = 0;
+    				else if (time < cacheDelay) extraDelay = time;
+    				mrbStats.hits++;
+    			}
     		}
     		
-    		Addr lookup = pf_target->address;
-   	        if(lookupAssoc>0){
-	   	 	int index=pf_target->lookupIndex;
-	   	 	int lookupMask = (1<<lookupOffset)-1;
-	   	 	lookup = (lookupTable[index]<<lookupOffset) + ((pf_target->address)&lookupMask);
-	   	 	lookupTick[index]=curTick();
-	   	 	if(lookup == pf_target->address)prefetchStats.lookupCorrect++;
+    		//Entries fetched ahead only wait for what is left of their fetch.
+    		const unsigned step_delay = delay + extraDelay - cacheDelay;
+    		Addr lookup = metadata->decode(next);
+   	        if(metadata->encoding == TriangelMarkovEncoding::lookup_table){
+	   	 	if(lookup == next.address)prefetchStats.lookupCorrect++;
 	    		else prefetchStats.lookupWrong++;
     		}
     		
-    		if(extraDelay == cacheDelay) addresses.push_back(AddrPriority(lookup << lBlkSize, delay));
+    		//Without high pattern confidence, or from a successor not yet
+    		//confirmed, the prefetch is inserted where it is evicted first.
+    		const bool confident = !confidenceHints || (high_degree_pf && next.confident);
+    		if(chain) {
+    			chain->steps.push_back({lastAccessFromPFCache && use_mrb ? MaxAddr : read,
+    				fresh ? lookup << lBlkSize : MaxAddr, confident});
+    		} else if(fresh) addresses.push_back(AddrPriority(lookup << lBlkSize, step_delay, confident));
+    		if(fresh) recordIssued(lookup, pc, is_secure);
+    		
+    		//The confident alternatives come in the same line, so cost no
+    		//further read; the chain carries on from the most recent one.
+    		for(unsigned x=1;x<successor_pfs && fresh;x++) {
+    			const Successor &alt = pf_target->successors[x];
+    			if(!alt.valid || !alt.confident) continue;
+    			const Addr alt_lookup = metadata->decode(alt);
+    			const bool alt_confident = !confidenceHints || high_degree_pf;
+    			if(chain) chain->steps.push_back({MaxAddr, alt_lookup << lBlkSize, alt_confident});
+    			else addresses.push_back(AddrPriority(alt_lookup << lBlkSize, step_delay, alt_confident));
+    			recordIssued(alt_lookup, pc, is_secure);
+    			metadata->stats.successorPrefetches++;
+    		}
     		delay += extraDelay;
     		deg++;
     		
-    		if(deg<max /*&& pf_target->confident*/) pf_target = getHistoryEntry(lookup, is_secure,false,true,false, should_hawk);
-    		else pf_target = nullptr;
+    		if(deg<max /*&& pf_target->confident*/) {
+    			read = lookup;
+    			pf_target = getHistoryEntry(lookup, is_secure,false,true,false, should_hawk);
+    		} else {
+    			//Fetch the entries past the end of the chain, so the next
+    			//chain along finds them on chip.
+    			if(use_mrb && metadataPrefetchDegree) prefetchMetadata(lookup, is_secure);
+    			read = MaxAddr;
+    			pf_target = nullptr;
+    		}
 
    	 }
+   	 if(chain) {
+   	 	//The last lookup read the LLC even if it found nothing to prefetch.
+   	 	if(read != MaxAddr && !(lastAccessFromPFCache && use_mrb)) chain->steps.push_back({read, MaxAddr});
+   	 	advanceChain(chain);
+   	 }
     }
 
         // Update the entry
     if(entry != nullptr) {
-    	entry->lastLastAddress = entry->lastAddress;
-    	entry->lastLastAddressSecure = entry->lastAddressSecure;
-    	entry->lastAddress = addr;
-    	entry->lastAddressSecure = is_secure;
+    	entry->pushAddress(addr, is_secure);
     	entry->local_timestamp ++;
     }
 
 
 }
 
+void
+Triangel::prefetchMetadata(Addr index, bool is_secure)
+{
+	for(unsigned x=0;x<metadataPrefetchDegree;x++) {
+		const MarkovMapping *next = metadataReuseBuffer.findEntry(index, is_secure);
+		if(next == nullptr) {
+			const MarkovMapping *entry = metadata->findEntry(index, is_secure);
+			prefetchStats.metadataAccesses++;
+			if(timedMetadata()) sendMetadataAccess(index, false, nullptr);
+			if(entry == nullptr) return;
+			MarkovMapping *pf_entry = metadataReuseBuffer.findVictim(index);
+			metadataReuseBuffer.insertEntry(index, is_secure, pf_entry);
+			pf_entry->copySuccessors(*entry);
+			pf_entry->cycle_issued = curCycle();
+			pf_entry->metadataPrefetched = true;
+			mrbStats.prefetches++;
+			next = pf_entry;
+		}
+		if(!next->successors[0].valid) return;
+		index = metadata->decode(next->successors[0]);
+	}
+}
+
+Triangel::MRBStats::MRBStats(statistics::Group *parent)
+  : statistics::Group(parent, "mrb"),
+    ADD_STAT(hits, statistics::units::Count::get(),
+        "number of chain steps found in the MRB, already prefetched"),
+    ADD_STAT(prefetchHits, statistics::units::Count::get(),
+        "number of chain steps found in the MRB, fetched there ahead of "
+        "the chain"),
+    ADD_STAT(prefetches, statistics::units::Count::get(),
+        "number of Markov entries fetched into the MRB ahead of a chain")
+{
+}
+
 Triangel::MarkovMapping*
 Triangel::getHistoryEntry(Addr paddr, bool is_secure, bool add, bool readonly, bool clearing, bool hawk)
 {
 	//The weird parameters above control whether we replace entries, and how the number of metadata accesses are updated, for instance. They're basically a simulation thing.
-  	    TriangelHashedSetAssociative* thsa = dynamic_cast<TriangelHashedSetAssociative*>(markovTablePtr->indexingPolicy);
-	  				if(!thsa)  assert(0);  
+  	    TriangelHashedSetAssociative* thsa = metadata->thsa;
 
-    	cachetags->clearSetWay(thsa->extractSet(paddr)/maxWays, thsa->extractSet(paddr)%maxWays); 
+    	metadata->llcWays.claim(thsa->extractSet(paddr));
 
 
     if(should_rearrange) {    
 
-	    int index= paddr % (way_idx.size()); //Not quite the same indexing strategy, but close enough.
+	    int index= paddr % (metadata->way_idx.size()); //Not quite the same indexing strategy, but close enough.
 	    
-	    if(way_idx[index] != thsa->ways) {
-	    	if(way_idx[index] !=0) prefetchStats.metadataAccesses+= thsa->ways + way_idx[index];
-	    	way_idx[index]=thsa->ways;
+	    if(metadata->way_idx[index] != thsa->ways) {
+	    	if(metadata->way_idx[index] !=0) prefetchStats.metadataAccesses+= thsa->ways + metadata->way_idx[index];
+	    	metadata->way_idx[index]=thsa->ways;
 	    }
     }
 
@@ -684,26 +1816,27 @@ Triangel::getHistoryEntry(Addr paddr, bool is_secure, bool add, bool readonly, b
     }
 
     MarkovMapping *ps_entry =
-        markovTablePtr->findEntry(paddr, is_secure);
+        metadata->findEntry(paddr, is_secure);
     if(readonly || !add) prefetchStats.metadataAccesses++;
     if (ps_entry != nullptr) {
         // A PS-AMC line already exists
         markovTablePtr->weightedAccessEntry(ps_entry,hawk?1:0,false);
     } else {
         if(!add) return nullptr;
-        ps_entry = markovTablePtr->findVictim(paddr);
+        ps_entry = metadata->findVictim(paddr, tenant);
         assert(ps_entry != nullptr);
-        if(useHawkeye && !clearing) for(int x=0;x<64;x++) hawksets[x].decrementOnLRU(ps_entry->index,&trainingUnit);
+        if(useHawkeye && !clearing) hawksets.decrementOnLRU(ps_entry->index,trainingUnit);
 	assert(!ps_entry->isValid());
         markovTablePtr->insertEntry(paddr, is_secure, ps_entry);
+        ps_entry->owner = tenant;
+        metadata->stats.tenantInsertions[tenant]++;
         markovTablePtr->weightedAccessEntry(ps_entry,hawk?1:0,true);
     }
 
     if(readonly && use_mrb) {
     	    MarkovMapping *pf_entry = metadataReuseBuffer.findVictim(paddr);
     	    metadataReuseBuffer.insertEntry(paddr, is_secure, pf_entry);
-    	    pf_entry->address = ps_entry->address;
-    	    pf_entry->confident = ps_entry->confident;
+    	    pf_entry->copySuccessors(*ps_entry);
     	    pf_entry->cycle_issued = curCycle();
     	    //This adds access time, to set delay appropriately.
     }
@@ -714,45 +1847,5 @@ Triangel::getHistoryEntry(Addr paddr, bool is_secure, bool add, bool readonly, b
 
 
 
-uint32_t
-TriangelHashedSetAssociative::extractSet(const Addr addr) const
-{
-	//Input is already blockIndex so no need to remove block again.
-    Addr offset = addr;
-    
-   /* const Addr hash1 = offset & ((1<<16)-1);
-    const Addr hash2 = (offset >> 16) & ((1<<16)-1);
-        const Addr hash3 = (offset >> 32) & ((1<<16)-1);
-    */
-        offset = ((offset) * max_ways) + (extractTag(addr) % ways);
-        return offset & setMask;   //setMask is numSets-1
-
-}
-
-
-Addr
-TriangelHashedSetAssociative::extractTag(const Addr addr) const
-{
-    //Input is already blockIndex so no need to remove block again.
-
-    //Description in Triage-ISR confuses whether the index is just the 16 least significant bits,
-    //or the weird index above. The tag can't be the remaining bits if we use the literal representation!
-
-
-    Addr offset = addr / (numSets/max_ways); 
-    int result = 0;
-    
-    //This is a tag# as described in the Triangel paper.
-    const int shiftwidth=10;
-
-    for(int x=0; x<64; x+=shiftwidth) {
-       result ^= (offset & ((1<<shiftwidth)-1));
-       offset = offset >> shiftwidth;
-    }
-    return result;
-}
-
-
-
 } // namespace prefetch
 } // namespace gem5
@@ -6,72 +6,417 @@
 #ifndef __MEM_CACHE_PREFETCH_TRIANGEL_HH__
 #define __MEM_CACHE_PREFETCH_TRIANGEL_HH__
 
+#include <algorithm>
+#include <deque>
+#include <iterator>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "base/sat_counter.hh"
+#include "base/statistics.hh"
 #include "base/types.hh"
 #include "mem/cache/tags/base.hh"
 #include "mem/cache/prefetch/associative_set.hh"
+#include "mem/cache/prefetch/hawkeye_sampler.hh"
 #include "mem/cache/prefetch/queued.hh"
+#include "mem/cache/prefetch/temporal.hh"
 #include "mem/cache/replacement_policies/replaceable_entry.hh"
 #include "mem/cache/tags/indexing_policies/set_associative.hh"
 #include "mem/packet.hh"
+#include "mem/port.hh"
 #include "base/random.hh"
+#include "sim/sim_object.hh"
 
+#include "enums/TriangelMarkovEncoding.hh"
 #include "params/TriangelHashedSetAssociative.hh"
 
-#include "bloom.h"
-
 
 
 namespace gem5
 {
 
+struct TriangelMetadataStoreParams;
 struct TriangelPrefetcherParams;
 
 GEM5_DEPRECATED_NAMESPACE(Prefetcher, prefetch);
 namespace prefetch
 {
 
-/**
- * Override the default set associative to apply a specific hash function
- * when extracting a set.
- */
-class TriangelHashedSetAssociative : public SetAssociative
+/** Indexing of the Triangel Markov table, see TemporalHashedSetAssociative */
+class TriangelHashedSetAssociative : public TemporalHashedSetAssociative
 {
   public:
-    uint32_t extractSet(const Addr addr) const override;
-    Addr extractTag(const Addr addr) const override;
-
-  public:
-    int ways;
-    int max_ways;
     TriangelHashedSetAssociative(
         const TriangelHashedSetAssociativeParams &p)
-      : SetAssociative(p), ways(0),max_ways(8)
+      : TemporalHashedSetAssociative(p)
     {
     }
-    ~TriangelHashedSetAssociative() = default;
 };
 
 
 
+/**
+ * Metadata shared by all Triangel prefetchers that steal ways from the same
+ * LLC: the Markov table itself, the set duellers or Bloom filter used to size
+ * it, and the current partition. One store should exist per LLC (or LLC
+ * slice), so that separate sockets, slices or systems in the same process
+ * keep independent metadata.
+ */
+class TriangelMetadataStore : public SimObject
+{
+  public:
+    /** Most successors a Markov entry can hold */
+    static const unsigned MaxSuccessors = 4;
+
+    /** A target that followed a Markov entry's index */
+    struct Successor
+    {
+        Addr address;
+        int lookupIndex; //Only one of lookupIndex/Address are real.
+        bool confident;
+        bool valid;
+        Successor() : address(0), lookupIndex(0), confident(false), valid(false)
+        {}
+    };
+
+    /**
+     * Address Mapping entry, holds up to MaxSuccessors targets with a
+     * confidence bit each, most recently trained first.
+     */
+    struct MarkovMapping : public TaggedEntry
+    {
+      	Addr index; //Just for maintaining HawkEye easily. Not real.
+        Successor successors[MaxSuccessors];
+        Cycles cycle_issued; // only for prefetched cache and only in simulation
+        /** Tenant that inserted the entry, for QoS partitioning */
+        int owner;
+        /** In the MRB only: fetched ahead, its prefetch not yet issued */
+        bool metadataPrefetched;
+        MarkovMapping()
+          : index(0), cycle_issued(0), owner(0), metadataPrefetched(false)
+        {}
+
+        /** Checkpointed words per mapping */
+        static const unsigned packedWords = 4 + 4 * MaxSuccessors;
+
+        void
+        pack(std::vector<uint64_t> &out) const
+        {
+                out.insert(out.end(), {index, cycle_issued, (uint64_t)owner,
+                        metadataPrefetched});
+                for(const Successor &s : successors) {
+                        out.insert(out.end(), {s.address,
+                                (uint64_t)s.lookupIndex, s.confident, s.valid});
+                }
+        }
+
+        void
+        unpack(const uint64_t *in)
+        {
+                index = *in++;
+                cycle_issued = Cycles(*in++);
+                owner = *in++;
+                metadataPrefetched = *in++;
+                for(Successor &s : successors) {
+                        s.address = *in++;
+                        s.lookupIndex = *in++;
+                        s.confident = *in++;
+                        s.valid = *in++;
+                }
+        }
+
+        /** Copy the targets, leaving tag and replacement state alone. */
+        void
+        copySuccessors(const MarkovMapping &other)
+        {
+                std::copy(std::begin(other.successors),
+                        std::end(other.successors), std::begin(successors));
+        }
+
+        void
+        invalidate() override
+        {
+                TaggedEntry::invalidate();
+                for(Successor &s : successors) s = Successor();
+                index = 0;
+                cycle_issued=Cycles(0);
+                metadataPrefetched = false;
+        }
+    };
+
+    /**
+     * Table of Markov entries. RRIP, the policy it is configured with,
+     * keeps its state inline rather than in every entry.
+     */
+    using MarkovTable =
+        AssociativeSet<MarkovMapping, replacement_policy::InlineBRRIP>;
+
+  private:
+    friend class Triangel;
+
+    /** LLC whose ways hold the Markov table */
+    BaseTags* const cachetags;
+
+    /** How entries are packed into an LLC line */
+    const TriangelMarkovEncoding encoding;
+    /** Successors held per entry, at most MaxSuccessors */
+    const unsigned numSuccessors;
+    /** Entries that fit in one LLC line, which sets the table's density */
+    const unsigned entriesPerLine;
+    /** Width of a signed delta target */
+    const unsigned deltaBits;
+    /** Target bits held per entry when the line shares the upper bits */
+    const unsigned pageBits;
+
+    const int max_size;
+    const int size_increment;
+    const int maxWays;
+
+    int64_t global_timestamp;
+    int current_size;
+    int target_size;
+
+    /** Dueller score for each possible partition size, in ways */
+    std::vector<uint32_t> setPrefetch;
+    SizeDuel sizeDuels[256];
+    /** Number of duellers that were initialised */
+    static const int numSizeDuels = 64;
+    /** LLC sets sampled by at least one dueller, indexed by set */
+    std::vector<bool> duelledSets;
+    uint64_t duelSetMask;
+
+    /** Live index estimate sizing the table when not duelling */
+    SizingSketch sizing;
+
+    /** Last known partition size per region, to model rearrangement cost */
+    std::vector<int> way_idx;
+
+    /** History mappings table */
+    MarkovTable markovTable;
+
+    /** Upper target bits shared through the lookup table encoding */
+    Addr lookupTable[1024];
+    uint64_t lookupTick[1024];
+    const int lookupAssoc;
+    const int lookupOffset;
+
+    /** Indexing policy of the Markov table, which holds the partition size */
+    TriangelHashedSetAssociative* const thsa;
+    /** Associativity of the LLC when no ways hold metadata */
+    const int llcAssoc;
+
+    /** Markov sets migrated per access after a resize, 0 for all at once */
+    const unsigned rearrangeSetsPerAccess;
+    /** Partition size, in ways, that the migration is moving away from */
+    int migrationOldWays;
+    /** Next Markov set to migrate, or -1 when no migration is in flight */
+    int64_t migrationCursor;
+    /** LLC ways taken by the Markov table */
+    LLCWayPartition llcWays;
+
+    /** A prefetcher sharing the table, when it is partitioned between them */
+    struct Tenant
+    {
+        std::string name;
+        /** Duellers sampling the same sets as the global ones, fed only
+         * by this tenant's accesses */
+        std::vector<SizeDuel> duels;
+        /** Prefetch hits the tenant would have had at each partition size */
+        std::vector<uint32_t> utility;
+        /** Entries of each Markov line the tenant may fill before it has
+         * to replace its own */
+        unsigned share;
+    };
+    std::vector<Tenant> tenants;
+    /** Ways, candidates and entries held per tenant of the line being
+     * replaced in, kept across findVictim() calls so they do not allocate */
+    std::vector<MarkovMapping*> victimLine;
+    std::vector<MarkovMapping*> victimCandidates;
+    std::vector<unsigned> victimHeld;
+    /** Whether Markov lines are split between tenants by utility */
+    const bool qosPartitioning;
+    /** Entries of each Markov line guaranteed to every tenant */
+    const unsigned qosMinEntries;
+
+    struct StatGroup : public statistics::Group
+    {
+        StatGroup(statistics::Group *parent);
+        /** Number of partition size changes */
+        statistics::Scalar resizes;
+        /** Number of Markov sets walked by the migration engine */
+        statistics::Scalar migratedSets;
+        /** Number of entries moved to their set in the new geometry */
+        statistics::Scalar migratedEntries;
+        /** Number of lookups that found their entry in the old geometry */
+        statistics::Scalar oldGeometryHits;
+        /** Number of correlations dropped as the encoding can't hold them */
+        statistics::Scalar encodingFailures;
+        /** Number of lookup table slots reassigned to new upper bits */
+        statistics::Scalar lookupReplacements;
+        /** Number of tenant rebalances */
+        statistics::Scalar rebalances;
+        /** Number of entries replaced by a tenant other than their owner */
+        statistics::Scalar crossTenantEvictions;
+        /** Entries per Markov line each tenant was given at the last rebalance */
+        statistics::Vector tenantShare;
+        /** Number of Markov entries inserted by each tenant */
+        statistics::Vector tenantInsertions;
+        /** Number of trained targets found at each successor position */
+        statistics::Vector successorHits;
+        /** Number of prefetches issued to other than the first successor */
+        statistics::Scalar successorPrefetches;
+    } stats;
+
+    /**
+     * Move an entry to where the current geometry places it, evicting
+     * whatever occupies that slot.
+     * @param entry Valid entry still in its pre-resize location.
+     * @return The entry at its new location.
+     */
+    MarkovMapping* relocate(MarkovMapping* entry);
+
+    /** Migrate one Markov set to the current geometry. */
+    void migrateSet(uint64_t set);
+
+    /** Hand the ways no longer used by the Markov table back to the LLC. */
+    void updateLLCWays();
+
+    /** Split each line evenly, before any utility has been measured. */
+    void equalShares();
+
+  public:
+    TriangelMetadataStore(const TriangelMetadataStoreParams &p);
+    ~TriangelMetadataStore() = default;
+
+    void regStats() override;
+
+    /**
+     * Register a prefetcher that inserts into this table.
+     * @return The tenant id it passes to duel() and findVictim().
+     */
+    int addTenant(const std::string &name);
+
+    /**
+     * Pick the entry an insertion by tenant replaces. With QoS
+     * partitioning, a tenant at its share of the line replaces its own
+     * entries, and one below it takes from tenants above theirs, so a
+     * noisy tenant cannot push the others below their share.
+     * @return The victim, already invalidated.
+     */
+    MarkovMapping* findVictim(Addr index, int tenant);
+
+    /**
+     * Re-split each Markov line between the tenants, greedily giving every
+     * entry beyond the guaranteed minimum to the tenant whose duellers
+     * gain the most prefetch hits from it. Called at the end of every
+     * sizing epoch, after which the tenants' duellers start afresh.
+     */
+    void rebalanceTenants();
+
+    /**
+     * Change the number of LLC ways given to the Markov table. When
+     * rearranging, entries are moved to their new sets incrementally by
+     * migrate(), and lookups consult the old geometry until they are.
+     * @param new_ways Number of ways to reserve.
+     * @param rearrange Whether to keep entries across the change.
+     */
+    void resize(int new_ways, bool rearrange);
+
+    /**
+     * Keep the partition to the store's own bookkeeping, leaving the
+     * LLC's ways and contents alone. Used by shadow prefetchers.
+     */
+    void detachFromLLC() { llcWays.detach(); }
+
+    /**
+     * Advance an in-flight migration.
+     * @param num_sets Maximum number of Markov sets to migrate.
+     */
+    void migrate(unsigned num_sets);
+
+    /** Migrate every remaining set of an in-flight migration at once. */
+    void finishMigration();
+
+    /**
+     * Find the Markov entry for an index, in either geometry while a
+     * migration is in flight.
+     */
+    MarkovMapping* findEntry(Addr index, bool is_secure);
+
+    /**
+     * Check whether the encoding can store target in the entry for index,
+     * counting an encoding failure if not.
+     */
+    bool canEncode(Addr index, Addr target);
+
+    /** Update the encoding state for a successor that was written. */
+    void encode(Successor &successor);
+
+    /** Address a prefetch of this successor would be issued to. */
+    Addr decode(const Successor &successor);
+
+    /**
+     * Record that target followed the entry's index. A target the entry
+     * holds becomes its most recent successor and is confident again.
+     * Otherwise the target replaces the least recent unconfident successor,
+     * or, if every successor is confident, the least recent one only loses
+     * its confidence, which is Triage's single-target hysteresis when one
+     * successor is kept.
+     * @return Whether the target was held and already confident.
+     */
+    bool train(MarkovMapping* mapping, Addr target);
+
+    void serialize(CheckpointOut &cp) const override;
+    void unserialize(CheckpointIn &cp) override;
+
+    /**
+     * Feed an access to the set duellers that sample its LLC set and
+     * credit their hits to the partition sizes they favour.
+     * @param addr Block address of the access.
+     * @param should_pf Whether Triangel would have stored and prefetched it.
+     * @param num_duellers Number of duellers in use.
+     * @param pf_weight Numerator, over 4, of the weight of a prefetch hit.
+     * @param tenant Tenant making the access.
+     */
+    void duel(Addr addr, bool should_pf, int num_duellers, int pf_weight,
+              int tenant);
+};
+
 class Triangel : public Queued
 {
+    typedef TriangelMetadataStore::MarkovMapping MarkovMapping;
+    typedef TriangelMetadataStore::Successor Successor;
 
     /** Number of maximum prefetches requests created when predicting */
     const unsigned degree;
+    /** Confident successors prefetched per Markov lookup, 0 for all */
+    const unsigned prefetchSuccessors;
 
     /**
      * Training Unit Entry datatype, it holds the last accessed address and
      * its secure flag
      */
 
+    /** Markov table and sizing state shared with the other prefetchers on this LLC */
+    TriangelMetadataStore* const metadata;
+    /** Our tenant id in the metadata store */
+    const int tenant;
     BaseTags* cachetags;
     const unsigned cacheDelay;
     const bool should_lookahead;
+    /** Largest distance a confident PC may look ahead by */
+    const unsigned maxLookahead;
+    /** Whether each PC learns its distance from prefetch lateness */
+    const bool adaptiveLookahead;
+    /** Whether each PC's degree follows the accuracy of its prefetches,
+     * and degree is cut while MSHRs are saturated */
+    const bool throttling;
+    /** MSHR occupancy at or above which prefetch degree is cut to 1 */
+    const double mshrThreshold;
+    /** Cache whose MSHRs are watched, or null for our own */
+    BaseCache* const throttleCache;
     const bool should_rearrange;
     
     const bool use_scs;
@@ -90,282 +435,66 @@ class Triangel : public Queued
     bool randomChance(int r, int s);
     const int max_size;
     const int size_increment;
-    static int64_t global_timestamp;
     uint64_t second_chance_timestamp;
     uint64_t lowest_blocked_entry;
-    static int current_size;
-    static int target_size;
     const int maxWays;    
     
-    static bloom* blptr;
-
-    bloom bl;
-    int bloomset=-1;
-    
-    std::vector<int> way_idx;
-    
         SatCounter8  globalReuseConfidence;
         SatCounter8  globalPatternConfidence;
         SatCounter8 globalHighPatternConfidence;    
    
 
-    struct TrainingUnitEntry : public TaggedEntry
+    /** Largest lookahead distance the training unit keeps history for */
+    static const unsigned MaxLookahead = 8;
+
+    struct TrainingUnitEntry : public TemporalTrainingEntry<MaxLookahead>
     {
-        Addr lastAddress;
-        Addr lastLastAddress;
         int64_t local_timestamp;
         SatCounter8  reuseConfidence;
         SatCounter8  patternConfidence;
         SatCounter8 highPatternConfidence;
         SatCounter8 replaceRate;
         SatCounter8 hawkConfidence;
-        bool lastAddressSecure;
-        bool lastLastAddressSecure;
+        /** Up on late prefetches from this PC, down on timely ones */
+        SatCounter8 lateness;
+        /** Up on used prefetches from this PC, down on unused ones */
+        SatCounter8 accuracy;
         bool currently_twodist_pf;
+        /** Distance the Markov index trails the target by when looking ahead */
+        unsigned lookahead;
+        /** Prefetches issued per confident access when throttling */
+        unsigned degree;
 
 
 
-        TrainingUnitEntry() : lastAddress(0), lastLastAddress(0), local_timestamp(0),reuseConfidence(4,8), patternConfidence(4,8), highPatternConfidence(4,8), replaceRate(4,8), hawkConfidence(4,8), lastAddressSecure(false), lastLastAddressSecure(false),currently_twodist_pf(false)
+        TrainingUnitEntry() : local_timestamp(0),reuseConfidence(4,8), patternConfidence(4,8), highPatternConfidence(4,8), replaceRate(4,8), hawkConfidence(4,8), lateness(4,8), accuracy(4,8), currently_twodist_pf(false), lookahead(0), degree(0)
         {}
 
         void
         invalidate() override
         {
-        	TaggedEntry::invalidate();
-                lastAddress = 0;
-                lastLastAddress = 0;
+        	TemporalTrainingEntry<MaxLookahead>::invalidate();
                 //local_timestamp=0; //Don't reset this, to handle replacement and still give contiguity of timestamp
                 reuseConfidence.reset();
                 patternConfidence.reset();
                 highPatternConfidence.reset();
                 replaceRate.reset();
+                lateness.reset();
+                accuracy.reset();
                 currently_twodist_pf = false;
+                lookahead = 0;
+                degree = 0;
                 
         }
     };
     /** Map of PCs to Training unit entries */
-    AssociativeSet<TrainingUnitEntry> trainingUnit;
+    AssociativeSet<TrainingUnitEntry, replacement_policy::InlineLRU>
+        trainingUnit;
     
-    Addr lookupTable[1024];
-    uint64_t lookupTick[1024];
-    const int lookupAssoc;
-    const int lookupOffset;
-    
-   
-  static std::vector<uint32_t> setPrefetch; 
- 
-public:
-  struct SizeDuel
-  {
-  	int idx;
-  	uint64_t set;
-  	uint64_t setMask;
-  	uint64_t temporalMod; //[0..12] Entries Per Line
-  	
-  	uint64_t temporalModMax; //12 by default
-  	uint64_t cacheMaxAssoc;
-  	
-  	
-  	std::vector<Addr> cacheAddrs; // [0..16] should be set by the nsets of the L3 cache.
-  	std::vector<uint64_t> cacheAddrTick;
-  	std::vector<Addr> temporalAddrs;
-  	std::vector<uint64_t> temporalAddrTick;
-  	std::vector<bool> inserted;
-
-  	SizeDuel()
-        {
-        }
-        void reset(uint64_t mask, uint64_t modMax, uint64_t cacheAssoc) {
-        	setMask=mask;
-        	temporalModMax = modMax;
-        	cacheMaxAssoc=cacheAssoc;
-        	cacheAddrTick.resize(cacheMaxAssoc);
-        	temporalAddrs.resize(cacheMaxAssoc);
-        	cacheAddrs.resize(cacheMaxAssoc);
-        	temporalAddrTick.resize(cacheMaxAssoc);
-        	inserted.resize(cacheMaxAssoc,false);
-        	for(int x=0;x<cacheMaxAssoc;x++) {
-			cacheAddrTick[x]=0;
-			temporalAddrs[x]=0;
-			cacheAddrs[x]=0;
-			temporalAddrTick[x]=0;
-		}
-		set = random_mt.random<uint64_t>(0,setMask);
-		temporalMod = random_mt.random<uint64_t>(0,modMax-1); // N-1, as range is inclusive.	
-        }
-  	
-  	int checkAndInsert(Addr addr, bool should_pf) {
-	  	int ret = 0;
-	  	bool foundInCache=false;
-	  	bool foundInTemp=false;
-	  	if((addr & setMask) != set) return ret;
-  		for(int x=0;x<cacheMaxAssoc;x++) {
-  			if(addr == cacheAddrs[x]) {
-  				foundInCache=true; 
-	  				int index=cacheMaxAssoc-1;
-	  				for(int y=0;y<cacheMaxAssoc;y++) {
-	  					if(cacheAddrTick[x]>cacheAddrTick[y]) index--;
-	  					assert(index>=0);
-	  				}  
-	  				cacheAddrTick[x] = curTick();
-	  				ret += index+1;	
-  			}
-  			if(should_pf && addr == temporalAddrs[x]) {
-  				
-  				
-  				foundInTemp=true;
-  				
-	  				int index=cacheMaxAssoc-1;
-	  				for(int y=0;y<cacheMaxAssoc;y++) {
-	  					if(temporalAddrTick[x]>temporalAddrTick[y]) index--;
-	  					assert(index>=0);
-	  				}  
-
-	  				ret += 128*(index+1);
-	  			
-	  			temporalAddrTick[x] = curTick();
-	  			inserted[x]=true;
-	  		}
-  		}
-  		if(!foundInCache) {
-  			uint64_t oldestTick = (uint64_t)-1;
-  			int idx = -1;
-  			for(int x=0; x<cacheMaxAssoc;x++) {
-  				if(cacheAddrTick[x]<oldestTick) {idx = x; oldestTick = cacheAddrTick[x];}
-  			}
-  			assert(idx>=0);
-  			cacheAddrs[idx]=addr;
-  			cacheAddrTick[idx]=curTick();
-  		}
-  		if(!foundInTemp && should_pf && (((addr / (setMask+1)) % temporalModMax) == temporalMod)) {
-  			uint64_t oldestTick = (uint64_t)-1;
-  			int idx = -1;
-  			for(int x=0; x<cacheMaxAssoc;x++) {
-  				if(temporalAddrTick[x]<oldestTick) {idx = x; oldestTick = temporalAddrTick[x]; }
-			}  			
-assert(idx>=0);
-  			temporalAddrs[idx]=addr;
-  			temporalAddrTick[idx]=curTick();
-  		}  
-  		return ret;		
-  	}
-  
-  };
-  SizeDuel sizeDuels[256];
-  static SizeDuel* sizeDuelPtr;
-
-
-  struct Hawkeye
-    {
-      int iteration;
-      uint64_t set;
-      uint64_t setMask; // address_map_rounded_entries/ maxElems - 1
-      Addr logaddrs[64];
-      Addr logpcs[64];
-      int logsize[64];
-      int maxElems = 8;
-      
-      Hawkeye(uint64_t mask, bool history) : iteration(0), set(0), setMask(mask)
-        {
-           reset();
-        }
-        
-      Hawkeye() : iteration(0), set(0)
-        {       }
-      
-      void reset() {
-        iteration=0;
-        for(int x=0;x<64;x++) {
-        	logsize[x]=0;
-        	logaddrs[x]=0;
-        	logpcs[x]=0;
-        }
-        set = random_mt.random<uint64_t>(0,setMask-1);
-      }
-      
-      void decrementOnLRU(Addr addr,AssociativeSet<TrainingUnitEntry>* trainer) {
-      	 if((addr % setMask) != set) return;
-         for(int y=iteration;y!=((iteration+1)&63);y=(y-1)&63) {
-               if(addr==logaddrs[y]) {
-               	    Addr pc = logpcs[y];
-               	    TrainingUnitEntry *entry = trainer->findEntry(pc, false); //TODO: is secure
-               	    if(entry!=nullptr) {
-               	    	if(entry->hawkConfidence>=8) {
-               	    		entry->hawkConfidence--;
-               	    		//printf("%s evicted, pc %s, temporality %d\n",addr, pc,entry->temporal);
-               	    	}
-               	    	
-               	    }
-               	    return;
-               }
-         }            
-      }
-      
-      void add(Addr addr,  Addr pc,AssociativeSet<TrainingUnitEntry>* trainer) {
-        if((addr % setMask) != set) return;
-        logaddrs[iteration]=addr;
-        logpcs[iteration]=pc;
-        logsize[iteration]=0;
-
-        
-        TrainingUnitEntry *entry = trainer->findEntry(pc, false); //TODO: is secure
-        if(entry!=nullptr) {
-          for(int y=(iteration-1)&63;y!=iteration;y=(y-1)&63) {
-               
-               if(logsize[y] == maxElems) {
-                 //no match
-                 //printf("%s above max elems, pc %s, temporality %d\n",addr, pc,entry->temporal-1);
-                 entry->hawkConfidence--;
-                 break;
-               }
-               if(addr==logaddrs[y]) {
-                 //found a match
-                 //printf("%s fits, pc %s, temporality %d\n",addr, pc,entry->temporal+1);
-                   entry->hawkConfidence++;
-                   for(int z=y;z!=iteration;z=(z+1)&63){
-                   	logsize[z]++;
-                   }
-                break;
-               }
-            }            
-        }
-        iteration++;
-        iteration = iteration % 64;
-      }
-      
-    };
-
-
-
-    
-    
-    Hawkeye hawksets[64];
+    /** OPTgen sampler training hawkConfidence */
+    HawkeyeSampler<TrainingUnitEntry> hawksets;
     bool useHawkeye;
 
-    /** Address Mapping entry, holds an address and a confidence counter */
-    struct MarkovMapping : public TaggedEntry
-    {
-      	Addr index; //Just for maintaining HawkEye easily. Not real.
-        Addr address;
-        int lookupIndex; //Only one of lookupIndex/Address are real.
-        bool confident;
-        Cycles cycle_issued; // only for prefetched cache and only in simulation
-        MarkovMapping() : index(0), address(0), confident(false), cycle_issued(0)
-        {}
-
-
-        void
-        invalidate() override
-        {
-                TaggedEntry::invalidate();
-                address = 0;
-                index = 0;
-                confident = false;
-                cycle_issued=Cycles(0);
-        }
-    };
-    
-
     /** Sample unit entry, tagged by data address, stores PC, timestamp, next element **/
     struct SampleEntry : public TaggedEntry
     {
@@ -403,20 +532,353 @@ assert(idx>=0);
     };
     AssociativeSet<SecondChanceEntry> secondChanceUnit;
 
-    /** History mappings table */
-    AssociativeSet<MarkovMapping> markovTable;
-    static AssociativeSet<MarkovMapping>* markovTablePtr;
+    /** History mappings table, owned by the metadata store */
+    TriangelMetadataStore::MarkovTable* const markovTablePtr;
     
 
     AssociativeSet<MarkovMapping> metadataReuseBuffer;
     bool lastAccessFromPFCache;
 
+    /** Markov entries fetched into the MRB past the end of each chain */
+    const unsigned metadataPrefetchDegree;
+
+    /**
+     * Hint the prefetches of chains without high pattern confidence, and
+     * of unconfident successors, as low-confidence to the caches they fill
+     */
+    const bool confidenceHints;
+
+    struct MRBStats : public statistics::Group
+    {
+        MRBStats(statistics::Group *parent);
+        /** Number of chain steps found in the MRB, already prefetched */
+        statistics::Scalar hits;
+        /** Number of chain steps found in the MRB, fetched ahead */
+        statistics::Scalar prefetchHits;
+        /** Number of entries fetched into the MRB ahead of a chain */
+        statistics::Scalar prefetches;
+    } mrbStats;
+
+    /**
+     * Fetch the Markov entries following index into the MRB, ahead of
+     * the chain that will need them.
+     */
+    void prefetchMetadata(Addr index, bool is_secure);
+
     MarkovMapping* getHistoryEntry(Addr index, bool is_secure, bool replace, bool readonly, bool clearing, bool hawk);
 
+    /** Port sending timed Markov table accesses to the LLC */
+    class MetadataPort : public RequestPort
+    {
+      public:
+        MetadataPort(const std::string &name, Triangel &owner);
+
+        /** Send an access, or hold it until the LLC can take it. */
+        void sendMetadataReq(PacketPtr pkt);
+
+      protected:
+        bool recvTimingResp(PacketPtr pkt) override;
+        void recvReqRetry() override;
+
+      private:
+        Triangel &owner;
+        /** Accesses refused by the LLC, oldest first */
+        std::deque<PacketPtr> blockedPackets;
+    };
+
+    /**
+     * A Markov prefetch chain in flight. Each step reads the entry that
+     * yields the next prefetch, so a step's prefetch is only queued once
+     * its read, and all reads before it, have returned from the LLC.
+     */
+    struct MetadataChain : public Packet::SenderState
+    {
+        struct Step
+        {
+            /** Markov index read from the LLC, MaxAddr if in the MRB */
+            Addr read;
+            /** Block to prefetch once the read returns, or MaxAddr */
+            Addr prefetch;
+            /** Whether the prefetch is hinted as confident */
+            bool confident = true;
+        };
+
+        /** The access that triggered the chain */
+        PrefetchInfo pfi;
+        std::vector<Step> steps;
+        size_t next;
+        /** Whether the read of the next step has been sent */
+        bool waiting;
+        /** Tick at which the outstanding read was sent */
+        Tick sent;
+
+        MetadataChain(const PrefetchInfo &trigger)
+          : pfi(trigger, trigger.getAddr()), next(0), waiting(false), sent(0)
+        {}
+    };
+
+    MetadataPort metadataPort;
+    /** Requestor ID the LLC recognises metadata accesses by */
+    const RequestorID metadataRequestorId;
+    /** Address space used to name Markov lines on the metadata port */
+    const Addr metadataBaseAddr;
+
+    struct MetadataTimingStats : public statistics::Group
+    {
+        MetadataTimingStats(statistics::Group *parent);
+        /** Number of timed Markov reads sent to the LLC */
+        statistics::Scalar reads;
+        /** Number of timed Markov updates sent to the LLC */
+        statistics::Scalar writes;
+        /** Ticks spent waiting for timed Markov reads */
+        statistics::Scalar readLatency;
+        statistics::Formula avgReadLatency;
+        /** Number of times the LLC refused a metadata access */
+        statistics::Scalar retries;
+    } metadataTimingStats;
+
+    struct LookaheadStats : public statistics::Group
+    {
+        LookaheadStats(statistics::Group *parent, unsigned max_lookahead);
+        /** Number of prefetches dropped as their block was in an MSHR */
+        statistics::Scalar latePrefetches;
+        /** Number of demand hits on blocks prefetched in time */
+        statistics::Scalar timelyPrefetches;
+        /** Number of times a PC's lookahead distance grew */
+        statistics::Scalar distanceIncreases;
+        /** Number of times a PC's lookahead distance shrank */
+        statistics::Scalar distanceDecreases;
+        /** Lookahead distance used by each trained access */
+        statistics::Distribution distance;
+    } lookaheadStats;
+
+    /** Distance a newly trained PC looks ahead by */
+    unsigned initialLookahead() const { return std::min(2u, maxLookahead); }
+
+    /**
+     * Train a PC's lookahead distance on the timeliness of one of its
+     * prefetches, moving one step once its lateness counter saturates.
+     */
+    void trainLookahead(TrainingUnitEntry *entry, bool late);
+
+    /** A prefetch issued to a block, kept to credit the PC behind it */
+    struct IssuedPrefetch
+    {
+        Addr block;
+        Addr pc;
+        bool secure;
+    };
+    /** Direct mapped by block. Empty unless throttling. */
+    std::vector<IssuedPrefetch> issuedTable;
+
+    struct ThrottleStats : public statistics::Group
+    {
+        ThrottleStats(statistics::Group *parent, unsigned max_degree);
+        /** Number of demand hits credited to the PC that prefetched them */
+        statistics::Scalar usefulPrefetches;
+        /** Number of unused evictions debited to the PC that prefetched them */
+        statistics::Scalar unusedPrefetches;
+        /** Number of times a PC's degree grew */
+        statistics::Scalar degreeIncreases;
+        /** Number of times a PC's degree shrank */
+        statistics::Scalar degreeDecreases;
+        /** Number of accesses whose degree was cut by saturated MSHRs */
+        statistics::Scalar mshrThrottled;
+        /** Degree used by each confident access */
+        statistics::Distribution degree;
+    } throttleStats;
+
+    /**
+     * Train a PC's degree on the accuracy of one of its prefetches,
+     * moving one step once its accuracy counter saturates.
+     */
+    void trainDegree(TrainingUnitEntry *entry, bool useful);
+
+    /** Whether the watched MSHRs are too full for more than one prefetch */
+    bool mshrsSaturated() const;
+
+    /** Remember that pc prefetched block. */
+    void recordIssued(Addr block, Addr pc, bool is_secure);
+
+    /**
+     * Train the PC that prefetched block, if it is still remembered, on
+     * whether the block was used, then forget the prefetch.
+     */
+    void creditIssued(Addr block, bool is_secure, bool useful);
+
+    /**
+     * Variants fed the same accesses as this prefetcher, with private
+     * tables, whose prefetches are scored instead of issued.
+     */
+    std::vector<Triangel*> shadows;
+
+    /**
+     * Blocks a shadow predicted and has not yet seen accessed, direct
+     * mapped by block. Empty unless this prefetcher is a shadow.
+     */
+    std::vector<Addr> shadowPredictions;
+    const unsigned shadowScoreEntries;
+
+    struct ShadowStats : public statistics::Group
+    {
+        ShadowStats(statistics::Group *parent);
+        /** Number of accesses the shadow was trained on */
+        statistics::Scalar accesses;
+        /** Number of prefetches the shadow would have issued */
+        statistics::Scalar predictions;
+        /** Number of predictions later accessed */
+        statistics::Scalar useful;
+        statistics::Formula accuracy;
+        statistics::Formula coverage;
+    };
+    /** Allocated only for shadows, so primaries report no shadow stats */
+    std::unique_ptr<ShadowStats> shadowStats;
+
+    /** Turn this prefetcher into a shadow of another one. */
+    void makeShadow();
+
+    /**
+     * Score an access against earlier shadow predictions, then train on
+     * it and remember what would have been prefetched.
+     */
+    void shadowNotify(const PrefetchInfo &pfi);
+
+    /**
+     * Whether a global miss-order history buffer prefetches alongside the
+     * PC-localised Markov table, catching sequences that interleave
+     * accesses from several PCs.
+     */
+    const bool globalHistory;
+    /** Prefetches issued per global history stream read */
+    const unsigned ghbDegree;
+    /** LLC ways holding the global history buffer */
+    const unsigned ghbWays;
+    /** History entries that fit in one LLC line */
+    const unsigned ghbEntriesPerLine;
+    /** Sets of the LLC, each holding one history line per way */
+    const uint64_t ghbLLCSets;
+
+    /** Index table entry, tagged by block, pointing at its last miss */
+    struct GHBIndexEntry : public TaggedEntry
+    {
+        uint64_t position;
+        GHBIndexEntry() : position(0)
+        {}
+
+        void
+        invalidate() override
+        {
+            TaggedEntry::invalidate();
+            position = 0;
+        }
+    };
+    AssociativeSet<GHBIndexEntry> ghbIndex;
+
+    /** Misses in order, as a circular buffer of LLC lines */
+    std::vector<Addr> ghb;
+    /** Position the next miss is written to; never wraps */
+    uint64_t ghbHead;
+    /** LLC ways taken by the history buffer, above the Markov table's */
+    LLCWayPartition ghbPartition;
+
+    struct GHBStats : public statistics::Group
+    {
+        GHBStats(statistics::Group *parent);
+        /** Number of misses appended to the history */
+        statistics::Scalar appends;
+        /** Number of misses whose last occurrence was still in the history */
+        statistics::Scalar indexHits;
+        /** Number of misses whose last occurrence had been overwritten */
+        statistics::Scalar staleIndexHits;
+        /** Number of prefetches read from the history */
+        statistics::Scalar prefetches;
+        /** Number of history lines read from the LLC */
+        statistics::Scalar lineReads;
+        /** Number of history lines started in the LLC */
+        statistics::Scalar lineWrites;
+    } ghbStats;
+
+    /**
+     * Look up the last occurrence of a miss in the global history, and
+     * prefetch the misses that followed it, then append this one.
+     */
+    void globalHistoryPrefetch(Addr addr, bool is_secure,
+                               std::vector<AddrPriority> &addresses);
+
+    /**
+     * Whether confident PCs also linearise their streams into structural
+     * addresses, so a whole prefetch chain is read from one structural
+     * line instead of one Markov lookup per prefetch.
+     */
+    const bool structuralAddresses;
+    StructuralAddressMap structuralMap;
+    /** Blocks read from a structural line, kept to avoid reallocation */
+    std::vector<Addr> structuralFollowers;
+
+    struct StructuralStats : public statistics::Group
+    {
+        StructuralStats(statistics::Group *parent);
+        /** Number of confident accesses looked up in the structural map */
+        statistics::Scalar lookups;
+        /** Number of lookups that found their structural line */
+        statistics::Scalar lineHits;
+        /** Number of prefetches read from structural lines */
+        statistics::Scalar prefetches;
+    } structuralStats;
+
+    /**
+     * Prefetch the blocks following target in its structural stream.
+     * @param high_degree_pf As for prefetchDegree().
+     * @param distance Structural distance of the first prefetch.
+     * @return Whether any prefetch was found, else the Markov table is
+     * walked instead.
+     */
+    bool structuralPrefetch(const PrefetchInfo &pfi,
+                            const TrainingUnitEntry *entry,
+                            bool high_degree_pf, Addr target,
+                            unsigned distance,
+                            std::vector<AddrPriority> &addresses);
+
+    /**
+     * Number of prefetches a confident access may issue.
+     * @param high_degree_pf Whether the PC is confident enough for more
+     * than one.
+     */
+    unsigned prefetchDegree(const TrainingUnitEntry *entry,
+                            bool high_degree_pf);
+
+    /** Whether Markov accesses go through the LLC rather than cacheDelay */
+    bool timedMetadata() const { return metadataPort.isConnected(); }
+
+    /**
+     * Send a timed access to the LLC line holding a Markov index.
+     * @param index Markov index whose line is accessed.
+     * @param write Whether the access updates the line.
+     * @param chain Chain to resume when a read returns, if any.
+     */
+    void sendMetadataAccess(Addr index, bool write, MetadataChain *chain);
+
+    /** Queue every prefetch of a chain up to its next outstanding read. */
+    void advanceChain(MetadataChain *chain);
+
+    /** Handle a timed metadata access returning from the LLC. */
+    void recvMetadataResp(PacketPtr pkt);
+
   public:
     Triangel(const TriangelPrefetcherParams &p);
     ~Triangel() = default;
 
+    void init() override;
+
+    void notifyPfHitInMSHR(const PacketPtr &pkt) override;
+    void notifyPrefetchUnused(Addr addr, bool is_secure) override;
+
+    void serialize(CheckpointOut &cp) const override;
+    void unserialize(CheckpointIn &cp) override;
+
+    Port &getPort(const std::string &if_name,
+                  PortID idx=InvalidPortID) override;
+
     void calculatePrefetch(const PrefetchInfo &pfi,
                            std::vector<AddrPriority> &addresses) override;
 };
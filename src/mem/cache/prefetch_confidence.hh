@@ -0,0 +1,58 @@
+/**
+ * @file
+ * Confidence hint carried by the requests of hardware prefetches.
+ */
+
+#ifndef __MEM_CACHE_PREFETCH_CONFIDENCE_HH__
+#define __MEM_CACHE_PREFETCH_CONFIDENCE_HH__
+
+#include <memory>
+
+#include "base/extensible.hh"
+#include "mem/packet.hh"
+#include "mem/request.hh"
+
+namespace gem5
+{
+
+/**
+ * Tells the caches a prefetch fills how confident its prefetcher was
+ * that the block will be used. It sits on the request, so it reaches
+ * every level the prefetch misses in. Replacement policies that honour it
+ * insert low-confidence prefetches at a distant re-reference position,
+ * and a demand that coalesces with the prefetch removes it.
+ */
+class PrefetchConfidence : public Extension<Request, PrefetchConfidence>
+{
+  public:
+    PrefetchConfidence(bool confident) : confident(confident) {}
+
+    std::unique_ptr<ExtensionBase>
+    clone() const override
+    {
+        return std::make_unique<PrefetchConfidence>(*this);
+    }
+
+    bool isConfident() const { return confident; }
+
+  private:
+    bool confident;
+};
+
+/**
+ * @param pkt Packet filling a block
+ * @return Whether pkt fills a block for a low-confidence prefetch
+ */
+inline bool
+isLowConfidencePrefetch(const PacketPtr pkt)
+{
+    if (!pkt || !pkt->req) {
+        return false;
+    }
+    auto hint = pkt->req->getExtension<PrefetchConfidence>();
+    return hint && !hint->isConfident();
+}
+
+} // namespace gem5
+
+#endif // __MEM_CACHE_PREFETCH_CONFIDENCE_HH__
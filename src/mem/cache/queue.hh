@@ -152,6 +152,12 @@ class Queue : public Drainable, public Named
         return (allocated >= numEntries - numReserve);
     }
 
+    /** Fraction of the entries, not counting the reserve, allocated */
+    double occupancy() const
+    {
+        return (double)allocated / (numEntries - numReserve);
+    }
+
     int numInService() const
     {
         return _numInService;
@@ -29,7 +29,9 @@
 #ifndef __MEM_CACHE_REPLACEMENT_POLICIES_BASE_HH__
 #define __MEM_CACHE_REPLACEMENT_POLICIES_BASE_HH__
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include "base/compiler.hh"
 #include "mem/cache/replacement_policies/replaceable_entry.hh"
@@ -53,6 +55,40 @@ namespace replacement_policy
  */
 class Base : public SimObject
 {
+  private:
+    /** Block replacement data is being handed out from */
+    std::shared_ptr<void> dataBlock;
+    /** Entries of the block, and how many of them were handed out */
+    size_t dataBlockEntries = 0;
+    size_t dataBlockUsed = 0;
+
+  protected:
+    /**
+     * Hand out replacement data from blocks of entries that share one
+     * allocation and one reference count, instead of allocating each entry
+     * and its control block separately. Neighbouring entries of a table
+     * then also have neighbouring replacement data. Blocks grow as more
+     * entries are instantiated, so small tables stay small.
+     *
+     * @param init Initial value of the replacement data.
+     * @return A shared pointer to the new replacement data.
+     */
+    template <class Data>
+    std::shared_ptr<ReplacementData>
+    allocateEntry(const Data &init)
+    {
+        if (dataBlockUsed == dataBlockEntries) {
+            dataBlockEntries = std::min<size_t>(
+                std::max<size_t>(2 * dataBlockEntries, 16), 4096);
+            dataBlock = std::make_shared<std::vector<Data>>(
+                dataBlockEntries, init);
+            dataBlockUsed = 0;
+        }
+        auto block = std::static_pointer_cast<std::vector<Data>>(dataBlock);
+        return std::shared_ptr<ReplacementData>(block,
+                                                &(*block)[dataBlockUsed++]);
+    }
+
   public:
     typedef BaseReplacementPolicyParams Params;
     Base(const Params &p) : SimObject(p) {}
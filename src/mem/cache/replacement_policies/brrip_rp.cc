@@ -33,6 +33,7 @@
 
 #include "base/logging.hh" // For fatal_if
 #include "base/random.hh"
+#include "mem/cache/prefetch_confidence.hh"
 #include "params/BRRIPRP.hh"
 
 namespace gem5
@@ -74,6 +75,19 @@ BRRIP::touch(const std::shared_ptr<ReplacementData>& replacement_data) const
     }
 }
 
+void
+BRRIP::reset(const std::shared_ptr<ReplacementData>& replacement_data,
+    const PacketPtr pkt)
+{
+    reset(replacement_data);
+
+    // Prefetches their prefetcher doubts are the first to go
+    if (isLowConfidencePrefetch(pkt)) {
+        std::static_pointer_cast<BRRIPReplData>(
+            replacement_data)->rrpv.saturate();
+    }
+}
+
 void
 BRRIP::reset(const std::shared_ptr<ReplacementData>& replacement_data) const
 {
@@ -144,7 +158,7 @@ BRRIP::getVictim(const ReplacementCandidates& candidates) const
 std::shared_ptr<ReplacementData>
 BRRIP::instantiateEntry()
 {
-    return std::shared_ptr<ReplacementData>(new BRRIPReplData(numRRPVBits));
+    return allocateEntry(BRRIPReplData(numRRPVBits));
 }
 
 } // namespace replacement_policy
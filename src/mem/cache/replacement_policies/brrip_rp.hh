@@ -112,6 +112,9 @@ class BRRIP : public Base
     const unsigned btp;
 
   public:
+    /** Mirrors this policy with its state inline */
+    friend class InlineBRRIP;
+
     typedef BRRIPRPParams Params;
     BRRIP(const Params &p);
     ~BRRIP() = default;
@@ -135,10 +138,14 @@ class BRRIP : public Base
 
     /**
      * Reset replacement data. Used when an entry is inserted.
-     * Set RRPV according to the insertion policy used.
+     * Set RRPV according to the insertion policy used, or as distant
+     * re-reference for low-confidence prefetches.
      *
      * @param replacement_data Replacement data to be reset.
+     * @param pkt Packet that generated this miss.
      */
+    void reset(const std::shared_ptr<ReplacementData>& replacement_data,
+        const PacketPtr pkt) override;
     void reset(const std::shared_ptr<ReplacementData>& replacement_data) const
                                                                      override;
 
@@ -91,7 +91,7 @@ FIFO::getVictim(const ReplacementCandidates& candidates) const
 std::shared_ptr<ReplacementData>
 FIFO::instantiateEntry()
 {
-    return std::shared_ptr<ReplacementData>(new FIFOReplData());
+    return allocateEntry(FIFOReplData());
 }
 
 } // namespace replacement_policy
@@ -0,0 +1,65 @@
+/**
+ * @file
+ * Inline copies of the configurable replacement policies.
+ */
+
+#include "mem/cache/replacement_policies/inline_rp.hh"
+
+#include <typeinfo>
+
+#include "mem/cache/replacement_policies/brrip_rp.hh"
+#include "mem/cache/replacement_policies/lru_rp.hh"
+#include "mem/cache/replacement_policies/ship_rp.hh"
+#include "mem/cache/replacement_policies/weighted_lru_rp.hh"
+
+namespace gem5
+{
+
+namespace replacement_policy
+{
+
+// Policies derived from the mirrored ones, e.g. BIP from LRU or SHiP from
+// BRRIP, decide differently, so only exact types are mirrored
+
+std::optional<InlineLRU>
+InlineLRU::create(const Base *policy, size_t num_entries)
+{
+    if (typeid(*policy) != typeid(LRU)) {
+        return std::nullopt;
+    }
+    return InlineLRU(num_entries);
+}
+
+std::optional<InlineWeightedLRU>
+InlineWeightedLRU::create(const Base *policy, size_t num_entries)
+{
+    if (typeid(*policy) != typeid(WeightedLRU)) {
+        return std::nullopt;
+    }
+    return InlineWeightedLRU(num_entries);
+}
+
+std::optional<InlineBRRIP>
+InlineBRRIP::create(const Base *policy, size_t num_entries)
+{
+    if (typeid(*policy) != typeid(BRRIP)) {
+        return std::nullopt;
+    }
+    auto brrip = static_cast<const BRRIP *>(policy);
+    return InlineBRRIP(num_entries, brrip->numRRPVBits, brrip->hitPriority,
+                       brrip->btp);
+}
+
+std::optional<InlineSHiP>
+InlineSHiP::create(Base *policy, size_t num_entries)
+{
+    if (typeid(*policy) != typeid(SHiPMem)) {
+        return std::nullopt;
+    }
+    auto ship = static_cast<SHiP *>(policy);
+    return InlineSHiP(num_entries, ship->numRRPVBits, ship->hitPriority,
+                      ship->btp, ship->SHCT, ship->insertionThreshold);
+}
+
+} // namespace replacement_policy
+} // namespace gem5
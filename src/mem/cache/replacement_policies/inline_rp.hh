@@ -0,0 +1,276 @@
+/**
+ * @file
+ * Replacement policies for containers that choose their policy at compile
+ * time. Their state is kept in arrays indexed by entry, the ways of a set
+ * being adjacent, rather than behind a shared pointer in every entry, and
+ * none of their calls is virtual. Each mirrors a configurable policy and
+ * makes the same decisions it would.
+ */
+
+#ifndef __MEM_CACHE_REPLACEMENT_POLICIES_INLINE_RP_HH__
+#define __MEM_CACHE_REPLACEMENT_POLICIES_INLINE_RP_HH__
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "base/random.hh"
+#include "base/sat_counter.hh"
+#include "base/types.hh"
+#include "sim/cur_tick.hh"
+
+namespace gem5
+{
+
+namespace replacement_policy
+{
+
+class Base;
+
+/**
+ * Inline LRU. Entries are touched and reset with their key, and victims
+ * are picked among the indexes of the candidate entries.
+ */
+class InlineLRU
+{
+  protected:
+    /** Tick of the last touch of every entry, 0 if invalid */
+    std::vector<Tick> lastTouch;
+
+  public:
+    /** Whether touches carry a weight for the policy to keep */
+    static constexpr bool weighted = false;
+
+    InlineLRU(size_t num_entries) : lastTouch(num_entries, 0) {}
+
+    /**
+     * @param policy Configured replacement policy.
+     * @param num_entries Entries of the container.
+     * @return The inline policy, if policy is exactly an LRU.
+     */
+    static std::optional<InlineLRU> create(const Base *policy,
+                                           size_t num_entries);
+
+    void invalidate(size_t entry) { lastTouch[entry] = 0; }
+    void touch(size_t entry) { lastTouch[entry] = curTick(); }
+    void reset(size_t entry, Addr key) { lastTouch[entry] = curTick(); }
+
+    /** @return The least recently touched candidate. */
+    size_t
+    getVictim(const std::vector<size_t> &candidates) const
+    {
+        assert(!candidates.empty());
+        size_t victim = candidates[0];
+        for (size_t candidate : candidates) {
+            if (lastTouch[candidate] < lastTouch[victim]) {
+                victim = candidate;
+            }
+        }
+        return victim;
+    }
+};
+
+/**
+ * Inline WeightedLRU. The weight of an entry is kept across invalidations
+ * and resets, as the configurable policy does.
+ */
+class InlineWeightedLRU : public InlineLRU
+{
+  protected:
+    /** Weight of the last weighted touch of every entry */
+    std::vector<int> weight;
+
+  public:
+    static constexpr bool weighted = true;
+
+    InlineWeightedLRU(size_t num_entries)
+      : InlineLRU(num_entries), weight(num_entries, 0)
+    {}
+
+    /** @return The inline policy, if policy is exactly a WeightedLRU. */
+    static std::optional<InlineWeightedLRU> create(const Base *policy,
+                                                   size_t num_entries);
+
+    using InlineLRU::touch;
+
+    void
+    touch(size_t entry, int occupancy)
+    {
+        touch(entry);
+        weight[entry] = occupancy;
+    }
+
+    /** @return The lightest candidate, the oldest among equals. */
+    size_t
+    getVictim(const std::vector<size_t> &candidates) const
+    {
+        assert(!candidates.empty());
+        size_t victim = candidates[0];
+        for (size_t candidate : candidates) {
+            if (weight[candidate] < weight[victim] ||
+                (weight[candidate] == weight[victim] &&
+                 lastTouch[candidate] < lastTouch[victim])) {
+                victim = candidate;
+            }
+        }
+        return victim;
+    }
+};
+
+/** Inline BRRIP, which RRIP and NRU configure. */
+class InlineBRRIP
+{
+  protected:
+    /** Re-reference prediction value of every entry */
+    std::vector<uint8_t> rrpv;
+    /** Whether every entry is valid */
+    std::vector<uint8_t> valid;
+    /** Most distant re-reference prediction value */
+    const uint8_t maxRRPV;
+    /** Whether hits make entries the last to be evicted */
+    const bool hitPriority;
+    /** Percentage of entries inserted as long rather than distant */
+    const unsigned btp;
+
+  public:
+    static constexpr bool weighted = false;
+
+    /**
+     * @param num_bits Bits of the re-reference prediction values.
+     * @param hit_priority Whether hits make entries the last to be evicted.
+     * @param btp Percentage of entries inserted as long re-reference.
+     */
+    InlineBRRIP(size_t num_entries, unsigned num_bits, bool hit_priority,
+                unsigned btp)
+      : rrpv(num_entries, 0), valid(num_entries, false),
+        maxRRPV((1 << num_bits) - 1), hitPriority(hit_priority), btp(btp)
+    {
+        assert(num_bits > 0 && num_bits <= 8);
+    }
+
+    /** @return The inline policy, if policy is exactly a BRRIP. */
+    static std::optional<InlineBRRIP> create(const Base *policy,
+                                             size_t num_entries);
+
+    void invalidate(size_t entry) { valid[entry] = false; }
+
+    void
+    touch(size_t entry)
+    {
+        if (hitPriority) {
+            rrpv[entry] = 0;
+        } else if (rrpv[entry] > 0) {
+            rrpv[entry]--;
+        }
+    }
+
+    void
+    reset(size_t entry, Addr key)
+    {
+        rrpv[entry] = maxRRPV;
+        if (random_mt.random<unsigned>(1, 100) <= btp) {
+            rrpv[entry]--;
+        }
+        valid[entry] = true;
+    }
+
+    /**
+     * @return The first invalid candidate, or else the first one with
+     * the most distant re-reference, after ageing every candidate until
+     * it is predicted distant.
+     */
+    size_t
+    getVictim(const std::vector<size_t> &candidates)
+    {
+        assert(!candidates.empty());
+        size_t victim = candidates[0];
+        for (size_t candidate : candidates) {
+            if (!valid[candidate]) {
+                return candidate;
+            }
+            if (rrpv[candidate] > rrpv[victim]) {
+                victim = candidate;
+            }
+        }
+        const uint8_t diff = maxRRPV - rrpv[victim];
+        if (diff > 0) {
+            for (size_t candidate : candidates) {
+                rrpv[candidate] += diff;
+            }
+        }
+        return victim;
+    }
+};
+
+/**
+ * Inline SHiPMem. Containers have no packet to sign entries with, so the
+ * key an entry is inserted with stands for the address SHiPMem signs by.
+ * The signature history counter table is the configured policy's, so it
+ * is trained by every container sharing the policy.
+ */
+class InlineSHiP : public InlineBRRIP
+{
+  protected:
+    /** Signature history counter table */
+    std::vector<SatCounter8> &shct;
+    /** Saturation of a signature's counter to insert as intermediate */
+    const double insertionThreshold;
+    /** Signature of every entry */
+    std::vector<uint32_t> signature;
+    /** Whether every entry was touched since it was inserted */
+    std::vector<uint8_t> reReferenced;
+
+  public:
+    /**
+     * @param shct Signature history counter table to train.
+     * @param insertion_threshold Saturation of a signature's counter
+     *        above which its entries are inserted as intermediate.
+     */
+    InlineSHiP(size_t num_entries, unsigned num_bits, bool hit_priority,
+               unsigned btp, std::vector<SatCounter8> &shct,
+               double insertion_threshold)
+      : InlineBRRIP(num_entries, num_bits, hit_priority, btp), shct(shct),
+        insertionThreshold(insertion_threshold),
+        signature(num_entries, 0), reReferenced(num_entries, false)
+    {}
+
+    /** @return The inline policy, if policy is exactly a SHiPMem. */
+    static std::optional<InlineSHiP> create(Base *policy,
+                                            size_t num_entries);
+
+    void
+    invalidate(size_t entry)
+    {
+        if (reReferenced[entry]) {
+            shct[signature[entry]]--;
+        }
+        InlineBRRIP::invalidate(entry);
+    }
+
+    void
+    touch(size_t entry)
+    {
+        shct[signature[entry]]++;
+        reReferenced[entry] = true;
+        InlineBRRIP::touch(entry);
+    }
+
+    void
+    reset(size_t entry, Addr key)
+    {
+        signature[entry] = key % shct.size();
+        reReferenced[entry] = false;
+        InlineBRRIP::reset(entry, key);
+        if (shct[signature[entry]].calcSaturation() >= insertionThreshold &&
+            rrpv[entry] > 0) {
+            rrpv[entry]--;
+        }
+    }
+};
+
+} // namespace replacement_policy
+} // namespace gem5
+
+#endif // __MEM_CACHE_REPLACEMENT_POLICIES_INLINE_RP_HH__
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2023
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "base/gtest/cur_tick_fake.hh"
+#include "base/sat_counter.hh"
+#include "mem/cache/replacement_policies/inline_rp.hh"
+
+using namespace gem5;
+
+namespace
+{
+
+GTestTickHandler tickHandler;
+
+/** Candidates of one set of four ways, the second set of a table. */
+const std::vector<size_t> ways = {4, 5, 6, 7};
+
+} // anonymous namespace
+
+/** Test that LRU evicts invalid entries, then the least recent one. */
+TEST(InlineRPTest, LRU)
+{
+    replacement_policy::InlineLRU lru(8);
+    for (size_t way : ways) {
+        tickHandler.setCurTick(10 + way);
+        lru.reset(way, way);
+    }
+    lru.invalidate(6);
+    ASSERT_EQ(lru.getVictim(ways), 6);
+
+    tickHandler.setCurTick(20);
+    lru.reset(6, 6);
+    ASSERT_EQ(lru.getVictim(ways), 4);
+    tickHandler.setCurTick(21);
+    lru.touch(4);
+    ASSERT_EQ(lru.getVictim(ways), 5);
+
+    // Only the candidates are considered
+    ASSERT_EQ(lru.getVictim({4, 6}), 6);
+}
+
+/**
+ * Test that weighted LRU evicts the lightest entry, the least recent among
+ * equals, and keeps weights across resets.
+ */
+TEST(InlineRPTest, WeightedLRU)
+{
+    replacement_policy::InlineWeightedLRU wlru(8);
+    for (size_t way : ways) {
+        tickHandler.setCurTick(10 + way);
+        wlru.reset(way, way);
+    }
+    ASSERT_EQ(wlru.getVictim(ways), 4);
+
+    tickHandler.setCurTick(30);
+    wlru.touch(4, 2);
+    wlru.touch(5, 1);
+    ASSERT_EQ(wlru.getVictim(ways), 6);
+    tickHandler.setCurTick(31);
+    wlru.touch(6, 1);
+    wlru.touch(7, 1);
+    ASSERT_EQ(wlru.getVictim(ways), 5);
+
+    // An unweighted touch keeps the weight
+    tickHandler.setCurTick(32);
+    wlru.touch(5);
+    ASSERT_EQ(wlru.getVictim(ways), 6);
+
+    // So does a reset
+    tickHandler.setCurTick(40);
+    wlru.invalidate(4);
+    wlru.reset(4, 4);
+    ASSERT_EQ(wlru.getVictim({4, 7}), 7);
+}
+
+/**
+ * Test that RRIP inserts entries as long re-reference, promotes them on
+ * hits and ages a set when none of it is predicted distant.
+ */
+TEST(InlineRPTest, RRIP)
+{
+    // Two bits, hit priority, always inserted as long re-reference
+    replacement_policy::InlineBRRIP rrip(8, 2, true, 100);
+
+    // Invalid entries go first
+    ASSERT_EQ(rrip.getVictim(ways), 4);
+    for (size_t way : ways) {
+        rrip.reset(way, way);
+    }
+
+    // All are long (2); the search ages the set so the first is distant
+    ASSERT_EQ(rrip.getVictim(ways), 4);
+    rrip.touch(4);
+    // 4 is near (0), the others were aged to distant (3)
+    ASSERT_EQ(rrip.getVictim(ways), 5);
+    rrip.reset(5, 5);
+    ASSERT_EQ(rrip.getVictim(ways), 6);
+
+    // After ageing 4 became long (2) and 5 distant (3): 5 goes before 4
+    rrip.touch(6);
+    rrip.touch(7);
+    ASSERT_EQ(rrip.getVictim(ways), 5);
+
+    rrip.invalidate(7);
+    ASSERT_EQ(rrip.getVictim(ways), 7);
+}
+
+/** Test that frequency priority hits only promote entries one step. */
+TEST(InlineRPTest, RRIPFrequencyPriority)
+{
+    // Always inserted as distant re-reference
+    replacement_policy::InlineBRRIP rrip(8, 2, false, 0);
+    for (size_t way : ways) {
+        rrip.reset(way, way);
+    }
+    rrip.touch(4);
+    rrip.touch(4);
+    rrip.touch(5);
+    // 4 is long-1 (1), 5 long (2), 6 and 7 distant (3)
+    ASSERT_EQ(rrip.getVictim(ways), 6);
+    rrip.invalidate(6);
+    rrip.invalidate(7);
+    ASSERT_EQ(rrip.getVictim({4, 5}), 5);
+    // 4 was aged by one along with 5, and is now long
+    rrip.touch(5);
+    rrip.touch(5);
+    ASSERT_EQ(rrip.getVictim({4, 5}), 4);
+}
+
+/**
+ * Test that SHiP inserts the entries of signatures that were re-referenced
+ * closer than those of others, and detrains on their invalidation.
+ */
+TEST(InlineRPTest, SHiP)
+{
+    std::vector<SatCounter8> shct(16, SatCounter8(2));
+    // Two bits, hit priority, always inserted as distant re-reference
+    // unless the signature's counter is at least half saturated
+    replacement_policy::InlineSHiP ship(8, 2, true, 0, shct, 0.5);
+
+    for (size_t way : ways) {
+        ship.reset(way, 0x100 + way);
+    }
+    // Keys 0x104 and 0x105 are signatures 4 and 5
+    ship.touch(4);
+    ship.touch(4);
+    ship.touch(4);
+    ship.touch(5);
+    ASSERT_EQ((uint8_t)shct[4], 3);
+    ASSERT_EQ((uint8_t)shct[5], 1);
+
+    // Signature 4 is still predicted to be re-referenced, 6 is not
+    ship.invalidate(4);
+    ASSERT_EQ((uint8_t)shct[4], 2);
+    ship.invalidate(6);
+    ASSERT_EQ((uint8_t)shct[6], 0);
+    ship.reset(4, 0x14);
+    ship.reset(6, 0x16);
+    ASSERT_EQ(ship.getVictim({4, 6}), 6);
+
+    // A key folds onto the signatures of the table
+    ship.reset(7, 0x105);
+    ship.touch(7);
+    ASSERT_EQ((uint8_t)shct[5], 2);
+}
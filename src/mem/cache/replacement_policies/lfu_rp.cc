@@ -89,7 +89,7 @@ LFU::getVictim(const ReplacementCandidates& candidates) const
 std::shared_ptr<ReplacementData>
 LFU::instantiateEntry()
 {
-    return std::shared_ptr<ReplacementData>(new LFUReplData());
+    return allocateEntry(LFUReplData());
 }
 
 } // namespace replacement_policy
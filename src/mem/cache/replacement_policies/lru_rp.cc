@@ -100,7 +100,7 @@ LRU::getVictim(const ReplacementCandidates& candidates) const
 std::shared_ptr<ReplacementData>
 LRU::instantiateEntry()
 {
-    return std::shared_ptr<ReplacementData>(new LRUReplData());
+    return allocateEntry(LRUReplData());
 }
 
 } // namespace replacement_policy
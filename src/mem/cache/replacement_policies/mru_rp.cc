@@ -98,7 +98,7 @@ MRU::getVictim(const ReplacementCandidates& candidates) const
 std::shared_ptr<ReplacementData>
 MRU::instantiateEntry()
 {
-    return std::shared_ptr<ReplacementData>(new MRUReplData());
+    return allocateEntry(MRUReplData());
 }
 
 } // namespace replacement_policy
@@ -92,7 +92,7 @@ Random::getVictim(const ReplacementCandidates& candidates) const
 std::shared_ptr<ReplacementData>
 Random::instantiateEntry()
 {
-    return std::shared_ptr<ReplacementData>(new RandomReplData());
+    return allocateEntry(RandomReplData());
 }
 
 } // namespace replacement_policy
@@ -134,7 +134,7 @@ SecondChance::getVictim(const ReplacementCandidates& candidates) const
 std::shared_ptr<ReplacementData>
 SecondChance::instantiateEntry()
 {
-    return std::shared_ptr<ReplacementData>(new SecondChanceReplData());
+    return allocateEntry(SecondChanceReplData());
 }
 
 } // namespace replacement_policy
@@ -29,6 +29,7 @@
 #include "mem/cache/replacement_policies/ship_rp.hh"
 
 #include "base/logging.hh"
+#include "mem/cache/prefetch_confidence.hh"
 #include "params/SHiPMemRP.hh"
 #include "params/SHiPPCRP.hh"
 #include "params/SHiPRP.hh"
@@ -132,6 +133,12 @@ SHiP::reset(const std::shared_ptr<ReplacementData>& replacement_data,
     if (SHCT[signature].calcSaturation() >= insertionThreshold) {
         casted_replacement_data->rrpv--;
     }
+
+    // Low-confidence prefetches are inserted as distant re-reference,
+    // whatever their signature predicts
+    if (isLowConfidencePrefetch(pkt)) {
+        casted_replacement_data->rrpv.saturate();
+    }
 }
 
 void
@@ -144,7 +151,7 @@ SHiP::reset(const std::shared_ptr<ReplacementData>& replacement_data)
 std::shared_ptr<ReplacementData>
 SHiP::instantiateEntry()
 {
-    return std::shared_ptr<ReplacementData>(new SHiPReplData(numRRPVBits));
+    return allocateEntry(SHiPReplData(numRRPVBits));
 }
 
 SHiPMem::SHiPMem(const SHiPMemRPParams &p) : SHiP(p) {}
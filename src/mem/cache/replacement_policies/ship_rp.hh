@@ -115,6 +115,9 @@ class SHiP : public BRRIP
     virtual SignatureType getSignature(const PacketPtr pkt) const = 0;
 
   public:
+    /** Mirrors this policy with its state inline */
+    friend class InlineSHiP;
+
     typedef SHiPRPParams Params;
     SHiP(const Params &p);
     ~SHiP() = default;
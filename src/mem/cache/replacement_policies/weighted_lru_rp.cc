@@ -93,7 +93,7 @@ WeightedLRU::getVictim(const ReplacementCandidates& candidates) const
 std::shared_ptr<ReplacementData>
 WeightedLRU::instantiateEntry()
 {
-    return std::shared_ptr<ReplacementData>(new WeightedLRUReplData);
+    return allocateEntry(WeightedLRUReplData());
 }
 
 } // namespace replacement_policy
@@ -106,6 +106,15 @@ class SetAssociative : public BaseIndexingPolicy
      */
     ~SetAssociative() {};
 
+    /**
+     * Get the set an address maps to. Lets containers that store the
+     * entries of a set contiguously find them without building a vector.
+     *
+     * @param addr The address.
+     * @return The set index of the address.
+     */
+    uint32_t getSetIndex(const Addr addr) const { return extractSet(addr); }
+
     /**
      * Find all possible entries for insertion and replacement of an address.
      * Should be called immediately before ReplacementPolicy's findVictim()